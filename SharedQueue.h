@@ -1,6 +1,7 @@
 #ifndef SHAREDQUEUE_H
 #define SHAREDQUEUE_H
 
+#include <algorithm>
 #include <condition_variable>
 #include <iostream>
 #include <mutex>
@@ -13,11 +14,15 @@ template <typename T> class SharedQueue {
     ~SharedQueue(); // Деструктор класса
 
     T &front();     // Возвращает ссылку на элемент в начале очереди
-    T &pop_front(); // Удаляет и возвращает элемент в начале очереди
+    T pop_front();  // Удаляет и возвращает элемент в начале очереди
 
     void push_back(const T &item); // Добавляет элемент в конец очереди
     void push_back(T &&item);      // Добавляет rvalue элемент в конец очереди
+    void push_front(const T &item); // Добавляет элемент в начало очереди
+    void push_front(T &&item);      // Добавляет rvalue элемент в начало очереди
     void clear();                  // Очищает очередь
+    template <typename Predicate> int remove_if(Predicate pred); // Удаляет элементы по условию
+    template <typename Predicate> int count_if(Predicate pred);  // Считает элементы по условию
 
     int size();                    // Возвращает количество элементов в очереди
     bool empty();                  // Проверяет, пуста ли очередь.
@@ -44,14 +49,15 @@ template <typename T> T &SharedQueue<T>::front()
     return queue_.front();
 }
 
-template <typename T> T &SharedQueue<T>::pop_front()
+template <typename T> T SharedQueue<T>::pop_front()
 {
     std::unique_lock<std::mutex> mlock(mutex_);
     while (queue_.empty())
     {
         cond_.wait(mlock);
     }
-    T &front = queue_.front();
+    // Элемент перемещается до удаления: ссылка на него после pop_front была бы висячей
+    T front = std::move(queue_.front());
     queue_.pop_front();
     return front;
 }
@@ -71,6 +77,22 @@ template <typename T> void SharedQueue<T>::push_back(T &&item)
     mlock.unlock();
     cond_.notify_one();
 }
+template <typename T> void SharedQueue<T>::push_front(const T &item)
+{
+    std::unique_lock<std::mutex> mlock(mutex_);
+    queue_.push_front(item);
+    mlock.unlock();
+    cond_.notify_one();
+}
+
+template <typename T> void SharedQueue<T>::push_front(T &&item)
+{
+    std::unique_lock<std::mutex> mlock(mutex_);
+    queue_.push_front(std::move(item));
+    mlock.unlock();
+    cond_.notify_one();
+}
+
 template <typename T> int SharedQueue<T>::size()
 {
     std::unique_lock<std::mutex> mlock(mutex_);
@@ -93,4 +115,20 @@ template <typename T> void SharedQueue<T>::clear()
     cond_.notify_one();
 }
 
+// Удаляет элементы, для которых pred возвращает true, и возвращает их количество.
+template <typename T> template <typename Predicate> int SharedQueue<T>::remove_if(Predicate pred)
+{
+    std::unique_lock<std::mutex> mlock(mutex_);
+    auto iter = std::remove_if(queue_.begin(), queue_.end(), pred);
+    int removed = std::distance(iter, queue_.end());
+    queue_.erase(iter, queue_.end());
+    return removed;
+}
+
+template <typename T> template <typename Predicate> int SharedQueue<T>::count_if(Predicate pred)
+{
+    std::unique_lock<std::mutex> mlock(mutex_);
+    return std::count_if(queue_.begin(), queue_.end(), pred);
+}
+
 #endif // SHAREDQUEUE_H
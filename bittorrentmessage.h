@@ -26,7 +26,15 @@ enum MessageId
     request = 6,
     piece = 7,
     cancel = 8,
-    port = 9
+    port = 9,
+    // Fast Extension (BEP 6)
+    suggestPiece = 13,
+    haveAll = 14,
+    haveNone = 15,
+    rejectRequest = 16,
+    allowedFast = 17,
+    // Протокол расширений (BEP 10)
+    extended = 20
 };
 
 // Класс для представления сообщений BitTorrent
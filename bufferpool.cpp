@@ -0,0 +1,52 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "bufferpool.h"
+
+BufferPool::BufferPool(size_t bufferSize, size_t alignment, size_t maxBuffers)
+    : bufferSize((bufferSize + alignment - 1) / alignment * alignment), alignment(alignment),
+      maxBuffers(std::max<size_t>(maxBuffers, 1))
+{
+}
+
+BufferPool::~BufferPool()
+{
+    for (char *buffer : available)
+    {
+        free(buffer);
+    }
+}
+
+char *BufferPool::acquire()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    released.wait(guard, [this] { return !available.empty() || allocated < maxBuffers; });
+    if (!available.empty())
+    {
+        char *buffer = available.back();
+        available.pop_back();
+        return buffer;
+    }
+    void *buffer = nullptr;
+    if (posix_memalign(&buffer, alignment, bufferSize) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    allocated++;
+    return (char *)buffer;
+}
+
+void BufferPool::release(char *buffer)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        available.push_back(buffer);
+    }
+    released.notify_one();
+}
+
+size_t BufferPool::getBufferSize() const
+{
+    return bufferSize;
+}
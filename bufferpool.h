@@ -0,0 +1,34 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/*
+ Пул выровненных буферов одинакового размера (для записи с O_DIRECT адрес буфера должен быть
+ выровнен по границе блока устройства). Буферы выделяются по мере надобности, но не более
+ maxBuffers; при исчерпании acquire ждет возврата буфера другим потоком. Потокобезопасен.
+ */
+class BufferPool {
+    private:
+    const size_t bufferSize;         // Размер буфера
+    const size_t alignment;          // Выравнивание адреса буфера
+    const size_t maxBuffers;         // Наибольшее количество выделенных буферов
+    size_t allocated = 0;            // Выделено буферов
+    std::vector<char *> available;   // Свободные буферы
+    std::mutex lock;                 // Мьютекс для предотвращения гонок
+    std::condition_variable released; // Уведомление о возврате буфера
+
+    public:
+    BufferPool(size_t bufferSize, size_t alignment, size_t maxBuffers); // Конструктор класса
+    ~BufferPool();                   // Деструктор класса, освобождает буферы
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+    char *acquire();                 // Свободный буфер (std::bad_alloc, если память не выделена)
+    void release(char *buffer);      // Возврат буфера в пул
+    size_t getBufferSize() const;    // Размер буфера
+};
+
+#endif                               // BUFFERPOOL_H
@@ -0,0 +1,125 @@
+#include <algorithm>
+
+#include "choker.h"
+
+#define OPTIMISTIC_ROTATION_TICKS 3 // Смена оптимистичного пира каждые 3 пересчета (30 секунд)
+
+Choker::Choker(const int unchokeSlots, const int optimisticSlots)
+    : unchokeSlots(unchokeSlots), optimisticSlots(optimisticSlots)
+{
+}
+
+void Choker::setSlots(int unchokeSlots, int optimisticSlots)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    this->unchokeSlots = std::max(unchokeSlots, 0);
+    this->optimisticSlots = std::max(optimisticSlots, 0);
+}
+
+void Choker::addConnection(PeerConnection *connection)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    connections.push_back(connection);
+}
+
+void Choker::removeConnection(PeerConnection *connection)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    connections.erase(std::remove(connections.begin(), connections.end(), connection), connections.end());
+    optimistic.erase(std::remove(optimistic.begin(), optimistic.end(), connection), optimistic.end());
+    unchoked.erase(std::remove(unchoked.begin(), unchoked.end(), connection), unchoked.end());
+}
+
+void Choker::tick(bool seeding)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::vector<Candidate> candidates;
+    for (PeerConnection *connection : connections)
+    {
+        if (connection->isConnected() && connection->isPeerInterested())
+        {
+            double rate = seeding ? connection->getUploadRate() : connection->getDownloadRate();
+            candidates.emplace_back(rate, connection);
+        }
+    }
+    unchoked = choose(std::move(candidates));
+
+    for (PeerConnection *connection : connections)
+    {
+        bool keep = std::find(unchoked.begin(), unchoked.end(), connection) != unchoked.end();
+        connection->setChoking(!keep);
+    }
+}
+
+bool Choker::interested(PeerConnection *connection)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (std::find(connections.begin(), connections.end(), connection) == connections.end())
+    {
+        return false;
+    }
+    if (std::find(unchoked.begin(), unchoked.end(), connection) != unchoked.end())
+    {
+        return true;
+    }
+    // Слот занимается до следующего пересчета, где пир конкурирует с остальными по скорости
+    if ((int)unchoked.size() >= unchokeSlots + optimisticSlots)
+    {
+        return false;
+    }
+    unchoked.push_back(connection);
+    connection->setChoking(false);
+    return true;
+}
+
+std::vector<PeerConnection *> Choker::choose(std::vector<Candidate> candidates)
+{
+    std::sort(candidates.begin(), candidates.end(),
+              [](const auto &a, const auto &b) { return a.first > b.first; });
+
+    std::vector<PeerConnection *> selected;
+    for (const auto &[rate, connection] : candidates)
+    {
+        if ((int)selected.size() >= unchokeSlots)
+        {
+            break;
+        }
+        selected.push_back(connection);
+    }
+
+    // Оптимистичные пиры выбираются из тех, кто не прошел по скорости
+    std::vector<PeerConnection *> rest;
+    for (size_t i = selected.size(); i < candidates.size(); i++)
+    {
+        rest.push_back(candidates[i].second);
+    }
+    optimistic.erase(std::remove_if(optimistic.begin(), optimistic.end(),
+                                    [&rest](PeerConnection *connection) {
+                                        return std::find(rest.begin(), rest.end(), connection) == rest.end();
+                                    }),
+                     optimistic.end());
+    // Пиры, которые еще не были оптимистичными, идут первыми; при плановой смене слоты освобождаются
+    std::shuffle(rest.begin(), rest.end(), generator);
+    std::stable_partition(rest.begin(), rest.end(), [this](PeerConnection *connection) {
+        return std::find(optimistic.begin(), optimistic.end(), connection) == optimistic.end();
+    });
+    if (tickCount % OPTIMISTIC_ROTATION_TICKS == 0)
+    {
+        optimistic.clear();
+    }
+    for (PeerConnection *connection : rest)
+    {
+        if ((int)optimistic.size() >= optimisticSlots)
+        {
+            break;
+        }
+        if (std::find(optimistic.begin(), optimistic.end(), connection) == optimistic.end())
+        {
+            optimistic.push_back(connection);
+        }
+    }
+    tickCount++;
+    selected.insert(selected.end(), optimistic.begin(), optimistic.end());
+    return selected;
+}
@@ -0,0 +1,43 @@
+#ifndef CHOKER_H
+#define CHOKER_H
+
+#include <mutex>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "peerconnection.h"
+
+/*
+ Алгоритм tit-for-tat: раз в интервал разблокирует отдачу заинтересованным пирам
+ с наибольшей скоростью (загрузки от них при скачивании, отдачи им при раздаче),
+ а каждые несколько интервалов меняет пира в слоте оптимистичной разблокировки.
+ */
+class Choker {
+    private:
+    std::vector<PeerConnection *> connections;  // Соединения торрента
+    int unchokeSlots;                           // Количество слотов по скорости
+    int optimisticSlots;                        // Количество оптимистичных слотов
+    std::vector<PeerConnection *> optimistic;   // Текущие оптимистично разблокированные соединения
+    std::vector<PeerConnection *> unchoked;     // Разблокированные соединения (по скорости и оптимистичные)
+    int tickCount = 0;                          // Количество выполненных пересчетов
+    std::mt19937 generator{std::random_device{}()};
+    std::mutex lock;                            // Мьютекс для предотвращения гонок
+
+    public:
+    using Candidate = std::pair<double, PeerConnection *>; // Заинтересованный пир и его скорость
+
+    explicit Choker(int unchokeSlots = 4, int optimisticSlots = 1); // Конструктор класса
+    void setSlots(int unchokeSlots, int optimisticSlots);          // Изменение количества слотов
+    void addConnection(PeerConnection *connection);                // Регистрация соединения
+    void removeConnection(PeerConnection *connection);             // Удаление соединения
+    void tick(bool seeding);                    // Пересчет блокировок (seeding - режим раздачи)
+    // Пир заинтересовался нашими фрагментами: при свободном слоте он разблокируется сразу, не дожидаясь
+    // пересчета. Возвращает, разблокирован ли пир
+    bool interested(PeerConnection *connection);
+    // Выбор разблокируемых пиров среди кандидатов (соединения не разыменовываются); продвигает
+    // ротацию оптимистичного слота. Вызывается из tick под мьютексом
+    std::vector<PeerConnection *> choose(std::vector<Candidate> candidates);
+};
+
+#endif                                          // CHOKER_H
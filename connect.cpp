@@ -2,17 +2,21 @@
 #include "utils.h"
 #include <arpa/inet.h>
 #include <chrono>
+#include <cerrno>
 #include <cstring>
 #include <fcntl.h>
 #include <limits>
 #include <netinet/in.h>
 #include <stdexcept>
 #include <sys/poll.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <vector>
 
 #define CONNECT_TIMEOUT 3
 #define READ_TIMEOUT 3000 // 3 секунды
+#define SENDFILE_FALLBACK_BUFFER 131072 // Размер буфера, если sendfile недоступен
 
 // Установка сокета в блокирующий или неблокирующий режим
 bool setSocketBlocking(int sock, bool blocking)
@@ -30,31 +34,24 @@ bool setSocketBlocking(int sock, bool blocking)
     return (fcntl(sock, F_SETFL, flags) == 0);
 }
 
-int createConnection(const std::string &ip, const int port)
+int createConnection(const struct sockaddr *address, socklen_t length)
 {
     int sock = 0;
-    struct sockaddr_in address;
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    if (length == 0)
     {
-        throw std::runtime_error("Ошибка создания сокета: " + std::to_string(sock));
+        throw std::runtime_error("Некорректный адрес пира");
     }
-    address.sin_family = AF_INET;
-    address.sin_port = htons(port);
-
-    char *tempIp = new char[ip.length() + 1];
-    strcpy(tempIp, ip.c_str());
-
-    // Преобразование IP-адреса из строки в структуру in_addr
-    if (inet_pton(AF_INET, tempIp, &address.sin_addr) <= 0)
+    if ((sock = socket(address->sa_family, SOCK_STREAM, 0)) < 0)
     {
-        throw std::runtime_error("Некорректный IP-адрес: " + ip);
+        throw std::runtime_error("Ошибка создания сокета: " + std::to_string(sock));
     }
     // Установка сокета в неблокирующий режим
     if (!setSocketBlocking(sock, false))
     {
+        close(sock);
         throw std::runtime_error("Произошла ошибка при установке сокета " + std::to_string(sock) + " в режим NONBLOCK");
     }
-    connect(sock, (struct sockaddr *)&address, sizeof(address));
+    connect(sock, address, length);
 
     fd_set fdset;
     struct timeval tv;
@@ -82,27 +79,97 @@ int createConnection(const std::string &ip, const int port)
         }
     }
     close(sock);
-    throw std::runtime_error("Подключение к " + ip + ": НЕУДАЧА [Таймаут подключения]");
+    throw std::runtime_error("Подключение к пиру: НЕУДАЧА [Таймаут подключения]");
 }
 
 // Отправка данных по указанному сокету
-void sendData(const int sock, const std::string &data)
+void sendData(const int sock, const std::string &data, RateLimiter *limiter)
 {
     int n = data.length();
+    if (limiter)
+    {
+        limiter->acquire(n);
+    }
     char buffer[n];
     for (int i = 0; i < n; i++)
     {
         buffer[i] = data[i];
     }
-    int res = send(sock, buffer, n, 0);
+    int res = send(sock, buffer, n, MSG_NOSIGNAL);
     if (res < 0)
     {
         throw std::runtime_error("Не удалось записать данные в сокет " + std::to_string(sock));
     }
 }
 
+// Отправка участка памяти по указанному сокету
+void sendMemoryData(const int sock, const char *data, long length, RateLimiter *limiter)
+{
+    if (limiter)
+    {
+        limiter->acquire(length);
+    }
+    while (length > 0)
+    {
+        ssize_t sent = send(sock, data, length, MSG_NOSIGNAL);
+        if (sent <= 0)
+        {
+            throw std::runtime_error("Не удалось записать данные в сокет " + std::to_string(sock));
+        }
+        data += sent;
+        length -= sent;
+    }
+}
+
+// Отправка части файла по указанному сокету
+void sendFileData(const int sock, const int fd, long offset, long length, RateLimiter *limiter)
+{
+    if (limiter)
+    {
+        limiter->acquire(length);
+    }
+    off_t position = offset;
+    while (length > 0)
+    {
+        ssize_t sent = sendfile(sock, fd, &position, length);
+        if (sent < 0 && (errno == EINVAL || errno == ENOSYS))
+        {
+            // sendfile недоступен для этого дескриптора: читаем через буфер потока
+            thread_local std::vector<char> buffer(SENDFILE_FALLBACK_BUFFER);
+            ssize_t bytesRead = pread(fd, buffer.data(), std::min<long>(length, buffer.size()), position);
+            if (bytesRead <= 0 || send(sock, buffer.data(), bytesRead, MSG_NOSIGNAL) != bytesRead)
+            {
+                throw std::runtime_error("Не удалось отправить данные файла в сокет " + std::to_string(sock));
+            }
+            position += bytesRead;
+            sent = bytesRead;
+        }
+        else if (sent <= 0)
+        {
+            throw std::runtime_error("Не удалось отправить данные файла в сокет " + std::to_string(sock));
+        }
+        length -= sent;
+    }
+}
+
+// Ожидание входящих данных на сокете
+bool waitForData(const int sock, int timeout)
+{
+    struct pollfd fd;
+    fd.fd = sock;
+    fd.events = POLLIN;
+    fd.revents = 0;
+    int ret = poll(&fd, 1, timeout);
+    if (ret < 0 && errno != EINTR)
+    {
+        throw std::runtime_error("Чтение из сокета " + std::to_string(sock) + " не удалось");
+    }
+    // Закрытие или ошибка соединения тоже пробуждают poll: их обнаружит последующее чтение
+    return ret > 0;
+}
+
 // Получение данных из указанного сокета
-std::string receiveData(const int sock, uint32_t bufferSize)
+std::string receiveData(const int sock, uint32_t bufferSize, RateLimiter *limiter)
 {
     std::string reply;
 
@@ -126,11 +193,11 @@ std::string receiveData(const int sock, uint32_t bufferSize)
         case 0:
             throw std::runtime_error("Таймаут чтения из сокета " + std::to_string(sock));
         default:
-            bytesRead = recv(sock, buffer, sizeof(buffer), 0);
+            bytesRead = recv(sock, buffer, sizeof(buffer), MSG_WAITALL);
         }
         if (bytesRead != lengthIndicatorSize)
         {
-            return reply;
+            throw std::runtime_error("Соединение на сокете " + std::to_string(sock) + " закрыто пиром");
         }
 
         std::string messageLengthStr;
@@ -139,6 +206,11 @@ std::string receiveData(const int sock, uint32_t bufferSize)
             messageLengthStr += i;
         }
         uint32_t messageLength = bytesToInt(messageLengthStr);
+        // Сообщение нулевой длины - keep-alive
+        if (messageLength == 0)
+        {
+            return reply;
+        }
         bufferSize = messageLength;
     }
 
@@ -148,6 +220,12 @@ std::string receiveData(const int sock, uint32_t bufferSize)
     {
         throw std::runtime_error("Получены поврежденные данные [Размер буфера превышает 2 ^ 16 - 1]");
     }
+    // Токены резервируются до чтения: пока поток ждет, данные остаются в буфере ядра
+    // и TCP сам притормаживает отправителя
+    if (limiter)
+    {
+        limiter->acquire(bufferSize);
+    }
     char buffer[bufferSize];
     long bytesRead = 0;
     long bytesToRead = bufferSize;
@@ -159,7 +237,7 @@ std::string receiveData(const int sock, uint32_t bufferSize)
         {
             throw std::runtime_error("Таймаут чтения из сокета " + std::to_string(sock));
         }
-        bytesRead = recv(sock, buffer, bufferSize, 0);
+        bytesRead = recv(sock, buffer, bytesToRead, 0);
 
         if (bytesRead <= 0)
         {
@@ -10,16 +10,30 @@
 #include <regex>
 #include <sstream>
 #include <string>
+#include <sys/socket.h>
 
 #include "log.h"
+#include "ratelimiter.h"
 
-// Создание TCP-соединения с указанным IP-адресом и портом
-int createConnection(const std::string &ip, int port);
+// Установка сокета в блокирующий или неблокирующий режим
+bool setSocketBlocking(int sock, bool blocking);
 
-// Отправка данных по указанному сокету
-void sendData(int sock, const std::string &data);
+// Создание TCP-соединения с адресом пира (sockaddr_in/sockaddr_in6 в сетевом порядке байт)
+int createConnection(const struct sockaddr *address, socklen_t length);
 
-// Получение данных из указанного сокета
-std::string receiveData(int sock, uint32_t bufferSize = 0);
+// Отправка данных по указанному сокету (limiter - корзина отдачи, nullptr без ограничения)
+void sendData(int sock, const std::string &data, RateLimiter *limiter = nullptr);
+
+// Отправка length байт из памяти (например, из отображенного файла) без промежуточного буфера
+void sendMemoryData(int sock, const char *data, long length, RateLimiter *limiter = nullptr);
+
+// Отправка length байт файла fd, начиная с offset, напрямую из page cache (sendfile)
+void sendFileData(int sock, int fd, long offset, long length, RateLimiter *limiter = nullptr);
+
+// Ожидание входящих данных на сокете не дольше timeout миллисекунд; false - данных нет
+bool waitForData(int sock, int timeout);
+
+// Получение данных из указанного сокета (limiter - корзина загрузки, nullptr без ограничения)
+std::string receiveData(int sock, uint32_t bufferSize = 0, RateLimiter *limiter = nullptr);
 
 #endif // CONNECT_H
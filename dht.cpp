@@ -0,0 +1,749 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <random>
+#include <set>
+#include <sstream>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "dht.h"
+#include "sha1.h"
+#include "utils.h"
+
+#define DHT_ID_LEN 20              // Длина идентификатора узла и info_hash
+#define DHT_K 8                    // Размер k-корзины и ширина поиска
+#define DHT_ALPHA 3                // Максимальное количество параллельных запросов одного поиска
+#define DHT_QUERY_TIMEOUT 2000     // Время ожидания ответа узла (миллисекунды)
+#define DHT_LOOKUP_TIMEOUT 15000   // Максимальная длительность поиска (миллисекунды)
+#define DHT_MAX_FAILURES 3         // Узел удаляется после стольких запросов без ответа
+#define DHT_MAX_STORED_PEERS 100   // Максимум объявленных пиров на один info_hash
+#define COMPACT_NODE_LEN 26        // Компактная запись узла: идентификатор, IPv4 и порт
+#define TOKEN_LEN 8                // Длина токена announce_peer
+#define POLL_INTERVAL 500          // Интервал проверки остановки потока приема (миллисекунды)
+#define MAX_DATAGRAM 2048          // Максимальный размер принимаемого сообщения
+
+// Значение ключа словаря без рекурсивного поиска во вложенных словарях (в отличие от getValue)
+static std::shared_ptr<BItem> child(const std::shared_ptr<BDictionary> &dictionary, const std::string &key)
+{
+    if (!dictionary)
+    {
+        return nullptr;
+    }
+    for (const auto &item : *dictionary)
+    {
+        if (item.first->value() == key)
+        {
+            return item.second;
+        }
+    }
+    return nullptr;
+}
+
+static std::string childString(const std::shared_ptr<BDictionary> &dictionary, const std::string &key)
+{
+    auto value = std::dynamic_pointer_cast<BString>(child(dictionary, key));
+    return value ? value->value() : "";
+}
+
+// Сравнение расстояний XOR: true, если a ближе к target, чем b
+static bool closer(const std::string &a, const std::string &b, const std::string &target)
+{
+    for (int i = 0; i < DHT_ID_LEN; i++)
+    {
+        auto da = (uint8_t)(a[i] ^ target[i]);
+        auto db = (uint8_t)(b[i] ^ target[i]);
+        if (da != db)
+        {
+            return da < db;
+        }
+    }
+    return false;
+}
+
+// Номер k-корзины: длина общего префикса идентификаторов в битах
+static int bucketIndex(const std::string &a, const std::string &b)
+{
+    for (int i = 0; i < DHT_ID_LEN; i++)
+    {
+        auto diff = (uint8_t)(a[i] ^ b[i]);
+        if (diff)
+        {
+            return i * 8 + __builtin_clz(diff) - 24;
+        }
+    }
+    return DHT_ID_LEN * 8 - 1;
+}
+
+static std::string randomBytes(int count)
+{
+    std::random_device rd;
+    std::string bytes;
+    for (int i = 0; i < count; i++)
+    {
+        bytes.push_back((char)(rd() & 0xff));
+    }
+    return bytes;
+}
+
+DhtNode::DhtNode(const int port, std::string stateFile) : port(port), stateFile(std::move(stateFile))
+{
+    nodeId = randomBytes(DHT_ID_LEN);
+    tokenSecret = randomBytes(DHT_ID_LEN);
+    buckets.resize(DHT_ID_LEN * 8);
+}
+
+DhtNode::~DhtNode()
+{
+    stop();
+}
+
+bool DhtNode::start()
+{
+    if (running)
+    {
+        return true;
+    }
+    loadState();
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        std::cerr << "Не удалось открыть UDP-порт " << port << " для DHT" << std::endl;
+        if (sock >= 0)
+        {
+            close(sock);
+            sock = -1;
+        }
+        return false;
+    }
+    running = true;
+    receiveThread = std::thread(&DhtNode::receiveLoop, this);
+    return true;
+}
+
+void DhtNode::stop()
+{
+    if (!running)
+    {
+        return;
+    }
+    running = false;
+    if (receiveThread.joinable())
+    {
+        receiveThread.join();
+    }
+    close(sock);
+    sock = -1;
+    saveState();
+}
+
+const std::string &DhtNode::getNodeId() const
+{
+    return nodeId;
+}
+
+int DhtNode::getNodeCount()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    int count = 0;
+    for (const auto &bucket : buckets)
+    {
+        count += bucket.size();
+    }
+    return count;
+}
+
+void DhtNode::sendMessage(const std::string &ip, int port, const std::string &message)
+{
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &address.sin_addr) <= 0)
+    {
+        return;
+    }
+    sendto(sock, message.data(), message.length(), 0, (struct sockaddr *)&address, sizeof(address));
+}
+
+std::string DhtNode::sendQuery(const std::string &ip,
+                               int port,
+                               const std::string &method,
+                               std::shared_ptr<BDictionary> arguments)
+{
+    std::string transactionId;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        uint16_t counter = nextTransaction++;
+        transactionId = std::string((char *)&counter, sizeof(counter));
+        transactions[transactionId] = Transaction();
+    }
+    (*arguments)[BString::create("id")] = BString::create(nodeId);
+    auto query = BDictionary::create();
+    (*query)[BString::create("t")] = BString::create(transactionId);
+    (*query)[BString::create("y")] = BString::create("q");
+    (*query)[BString::create("q")] = BString::create(method);
+    (*query)[BString::create("a")] = arguments;
+    sendMessage(ip, port, encode(std::move(query)));
+    return transactionId;
+}
+
+void DhtNode::receiveLoop()
+{
+    char buffer[MAX_DATAGRAM];
+    while (running)
+    {
+        struct pollfd fd = {sock, POLLIN, 0};
+        if (poll(&fd, 1, POLL_INTERVAL) <= 0)
+        {
+            continue;
+        }
+        struct sockaddr_in address;
+        socklen_t length = sizeof(address);
+        long bytesRead = recvfrom(sock, buffer, sizeof(buffer), 0, (struct sockaddr *)&address, &length);
+        if (bytesRead <= 0)
+        {
+            continue;
+        }
+        char ipBuffer[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &address.sin_addr, ipBuffer, sizeof(ipBuffer));
+        std::string ip = ipBuffer;
+        int senderPort = ntohs(address.sin_port);
+
+        std::shared_ptr<BDictionary> message;
+        try
+        {
+            message = std::dynamic_pointer_cast<BDictionary>(
+                std::shared_ptr<BItem>(decode(std::string(buffer, bytesRead))));
+        }
+        catch (const std::exception &e)
+        {
+            continue;
+        }
+        if (!message)
+        {
+            continue;
+        }
+        std::string type = childString(message, "y");
+        if (type == "q")
+        {
+            handleQuery(message, ip, senderPort);
+            continue;
+        }
+        if (type != "r" && type != "e")
+        {
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        auto iter = transactions.find(childString(message, "t"));
+        if (iter == transactions.end())
+        {
+            continue;
+        }
+        if (type == "r")
+        {
+            auto reply = std::dynamic_pointer_cast<BDictionary>(child(message, "r"));
+            std::string id = childString(reply, "id");
+            if (id.length() != DHT_ID_LEN)
+            {
+                continue;
+            }
+            iter->second.reply = reply;
+            insertContact(id, ip, senderPort);
+        }
+        else
+        {
+            iter->second.failed = true;
+        }
+        replies.notify_all();
+    }
+}
+
+void DhtNode::handleQuery(const std::shared_ptr<BDictionary> &message, const std::string &ip, int senderPort)
+{
+    std::string method = childString(message, "q");
+    auto arguments = std::dynamic_pointer_cast<BDictionary>(child(message, "a"));
+    std::string senderId = childString(arguments, "id");
+    if (senderId.length() != DHT_ID_LEN)
+    {
+        return;
+    }
+
+    auto reply = BDictionary::create();
+    (*reply)[BString::create("id")] = BString::create(nodeId);
+    bool valid = true;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (method == "find_node")
+        {
+            (*reply)[BString::create("nodes")] = BString::create(compactNodes(childString(arguments, "target")));
+        }
+        else if (method == "get_peers")
+        {
+            std::string infoHash = childString(arguments, "info_hash");
+            (*reply)[BString::create("token")] = BString::create(makeToken(ip));
+            auto stored = storage.find(infoHash);
+            if (stored != storage.end() && !stored->second.empty())
+            {
+                auto values = BList::create();
+                for (const std::string &peer : stored->second)
+                {
+                    values->push_back(BString::create(peer));
+                }
+                (*reply)[BString::create("values")] = std::move(values);
+            }
+            else
+            {
+                (*reply)[BString::create("nodes")] = BString::create(compactNodes(infoHash));
+            }
+        }
+        else if (method == "announce_peer")
+        {
+            std::string infoHash = childString(arguments, "info_hash");
+            auto portItem = std::dynamic_pointer_cast<BInteger>(child(arguments, "port"));
+            auto impliedPort = std::dynamic_pointer_cast<BInteger>(child(arguments, "implied_port"));
+            int peerPort = (impliedPort && impliedPort->value()) ? senderPort : (portItem ? portItem->value() : 0);
+            valid = infoHash.length() == DHT_ID_LEN && peerPort > 0 && peerPort < 65536 &&
+                    childString(arguments, "token") == makeToken(ip);
+            if (valid)
+            {
+                std::vector<std::string> &peers = storage[infoHash];
+                std::string peer = encodeCompactPeer(ip, peerPort);
+                if (std::find(peers.begin(), peers.end(), peer) == peers.end())
+                {
+                    if (peers.size() >= DHT_MAX_STORED_PEERS)
+                    {
+                        peers.erase(peers.begin());
+                    }
+                    peers.push_back(peer);
+                }
+            }
+        }
+        else if (method != "ping")
+        {
+            valid = false;
+        }
+        insertContact(senderId, ip, senderPort);
+    }
+
+    auto response = BDictionary::create();
+    (*response)[BString::create("t")] = BString::create(childString(message, "t"));
+    if (valid)
+    {
+        (*response)[BString::create("y")] = BString::create("r");
+        (*response)[BString::create("r")] = std::move(reply);
+    }
+    else
+    {
+        auto error = BList::create();
+        error->push_back(BInteger::create(203));
+        error->push_back(BString::create("Protocol Error"));
+        (*response)[BString::create("y")] = BString::create("e");
+        (*response)[BString::create("e")] = std::move(error);
+    }
+    sendMessage(ip, senderPort, encode(std::move(response)));
+}
+
+void DhtNode::insertContact(const std::string &id, const std::string &ip, int port)
+{
+    if (id.length() != DHT_ID_LEN || id == nodeId)
+    {
+        return;
+    }
+    std::vector<DhtContact> &bucket = buckets[bucketIndex(id, nodeId)];
+    time_t currentTime = std::time(nullptr);
+    for (DhtContact &contact : bucket)
+    {
+        if (contact.id == id)
+        {
+            contact.ip = ip;
+            contact.port = port;
+            contact.lastSeen = currentTime;
+            contact.failures = 0;
+            return;
+        }
+    }
+    if (bucket.size() < DHT_K)
+    {
+        bucket.push_back({id, ip, port, currentTime, 0});
+        return;
+    }
+    // Заполненная корзина принимает новый узел только вместо неотвечающего
+    auto worst = std::max_element(bucket.begin(), bucket.end(), [](const DhtContact &a, const DhtContact &b) {
+        return a.failures < b.failures;
+    });
+    if (worst->failures > 0)
+    {
+        *worst = {id, ip, port, currentTime, 0};
+    }
+}
+
+void DhtNode::markFailed(const std::string &id)
+{
+    if (id.length() != DHT_ID_LEN || id == nodeId)
+    {
+        return;
+    }
+    std::vector<DhtContact> &bucket = buckets[bucketIndex(id, nodeId)];
+    for (auto iter = bucket.begin(); iter != bucket.end(); ++iter)
+    {
+        if (iter->id == id)
+        {
+            if (++iter->failures >= DHT_MAX_FAILURES)
+            {
+                bucket.erase(iter);
+            }
+            return;
+        }
+    }
+}
+
+std::vector<DhtContact> DhtNode::closestContacts(const std::string &target, size_t count)
+{
+    std::vector<DhtContact> contacts;
+    for (const auto &bucket : buckets)
+    {
+        contacts.insert(contacts.end(), bucket.begin(), bucket.end());
+    }
+    if (target.length() != DHT_ID_LEN)
+    {
+        contacts.resize(std::min(contacts.size(), count));
+        return contacts;
+    }
+    size_t resultSize = std::min(contacts.size(), count);
+    std::partial_sort(contacts.begin(), contacts.begin() + resultSize, contacts.end(),
+                      [&target](const DhtContact &a, const DhtContact &b) { return closer(a.id, b.id, target); });
+    contacts.resize(resultSize);
+    return contacts;
+}
+
+std::string DhtNode::compactNodes(const std::string &target)
+{
+    std::string nodes;
+    for (const DhtContact &contact : closestContacts(target, DHT_K))
+    {
+        std::string endpoint = encodeCompactPeer(contact.ip, contact.port);
+        if (endpoint.length() == COMPACT_PEER_LEN)
+        {
+            nodes += contact.id + endpoint;
+        }
+    }
+    return nodes;
+}
+
+std::string DhtNode::makeToken(const std::string &ip) const
+{
+    SHA1 checksum;
+    checksum.update(tokenSecret);
+    checksum.update(ip);
+    Sha1Digest digest = checksum.final();
+    return std::string((const char *)digest.data(), TOKEN_LEN);
+}
+
+std::vector<Peer> DhtNode::lookup(const std::string &target,
+                                    bool wantPeers,
+                                    int announcePort,
+                                    const std::vector<std::pair<std::string, int>> &seeds,
+                                    const std::atomic<bool> *cancelled)
+{
+    enum CandidateState
+    {
+        Fresh,
+        Queried,
+        Responded,
+        Failed
+    };
+    struct Candidate
+    {
+        DhtContact contact;
+        CandidateState state;
+        std::string transactionId;
+        std::string token;
+        std::chrono::steady_clock::time_point sentAt;
+    };
+
+    using Clock = std::chrono::steady_clock;
+    const std::string method = wantPeers ? "get_peers" : "find_node";
+    std::vector<Candidate> shortlist;
+    std::set<std::string> seenNodes; // ip:port уже добавленных узлов
+    std::set<std::string> seenPeers; // компактные адреса найденных пиров
+    std::string foundPeers;
+
+    auto addCandidate = [&](const DhtContact &contact) {
+        std::string key = contact.ip + ":" + std::to_string(contact.port);
+        if (contact.id == nodeId || !seenNodes.insert(key).second)
+        {
+            return;
+        }
+        shortlist.push_back({contact, Fresh, "", "", Clock::time_point()});
+    };
+    // Узлы без идентификатора (bootstrap-роутеры) сортируются в конец, но опрашиваются, пока список пуст
+    auto sortShortlist = [&]() {
+        std::stable_sort(shortlist.begin(), shortlist.end(), [&target](const Candidate &a, const Candidate &b) {
+            if (a.contact.id.empty() || b.contact.id.empty())
+            {
+                return !a.contact.id.empty() && b.contact.id.empty();
+            }
+            return closer(a.contact.id, b.contact.id, target);
+        });
+    };
+
+    std::unique_lock<std::mutex> guard(lock);
+    for (const DhtContact &contact : closestContacts(target, DHT_K * 2))
+    {
+        addCandidate(contact);
+    }
+    for (const auto &[ip, seedPort] : seeds)
+    {
+        addCandidate({"", ip, seedPort, 0, 0});
+    }
+    sortShortlist();
+
+    auto deadline = Clock::now() + std::chrono::milliseconds(DHT_LOOKUP_TIMEOUT);
+    while (Clock::now() < deadline && !(cancelled && *cancelled))
+    {
+        // Обработка ответов и таймаутов
+        bool changed = false;
+        for (Candidate &candidate : shortlist)
+        {
+            if (candidate.state != Queried)
+            {
+                continue;
+            }
+            auto iter = transactions.find(candidate.transactionId);
+            bool timedOut = Clock::now() - candidate.sentAt > std::chrono::milliseconds(DHT_QUERY_TIMEOUT);
+            if (iter != transactions.end() && iter->second.reply)
+            {
+                std::shared_ptr<BDictionary> reply = iter->second.reply;
+                transactions.erase(iter);
+                candidate.state = Responded;
+                candidate.contact.id = childString(reply, "id");
+                candidate.token = childString(reply, "token");
+                std::string nodes = childString(reply, "nodes");
+                for (size_t offset = 0; offset + COMPACT_NODE_LEN <= nodes.length(); offset += COMPACT_NODE_LEN)
+                {
+                    Peer endpoint(std::string_view(nodes).substr(offset + DHT_ID_LEN, COMPACT_PEER_LEN));
+                    addCandidate({nodes.substr(offset, DHT_ID_LEN), endpoint.ip(), endpoint.port(), 0, 0});
+                }
+                auto values = std::dynamic_pointer_cast<BList>(child(reply, "values"));
+                if (values)
+                {
+                    for (const auto &value : *values)
+                    {
+                        auto peer = std::dynamic_pointer_cast<BString>(value);
+                        if (peer && peer->length() == COMPACT_PEER_LEN && seenPeers.insert(peer->value()).second)
+                        {
+                            foundPeers += peer->value();
+                        }
+                    }
+                }
+                changed = true;
+            }
+            else if (timedOut || (iter != transactions.end() && iter->second.failed))
+            {
+                if (iter != transactions.end())
+                {
+                    transactions.erase(iter);
+                }
+                candidate.state = Failed;
+                markFailed(candidate.contact.id);
+                changed = true;
+            }
+        }
+        if (changed)
+        {
+            sortShortlist();
+        }
+
+        // Новые запросы к ближайшим неопрошенным узлам, не больше DHT_ALPHA одновременно
+        int inFlight = 0;
+        int considered = 0;
+        bool pending = false;
+        bool sent = false;
+        for (Candidate &candidate : shortlist)
+        {
+            if (candidate.state == Queried)
+            {
+                inFlight++;
+            }
+        }
+        for (Candidate &candidate : shortlist)
+        {
+            if (candidate.state == Failed)
+            {
+                continue;
+            }
+            if (considered++ >= DHT_K)
+            {
+                break;
+            }
+            if (candidate.state == Fresh)
+            {
+                pending = true;
+                if (inFlight >= DHT_ALPHA)
+                {
+                    continue;
+                }
+                auto arguments = BDictionary::create();
+                (*arguments)[BString::create(wantPeers ? "info_hash" : "target")] = BString::create(target);
+                guard.unlock();
+                candidate.transactionId = sendQuery(candidate.contact.ip, candidate.contact.port, method,
+                                                    std::move(arguments));
+                guard.lock();
+                candidate.state = Queried;
+                candidate.sentAt = Clock::now();
+                inFlight++;
+                sent = true;
+            }
+        }
+        if (!pending && inFlight == 0)
+        {
+            break;
+        }
+        // Пока lock был отпущен для отправки, ответы могли уже прийти - тогда без ожидания
+        if (!sent)
+        {
+            replies.wait_for(guard, std::chrono::milliseconds(100));
+        }
+    }
+
+    // Запросы, оставшиеся без ответа к концу поиска, больше не нужны
+    for (const Candidate &candidate : shortlist)
+    {
+        if (candidate.state == Queried)
+        {
+            transactions.erase(candidate.transactionId);
+        }
+    }
+    std::vector<Candidate> announceTo;
+    if (announcePort && !(cancelled && *cancelled))
+    {
+        for (const Candidate &candidate : shortlist)
+        {
+            if (candidate.state == Responded && !candidate.token.empty() && announceTo.size() < DHT_K)
+            {
+                announceTo.push_back(candidate);
+            }
+        }
+    }
+    guard.unlock();
+
+    for (const Candidate &candidate : announceTo)
+    {
+        auto arguments = BDictionary::create();
+        (*arguments)[BString::create("info_hash")] = BString::create(target);
+        (*arguments)[BString::create("port")] = BInteger::create(announcePort);
+        (*arguments)[BString::create("token")] = BString::create(candidate.token);
+        std::string transactionId =
+            sendQuery(candidate.contact.ip, candidate.contact.port, "announce_peer", std::move(arguments));
+        std::lock_guard<std::mutex> eraseGuard(lock);
+        transactions.erase(transactionId);
+    }
+    return decodeCompactPeers(foundPeers);
+}
+
+void DhtNode::bootstrap(const std::vector<std::pair<std::string, int>> &routers, const std::atomic<bool> *cancelled)
+{
+    std::vector<std::pair<std::string, int>> seeds;
+    for (const auto &[host, routerPort] : routers)
+    {
+        struct addrinfo hints;
+        struct addrinfo *result = nullptr;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0)
+        {
+            continue;
+        }
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &((struct sockaddr_in *)result->ai_addr)->sin_addr, ip, sizeof(ip));
+        seeds.emplace_back(ip, routerPort);
+        freeaddrinfo(result);
+    }
+    lookup(nodeId, false, 0, seeds, cancelled);
+    std::cout << "DHT: в таблице маршрутизации " << getNodeCount() << " узлов" << std::endl;
+}
+
+std::vector<Peer> DhtNode::getPeers(const std::string &infoHash, int announcePort, const std::atomic<bool> *cancelled)
+{
+    if (!running || infoHash.length() != DHT_ID_LEN)
+    {
+        return {};
+    }
+    std::vector<Peer> peers = lookup(infoHash, true, announcePort, {}, cancelled);
+    std::cout << "DHT: найдено " << peers.size() << " пиров" << std::endl;
+    return peers;
+}
+
+void DhtNode::loadState()
+{
+    if (stateFile.empty())
+    {
+        return;
+    }
+    std::ifstream file(stateFile, std::ios::binary);
+    if (!file)
+    {
+        return;
+    }
+    try
+    {
+        auto state = std::dynamic_pointer_cast<BDictionary>(std::shared_ptr<BItem>(decode(file)));
+        std::string id = childString(state, "id");
+        std::string nodes = childString(state, "nodes");
+        std::lock_guard<std::mutex> guard(lock);
+        if (id.length() == DHT_ID_LEN)
+        {
+            nodeId = id;
+        }
+        for (size_t offset = 0; offset + COMPACT_NODE_LEN <= nodes.length(); offset += COMPACT_NODE_LEN)
+        {
+            Peer endpoint(std::string_view(nodes).substr(offset + DHT_ID_LEN, COMPACT_PEER_LEN));
+            insertContact(nodes.substr(offset, DHT_ID_LEN), endpoint.ip(), endpoint.port());
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "DHT: не удалось прочитать " << stateFile << ": " << e.what() << std::endl;
+    }
+}
+
+void DhtNode::saveState()
+{
+    if (stateFile.empty())
+    {
+        return;
+    }
+    std::string nodes;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (const auto &bucket : buckets)
+        {
+            for (const DhtContact &contact : bucket)
+            {
+                std::string endpoint = encodeCompactPeer(contact.ip, contact.port);
+                if (endpoint.length() == COMPACT_PEER_LEN && contact.failures == 0)
+                {
+                    nodes += contact.id + endpoint;
+                }
+            }
+        }
+    }
+    auto state = BDictionary::create();
+    (*state)[BString::create("id")] = BString::create(nodeId);
+    (*state)[BString::create("nodes")] = BString::create(nodes);
+    std::ofstream file(stateFile, std::ios::binary | std::ios::trunc);
+    file << encode(std::move(state));
+}
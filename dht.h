@@ -0,0 +1,92 @@
+#ifndef DHT_H
+#define DHT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bencode.h"
+#include "peerretriever.h"
+
+struct DhtContact
+{
+    std::string id;            // Идентификатор узла (20 байт)
+    std::string ip;            // IP-адрес узла
+    int port;                  // UDP-порт узла
+    time_t lastSeen;           // Время последнего ответа
+    int failures;              // Количество запросов подряд без ответа
+};
+
+/*
+ Узел Mainline DHT (BEP 5): таблица маршрутизации из k-корзин, ответы на запросы
+ других узлов и итеративный поиск get_peers/announce_peer по info_hash.
+ Запросы к разным узлам идут параллельно, но не больше DHT_ALPHA одновременно.
+ Таблица маршрутизации сохраняется в stateFile между запусками.
+ */
+class DhtNode {
+    private:
+    struct Transaction
+    {
+        std::shared_ptr<BDictionary> reply; // Ответ узла (nullptr, пока ответа нет)
+        bool failed = false;                // Узел вернул ошибку
+    };
+
+    const int port;                         // UDP-порт узла
+    const std::string stateFile;            // Файл для сохранения таблицы маршрутизации
+    std::string nodeId;                     // Наш идентификатор (20 байт)
+    std::string tokenSecret;                // Секрет для выдачи токенов announce_peer
+    int sock = -1;                          // UDP-сокет
+    std::atomic<bool> running{false};       // Признак работы потока приема
+    std::thread receiveThread;              // Поток приема сообщений
+    std::vector<std::vector<DhtContact>> buckets;          // k-корзины по длине общего префикса
+    std::map<std::string, std::vector<std::string>> storage; // Объявленные нам пиры по info_hash
+    std::map<std::string, Transaction> transactions;       // Ожидающие ответа запросы
+    uint16_t nextTransaction = 0;           // Счетчик идентификаторов транзакций
+    std::mutex lock;                        // Мьютекс для предотвращения гонок
+    std::condition_variable replies;        // Уведомление о пришедших ответах
+
+    void receiveLoop();                     // Цикл приема сообщений
+    void handleQuery(const std::shared_ptr<BDictionary> &message, const std::string &ip, int port);
+    void sendMessage(const std::string &ip, int port, const std::string &message);
+    std::string sendQuery(const std::string &ip, int port, const std::string &method,
+                          std::shared_ptr<BDictionary> arguments); // Возвращает идентификатор транзакции
+    void insertContact(const std::string &id, const std::string &ip, int port); // Вызывается под lock
+    void markFailed(const std::string &id);                                     // Вызывается под lock
+    std::vector<DhtContact> closestContacts(const std::string &target, size_t count); // Под lock
+    std::string compactNodes(const std::string &target);                        // Под lock
+    std::string makeToken(const std::string &ip) const;
+    // Итеративный поиск; seeds - дополнительные стартовые узлы (например, bootstrap-роутеры),
+    // cancelled - флаг досрочного завершения
+    std::vector<Peer> lookup(const std::string &target,
+                               bool wantPeers,
+                               int announcePort,
+                               const std::vector<std::pair<std::string, int>> &seeds,
+                               const std::atomic<bool> *cancelled);
+    void loadState();                       // Загрузка таблицы маршрутизации
+    void saveState();                       // Сохранение таблицы маршрутизации
+
+    public:
+    explicit DhtNode(int port, std::string stateFile = ""); // Конструктор класса
+    ~DhtNode();                                             // Деструктор класса
+    bool start();                           // Открытие сокета, загрузка состояния, запуск приема
+    void stop();                            // Остановка и сохранение состояния
+    // Заполнение таблицы маршрутизации через известные узлы (host, port). Поиск, как и в getPeers,
+    // прерывается в течение 100 мс после установки флага cancelled
+    void bootstrap(const std::vector<std::pair<std::string, int>> &routers,
+                   const std::atomic<bool> *cancelled = nullptr);
+    // Поиск пиров торрента; при announcePort != 0 узлы получают announce_peer
+    std::vector<Peer> getPeers(const std::string &infoHash,
+                               int announcePort = 0,
+                               const std::atomic<bool> *cancelled = nullptr);
+    int getNodeCount();                     // Количество узлов в таблице маршрутизации
+    const std::string &getNodeId() const;   // Наш идентификатор
+};
+
+#endif                                      // DHT_H
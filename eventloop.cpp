@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "eventloop.h"
+
+EventLoop::EventLoop()
+{
+    if (pipe(wakeupPipe) < 0)
+    {
+        throw std::runtime_error("Не удалось создать канал пробуждения цикла событий");
+    }
+    for (int fd : wakeupPipe)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    close(wakeupPipe[0]);
+    close(wakeupPipe[1]);
+}
+
+void EventLoop::wakeup()
+{
+    char byte = 0;
+    // Переполненный канал уже гарантирует пробуждение, ошибку можно игнорировать
+    (void)!write(wakeupPipe[1], &byte, 1);
+}
+
+int EventLoop::addTimer(long intervalMs, Callback callback, bool repeat)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    int id = nextTimerId++;
+    auto interval = std::chrono::milliseconds(intervalMs);
+    timers[id] = {Clock::now() + interval, interval, repeat, std::move(callback)};
+    wakeup();
+    return id;
+}
+
+void EventLoop::cancelTimer(int id)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    timers.erase(id);
+}
+
+void EventLoop::post(Callback callback)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    posted.push_back(std::move(callback));
+    wakeup();
+}
+
+void EventLoop::watchFd(int fd, short events, FdCallback callback)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    watchers[fd] = {events, std::move(callback)};
+    wakeup();
+}
+
+void EventLoop::unwatchFd(int fd)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    watchers.erase(fd);
+}
+
+void EventLoop::stop()
+{
+    stopRequested = true;
+    wakeup();
+}
+
+bool EventLoop::isRunning() const
+{
+    return running;
+}
+
+int EventLoop::nextTimeout()
+{
+    if (timers.empty())
+    {
+        return -1;
+    }
+    auto nearest = Clock::time_point::max();
+    for (const auto &[id, timer] : timers)
+    {
+        nearest = std::min(nearest, timer.due);
+    }
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(nearest - Clock::now()).count();
+    // Округление вверх, чтобы не просыпаться за миллисекунду до срока впустую
+    return wait <= 0 ? 0 : (int)wait + 1;
+}
+
+void EventLoop::runTimers()
+{
+    std::vector<Callback> expired;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto currentTime = Clock::now();
+        for (auto iter = timers.begin(); iter != timers.end();)
+        {
+            if (iter->second.due > currentTime)
+            {
+                ++iter;
+                continue;
+            }
+            expired.push_back(iter->second.callback);
+            if (iter->second.repeat)
+            {
+                iter->second.due = currentTime + iter->second.interval;
+                ++iter;
+            }
+            else
+            {
+                iter = timers.erase(iter);
+            }
+        }
+    }
+    for (Callback &callback : expired)
+    {
+        callback();
+    }
+}
+
+void EventLoop::run()
+{
+    running = true;
+    while (!stopRequested)
+    {
+        std::vector<struct pollfd> fds;
+        int timeout;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            fds.push_back({wakeupPipe[0], POLLIN, 0});
+            for (const auto &[fd, watcher] : watchers)
+            {
+                fds.push_back({fd, watcher.first, 0});
+            }
+            timeout = posted.empty() ? nextTimeout() : 0;
+        }
+
+        if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            char buffer[64];
+            while (read(wakeupPipe[0], buffer, sizeof(buffer)) > 0)
+            {
+            }
+        }
+        for (size_t i = 1; i < fds.size() && !stopRequested; i++)
+        {
+            if (!fds[i].revents)
+            {
+                continue;
+            }
+            // Обработчик мог снять отслеживание этого или другого дескриптора
+            FdCallback callback;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                auto iter = watchers.find(fds[i].fd);
+                if (iter == watchers.end())
+                {
+                    continue;
+                }
+                callback = iter->second.second;
+            }
+            callback(fds[i].revents);
+        }
+
+        std::vector<Callback> tasks;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            tasks.swap(posted);
+        }
+        for (Callback &task : tasks)
+        {
+            task();
+        }
+        runTimers();
+    }
+    stopRequested = false;
+    running = false;
+}
@@ -0,0 +1,60 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sys/poll.h>
+#include <vector>
+
+/*
+ Цикл событий на poll(): таймеры, готовность дескрипторов и задачи из других потоков.
+ Между событиями поток спит в poll() до ближайшего таймера, поэтому простаивающий
+ цикл не расходует процессорное время. Обработчики выполняются в потоке run().
+ */
+class EventLoop {
+    public:
+    using Callback = std::function<void()>;
+    using FdCallback = std::function<void(short revents)>; // revents - события poll()
+
+    private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Timer
+    {
+        Clock::time_point due;              // Время следующего срабатывания
+        std::chrono::milliseconds interval; // Период (для повторяющихся таймеров)
+        bool repeat;                        // Повторять ли таймер
+        Callback callback;                  // Обработчик
+    };
+
+    std::map<int, Timer> timers;            // Таймеры по идентификатору
+    std::map<int, std::pair<short, FdCallback>> watchers; // Отслеживаемые дескрипторы
+    std::vector<Callback> posted;           // Задачи, переданные из других потоков
+    int wakeupPipe[2] = {-1, -1};           // Канал для пробуждения poll()
+    int nextTimerId = 1;                    // Счетчик идентификаторов таймеров
+    std::atomic<bool> stopRequested{false}; // Запрошена остановка цикла
+    std::atomic<bool> running{false};       // Цикл выполняется
+    std::mutex lock;                        // Мьютекс для предотвращения гонок
+
+    void wakeup();                          // Прерывание ожидания в poll()
+    int nextTimeout();                      // Время до ближайшего таймера (миллисекунды, -1 - нет)
+    void runTimers();                       // Выполнение наступивших таймеров
+
+    public:
+    EventLoop();                            // Конструктор класса
+    ~EventLoop();                           // Деструктор класса
+    // Таймер через intervalMs миллисекунд (и далее с тем же периодом при repeat); возвращает идентификатор
+    int addTimer(long intervalMs, Callback callback, bool repeat = true);
+    void cancelTimer(int id);               // Отмена таймера
+    void post(Callback callback);           // Выполнение задачи в потоке цикла (из любого потока)
+    void watchFd(int fd, short events, FdCallback callback); // Отслеживание дескриптора
+    void unwatchFd(int fd);                 // Прекращение отслеживания дескриптора
+    void run();                             // Выполнение цикла до вызова stop()
+    void stop();                            // Остановка цикла (из любого потока)
+    bool isRunning() const;                 // Выполняется ли цикл
+};
+
+#endif                                      // EVENTLOOP_H
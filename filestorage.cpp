@@ -0,0 +1,483 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include "connect.h"
+#include "filestorage.h"
+
+// Создание недостающих каталогов на пути к файлу
+static void createParentDirectories(const std::string &path)
+{
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1))
+    {
+        std::string directory = path.substr(0, slash);
+        if (mkdir(directory.c_str(), 0755) < 0 && errno != EEXIST)
+        {
+            throw std::runtime_error("Не удалось создать каталог " + directory);
+        }
+    }
+}
+
+// Запись буферов с позиции offset, пока не будет записано все (pwritev может записать часть).
+// false при ошибке, errno сохраняется
+static bool writeFully(int fd, std::vector<struct iovec> &buffers, off_t offset)
+{
+    size_t index = 0;
+    while (index < buffers.size())
+    {
+        ssize_t written = pwritev(fd, &buffers[index], (int)std::min<size_t>(buffers.size() - index, IOV_MAX), offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        offset += written;
+        // Пропуск записанных буферов и сдвиг начала частично записанного
+        while (index < buffers.size() && (size_t)written >= buffers[index].iov_len)
+        {
+            written -= buffers[index].iov_len;
+            index++;
+        }
+        if (written > 0)
+        {
+            buffers[index].iov_base = (char *)buffers[index].iov_base + written;
+            buffers[index].iov_len -= written;
+        }
+    }
+    return true;
+}
+
+// Запись length байт из data с позиции offset; std::runtime_error при ошибке
+static void writeRange(int fd, const char *data, long length, off_t offset)
+{
+    std::vector<struct iovec> buffers = {{(void *)data, (size_t)length}};
+    if (!writeFully(fd, buffers, offset))
+    {
+        throw std::runtime_error("Не удалось записать данные в файл");
+    }
+}
+
+FileStorage::FileStorage(std::vector<TorrentFileEntry> files,
+                         std::string rootDirectory,
+                         AllocationMode allocationMode,
+                         size_t maxOpenFiles)
+    : files(std::move(files)), rootDirectory(std::move(rootDirectory)),
+      maxOpenFiles(std::max<size_t>(maxOpenFiles, 1)), allocationMode(allocationMode)
+{
+    handles.resize(this->files.size());
+    for (const TorrentFileEntry &file : this->files)
+    {
+        totalLength += file.length;
+    }
+}
+
+void FileStorage::open()
+{
+    createParentDirectories(getFilePath(0));
+    checkFreeSpace();
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        struct stat status;
+        if (files[i].length > 0 && stat(getFilePath(i).c_str(), &status) == 0 && status.st_size > 0)
+        {
+            existingData = true;
+        }
+        if (files[i].length == 0)
+        {
+            // Пустые файлы не содержат данных, и обращений к ним не будет: создаются сразу
+            std::string path = getFilePath(i);
+            createParentDirectories(path);
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    }
+}
+
+void FileStorage::preallocate()
+{
+    if (allocationMode != allocateFull)
+    {
+        return;
+    }
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (files[i].length > 0)
+        {
+            // Открытие резервирует место под файл; дескриптор остается в LRU для будущих обращений
+            acquire(i);
+            release(i);
+        }
+    }
+}
+
+void FileStorage::flush()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t file : recent)
+    {
+        fdatasync(handles[file].fd);
+    }
+}
+
+bool FileStorage::hasData() const
+{
+    return existingData;
+}
+
+void FileStorage::checkFreeSpace() const
+{
+    // Недостающее место: уже выделенные блоки существующих файлов (продолжение загрузки) не учитываются
+    long long required = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        struct stat status;
+        long long allocated = 0;
+        if (stat(getFilePath(i).c_str(), &status) == 0)
+        {
+            allocated = (long long)status.st_blocks * 512;
+        }
+        required += std::max<long long>(files[i].length - allocated, 0);
+    }
+    struct statvfs disk;
+    std::string directory = rootDirectory.empty() ? "." : rootDirectory;
+    if (statvfs(directory.c_str(), &disk) < 0)
+    {
+        return;
+    }
+    long long available = (long long)disk.f_bavail * disk.f_frsize;
+    if (required > available)
+    {
+        throw std::runtime_error("Недостаточно места на диске: нужно " + std::to_string(required) +
+                                 " байт, доступно " + std::to_string(available));
+    }
+}
+
+bool FileStorage::allocate(int fd, long length, AllocationMode mode)
+{
+    struct stat status;
+    if (mode == allocateNone || fstat(fd, &status) < 0)
+    {
+        return mode == allocateNone;
+    }
+#ifdef __linux__
+    if (mode == allocateFull)
+    {
+        // Экстенты выделяются сразу без записи нулей; существующие данные сохраняются
+        if (fallocate(fd, 0, 0, length) == 0)
+        {
+            return true;
+        }
+        if (errno != EOPNOTSUPP && errno != ENOSYS)
+        {
+            return false;
+        }
+    }
+#endif
+    return status.st_size >= length || ftruncate(fd, length) == 0;
+}
+
+FileStorage::~FileStorage()
+{
+    for (Handle &handle : handles)
+    {
+        if (handle.fd >= 0)
+        {
+            close(handle.fd);
+        }
+        if (handle.directFd >= 0)
+        {
+            close(handle.directFd);
+        }
+    }
+}
+
+std::vector<FileSpan> FileStorage::map(long offset, long length) const
+{
+    if (offset < 0 || length < 0 || offset + length > totalLength)
+    {
+        throw std::runtime_error("Запрошенный участок выходит за пределы данных торрента");
+    }
+    std::vector<FileSpan> spans;
+    // Последний файл, начинающийся не позже offset
+    auto next = std::upper_bound(files.begin(), files.end(), offset,
+                                 [](long value, const TorrentFileEntry &file) { return value < file.offset; });
+    size_t file = next - files.begin() - 1;
+    while (length > 0)
+    {
+        long fileOffset = offset - files[file].offset;
+        long spanLength = std::min(length, files[file].length - fileOffset);
+        if (spanLength > 0)
+        {
+            spans.push_back({file, fileOffset, spanLength});
+            offset += spanLength;
+            length -= spanLength;
+        }
+        file++;
+    }
+    return spans;
+}
+
+void FileStorage::writePiece(long offset, const struct iovec *buffers, int count)
+{
+    long length = 0;
+    for (int i = 0; i < count; i++)
+    {
+        length += buffers[i].iov_len;
+    }
+    int index = 0;       // Текущий буфер
+    size_t consumed = 0; // Уже распределенная часть текущего буфера
+    for (const FileSpan &span : map(offset, length))
+    {
+        // Буферы (или их части), приходящиеся на участок файла
+        std::vector<struct iovec> parts;
+        long remaining = span.length;
+        while (remaining > 0)
+        {
+            size_t taken = std::min<size_t>(buffers[index].iov_len - consumed, remaining);
+            if (taken > 0)
+            {
+                parts.push_back({(char *)buffers[index].iov_base + consumed, taken});
+            }
+            consumed += taken;
+            remaining -= taken;
+            if (consumed == buffers[index].iov_len)
+            {
+                index++;
+                consumed = 0;
+            }
+        }
+        int fd = acquire(span.file);
+        try
+        {
+            if (directBuffers)
+            {
+                writeDirect(span, fd, parts);
+            }
+            else if (!writeFully(fd, parts, span.offset))
+            {
+                throw std::runtime_error("Не удалось записать данные в файл " + getFilePath(span.file));
+            }
+        }
+        catch (...)
+        {
+            release(span.file);
+            throw;
+        }
+        release(span.file);
+    }
+}
+
+void FileStorage::writeDirect(const FileSpan &span, int fd, std::vector<struct iovec> &parts)
+{
+    long head = span.offset % DIRECT_IO_ALIGNMENT;                      // Сдвиг начала от границы блока
+    long alignedStart = head ? span.offset - head + DIRECT_IO_ALIGNMENT : span.offset;
+    long alignedEnd = (span.offset + span.length) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    bool fits = head + span.length <= (long)directBuffers->getBufferSize();
+    int directFd = fits && alignedEnd > alignedStart ? getDirectDescriptor(span.file) : -1;
+    if (directFd < 0)
+    {
+        // Участок короче блока, длиннее буфера или O_DIRECT недоступен
+        if (!writeFully(fd, parts, span.offset))
+        {
+            throw std::runtime_error("Не удалось записать данные в файл " + getFilePath(span.file));
+        }
+        return;
+    }
+
+    // Данные кладутся в буфер с тем же сдвигом от границы блока, что и в файле,
+    // тогда выровненная середина участка лежит в буфере по выровненному адресу
+    char *buffer = directBuffers->acquire();
+    try
+    {
+        char *data = buffer + head;
+        long position = 0;
+        for (const struct iovec &part : parts)
+        {
+            memcpy(data + position, part.iov_base, part.iov_len);
+            position += part.iov_len;
+        }
+        std::vector<struct iovec> middle = {{data + (alignedStart - span.offset), (size_t)(alignedEnd - alignedStart)}};
+        if (!writeFully(directFd, middle, alignedStart))
+        {
+            if (errno != EINVAL)
+            {
+                throw std::runtime_error("Не удалось записать данные в файл " + getFilePath(span.file));
+            }
+            // Требования к выравниванию строже ожидаемых: файл пишется через page cache
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                handles[span.file].directUnsupported = true;
+            }
+            writeRange(fd, data + (alignedStart - span.offset), alignedEnd - alignedStart, alignedStart);
+        }
+        // Начало и конец в неполных блоках делят блок с соседними фрагментами и пишутся через page cache
+        if (alignedStart > span.offset)
+        {
+            writeRange(fd, data, alignedStart - span.offset, span.offset);
+        }
+        if (span.offset + span.length > alignedEnd)
+        {
+            writeRange(fd, data + (alignedEnd - span.offset), span.offset + span.length - alignedEnd, alignedEnd);
+        }
+    }
+    catch (...)
+    {
+        directBuffers->release(buffer);
+        throw;
+    }
+    directBuffers->release(buffer);
+}
+
+void FileStorage::readBlock(long offset, char *data, long length)
+{
+    for (const FileSpan &span : map(offset, length))
+    {
+        int fd = acquire(span.file);
+        long done = 0;
+        while (done < span.length)
+        {
+            ssize_t bytesRead = pread(fd, data + done, span.length - done, span.offset + done);
+            if (bytesRead < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytesRead <= 0)
+            {
+                release(span.file);
+                throw std::runtime_error("Не удалось прочитать данные из файла " + getFilePath(span.file));
+            }
+            done += bytesRead;
+        }
+        release(span.file);
+        data += span.length;
+    }
+}
+
+void FileStorage::send(int sock, long offset, long length, RateLimiter *limiter)
+{
+    for (const FileSpan &span : map(offset, length))
+    {
+        int fd = acquire(span.file);
+        try
+        {
+            sendFileData(sock, fd, span.offset, span.length, limiter);
+        }
+        catch (...)
+        {
+            release(span.file);
+            throw;
+        }
+        release(span.file);
+    }
+}
+
+int FileStorage::acquire(size_t file)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Handle &handle = handles[file];
+    if (handle.fd < 0)
+    {
+        closeUnused();
+        std::string path = getFilePath(file);
+        createParentDirectories(path);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Не удалось открыть файл " + path);
+        }
+        if (!allocate(fd, files[file].length, allocationMode))
+        {
+            close(fd);
+            throw std::runtime_error("Не удалось выделить место под файл " + path);
+        }
+        handle.fd = fd;
+        recent.push_front(file);
+        handle.position = recent.begin();
+    }
+    else
+    {
+        recent.splice(recent.begin(), recent, handle.position);
+    }
+    handle.pins++;
+    return handle.fd;
+}
+
+int FileStorage::getDirectDescriptor(size_t file)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Handle &handle = handles[file];
+#ifdef O_DIRECT
+    if (handle.directFd < 0 && !handle.directUnsupported)
+    {
+        handle.directFd = ::open(getFilePath(file).c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+        handle.directUnsupported = handle.directFd < 0;
+    }
+#endif
+    return handle.directUnsupported ? -1 : handle.directFd;
+}
+
+void FileStorage::release(size_t file)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    handles[file].pins--;
+}
+
+void FileStorage::closeUnused()
+{
+    // Закрепленные файлы не закрываются: если заняты все, ограничение временно превышается
+    auto iter = recent.end();
+    while (recent.size() >= maxOpenFiles && iter != recent.begin())
+    {
+        --iter;
+        Handle &handle = handles[*iter];
+        if (handle.pins == 0)
+        {
+            close(handle.fd);
+            handle.fd = -1;
+            if (handle.directFd >= 0)
+            {
+                close(handle.directFd);
+                handle.directFd = -1;
+            }
+            iter = recent.erase(iter);
+        }
+    }
+}
+
+size_t FileStorage::getFileCount() const
+{
+    return files.size();
+}
+
+std::string FileStorage::getFilePath(size_t file) const
+{
+    if (rootDirectory.empty() || rootDirectory.back() == '/')
+    {
+        return rootDirectory + files[file].path;
+    }
+    return rootDirectory + "/" + files[file].path;
+}
+
+size_t FileStorage::getOpenFileCount()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return recent.size();
+}
+
+void FileStorage::enableDirectWrites(size_t maxWriteLength, size_t maxBuffers)
+{
+    // Запас на сдвиг начала участка от границы блока
+    directBuffers.reset(new BufferPool(maxWriteLength + DIRECT_IO_ALIGNMENT, DIRECT_IO_ALIGNMENT, maxBuffers));
+}
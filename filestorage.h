@@ -0,0 +1,106 @@
+#ifndef FILESTORAGE_H
+#define FILESTORAGE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+#include "bufferpool.h"
+#include "ratelimiter.h"
+#include "storage.h"
+#include "torrentfile.h"
+
+#define DEFAULT_MAX_OPEN_FILES 64 // Ограничение на число одновременно открытых файлов раздачи
+#define DIRECT_IO_ALIGNMENT 4096  // Выравнивание смещения, длины и адреса буфера для записи с O_DIRECT
+
+// Выделение места под файлы раздачи
+enum AllocationMode
+{
+    allocateFull,                 // Место резервируется сразу (fallocate): запись вразнобой не фрагментирует файл
+    allocateSparse,               // Разреженный файл полного размера, место выделяется по мере записи
+    allocateNone                  // Файл растет по мере записи
+};
+
+// Участок данных торрента внутри одного файла
+struct FileSpan
+{
+    size_t file;                  // Индекс файла
+    long offset;                  // Смещение внутри файла
+    long length;                  // Длина участка
+};
+
+/*
+ Хранилище данных торрента на диске. Смещение в общих данных торрента отображается
+ на участки файлов (для многофайлового торрента фрагмент может лежать в нескольких файлах).
+ Запись, чтение и отдача пирам идут через это отображение: запись участка, пересекающего
+ границу файлов, выполняется векторным pwritev в каждый файл. Файлы открываются при первом
+ обращении, число открытых дескрипторов ограничено, давно не использовавшиеся закрываются (LRU).
+ При открытии хранилища проверяется свободное место на диске, а в режиме allocateFull
+ preallocate резервирует место под все файлы сразу. Методы потокобезопасны.
+
+ Запись с O_DIRECT (enableDirectWrites) идет мимо page cache и не вытесняет из него данные
+ других процессов. Данные копируются в выровненный буфер из пула, выровненная середина участка
+ пишется через O_DIRECT, а невыровненные начало и конец - обычной записью. Если файловая
+ система не поддерживает O_DIRECT, файл пишется обычным способом.
+ */
+class FileStorage : public Storage {
+    private:
+    struct Handle
+    {
+        int fd = -1;              // Дескриптор файла (-1 - закрыт)
+        int directFd = -1;        // Дескриптор с O_DIRECT (-1 - не открыт)
+        bool directUnsupported = false; // Файловая система отвергла O_DIRECT
+        int pins = 0;             // Выполняемые операции с дескриптором; такой файл не закрывается
+        std::list<size_t>::iterator position; // Место в списке LRU
+    };
+
+    const std::vector<TorrentFileEntry> files; // Файлы раздачи по возрастанию смещения
+    const std::string rootDirectory;           // Каталог загрузки
+    const size_t maxOpenFiles;                 // Ограничение на число открытых дескрипторов
+    const AllocationMode allocationMode;       // Выделение места под файлы
+    long totalLength = 0;                      // Общий размер данных
+    bool existingData = false;                 // До open на диске уже были непустые файлы раздачи
+    std::vector<Handle> handles;               // Дескрипторы по индексу файла
+    std::list<size_t> recent;                  // Открытые файлы, недавно использованные - в начале
+    std::unique_ptr<BufferPool> directBuffers; // Буферы записи с O_DIRECT (nullptr - запись через page cache)
+    std::mutex lock;                           // Мьютекс для предотвращения гонок
+
+    int acquire(size_t file);                  // Открытие (при необходимости) и закрепление дескриптора
+    void release(size_t file);                 // Снятие закрепления
+    int getDirectDescriptor(size_t file);      // Дескриптор с O_DIRECT закрепленного файла; -1, если недоступен
+    void writeDirect(const FileSpan &span, int fd, std::vector<struct iovec> &parts); // Запись участка с O_DIRECT
+    void closeUnused();                        // Закрытие давно не использовавшихся файлов сверх ограничения
+    void checkFreeSpace() const;               // std::runtime_error, если данные не поместятся на диск
+
+    public:
+    FileStorage(std::vector<TorrentFileEntry> files,
+                std::string rootDirectory,
+                AllocationMode allocationMode = allocateFull,
+                size_t maxOpenFiles = DEFAULT_MAX_OPEN_FILES); // Конструктор класса
+    ~FileStorage() override;                                   // Деструктор класса, закрывает файлы
+    void open() override;                                       // Каталоги, пустые файлы, проверка места
+    void preallocate() override;                                // Резервирование места (allocateFull)
+    // Запись буферов подряд начиная с offset; участки разных файлов пишутся отдельными pwritev
+    void writePiece(long offset, const struct iovec *buffers, int count) override;
+    void readBlock(long offset, char *data, long length) override; // Чтение length байт с offset
+    void flush() override;                                      // fdatasync открытых файлов
+    bool hasData() const override;                              // Были ли непустые файлы до open
+    // Отдача length байт с offset в сокет через sendfile по участкам файлов
+    void send(int sock, long offset, long length, RateLimiter *limiter = nullptr) override;
+    // Участки файлов, на которые приходится [offset, offset + length). std::runtime_error вне данных
+    std::vector<FileSpan> map(long offset, long length) const;
+    size_t getFileCount() const;                                // Количество файлов
+    std::string getFilePath(size_t file) const;                 // Полный путь файла
+    size_t getOpenFileCount();                                  // Количество открытых дескрипторов
+    // Запись с O_DIRECT для участков не длиннее maxWriteLength; maxBuffers - одновременные записи.
+    // Вызывается до начала записи
+    void enableDirectWrites(size_t maxWriteLength, size_t maxBuffers);
+    // Доведение размера открытого файла до length выбранным способом; false при ошибке.
+    // Если файловая система не поддерживает fallocate, allocateFull создает разреженный файл
+    static bool allocate(int fd, long length, AllocationMode mode);
+};
+
+#endif                                                          // FILESTORAGE_H
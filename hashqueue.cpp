@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <chrono>
+
+#include "hashqueue.h"
+#include "sha1multi.h"
+
+#define HASH_QUEUE_FILL_WAIT 5 // Ожидание пополнения неполной пачки (миллисекунды)
+
+HashQueue::HashQueue(int threads, size_t maxPending)
+    : lanes(sha1MultiBufferLanes()),
+      maxPending(maxPending > 0 ? maxPending : 2 * sha1MultiBufferLanes() * std::max(threads, 1))
+{
+    for (int i = 0; i < std::max(threads, 1); i++)
+    {
+        workers.emplace_back([this] { run(); });
+    }
+}
+
+HashQueue::~HashQueue()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void HashQueue::submit(std::string data, Callback callback)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this] { return jobs.size() < maxPending; });
+    jobs.push_back({std::move(data), std::move(callback)});
+    guard.unlock();
+    changed.notify_all();
+}
+
+void HashQueue::wait()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    flushing = true;
+    changed.notify_all();
+    changed.wait(guard, [this] { return jobs.empty() && active == 0; });
+    flushing = false;
+}
+
+void HashQueue::run()
+{
+    std::vector<Job> batch;
+    std::vector<const char *> data;
+    std::vector<Sha1Digest> digests;
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        changed.wait(guard, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty())
+        {
+            return;
+        }
+        if (jobs.size() < lanes && !flushing && !stopping)
+        {
+            // Неполная пачка хешируется медленнее в расчете на задание: даем читающему потоку дополнить ее
+            changed.wait_for(guard, std::chrono::milliseconds(HASH_QUEUE_FILL_WAIT),
+                             [this] { return jobs.size() >= lanes || flushing || stopping; });
+            if (jobs.empty())
+            {
+                continue;
+            }
+        }
+
+        // В пачку попадают задания той же длины, что и первое (обычно все, кроме последнего фрагмента)
+        size_t length = jobs.front().data.size();
+        batch.clear();
+        for (auto iter = jobs.begin(); iter != jobs.end() && batch.size() < lanes;)
+        {
+            if (iter->data.size() == length)
+            {
+                batch.push_back(std::move(*iter));
+                iter = jobs.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+        active += batch.size();
+        guard.unlock();
+        changed.notify_all();
+
+        data.clear();
+        for (const Job &job : batch)
+        {
+            data.push_back(job.data.data());
+        }
+        digests.resize(batch.size());
+        sha1MultiBuffer(data.data(), batch.size(), length, digests.data());
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (batch[i].callback)
+            {
+                batch[i].callback(digests[i]);
+            }
+        }
+        size_t finished = batch.size();
+        batch.clear();
+
+        guard.lock();
+        active -= finished;
+        changed.notify_all();
+    }
+}
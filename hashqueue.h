@@ -0,0 +1,54 @@
+#ifndef HASHQUEUE_H
+#define HASHQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sha1.h"
+
+/*
+ Очередь проверки хэшей. Рабочие потоки забирают задания пачками одинаковой длины (по числу
+ дорожек sha1MultiBuffer) и хешируют их одновременно; неполная пачка ждет пополнения недолго.
+ submit блокируется, пока в очереди слишком много заданий, чтобы читающий поток не обгонял
+ хеширование по памяти. Обработчики вызываются из рабочих потоков.
+ */
+class HashQueue {
+    public:
+    // Получатель хэша данных задания
+    using Callback = std::function<void(const Sha1Digest &digest)>;
+
+    private:
+    struct Job
+    {
+        std::string data;            // Хешируемые данные
+        Callback callback;           // Получатель хэша
+    };
+
+    const size_t lanes;              // Размер пачки
+    const size_t maxPending;         // Наибольшее количество заданий в очереди
+    std::deque<Job> jobs;            // Ожидающие задания
+    size_t active = 0;               // Задания, которые хешируются сейчас
+    bool flushing = false;           // Идет wait: неполные пачки не ждут пополнения
+    bool stopping = false;           // Рабочие потоки завершаются
+    std::vector<std::thread> workers; // Рабочие потоки
+    std::mutex lock;                 // Мьютекс для предотвращения гонок
+    std::condition_variable changed; // Уведомление об изменении очереди
+
+    void run();                      // Цикл рабочего потока
+
+    public:
+    // threads рабочих потоков, в очереди не больше maxPending заданий (0 - по две пачки на поток)
+    explicit HashQueue(int threads = 1, size_t maxPending = 0);
+    ~HashQueue();                    // Деструктор класса, дожидается всех заданий
+    HashQueue(const HashQueue &) = delete;
+    HashQueue &operator=(const HashQueue &) = delete;
+    void submit(std::string data, Callback callback); // Добавление задания
+    void wait();                     // Ожидание завершения всех добавленных заданий
+};
+
+#endif                               // HASHQUEUE_H
@@ -0,0 +1,676 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "httpclient.h"
+#include "utils.h"
+
+#define HTTP_BUFFER_SIZE 16384          // Размер буфера чтения из сокета
+#define HTTP_IDLE_TIMEOUT 30000         // Время жизни простаивающего keep-alive соединения (миллисекунды)
+#define HTTP_MAX_HEADER_SIZE 65536      // Наибольший размер заголовков ответа
+#define HTTP_MAX_BODY_SIZE (16 << 20)   // Наибольший размер тела ответа (после распаковки)
+
+HttpClient::HttpClient(EventLoop &loop) : loop(loop), resolver(loop), alive(std::make_shared<bool>(true))
+{
+}
+
+HttpClient::~HttpClient()
+{
+    alive.reset();
+    while (!connections.empty())
+    {
+        closeConnection(connections.begin()->first);
+    }
+    for (const auto &[id, request] : requests)
+    {
+        loop.cancelTimer(request.timer);
+    }
+}
+
+size_t HttpClient::getConnectionCount() const
+{
+    return connections.size();
+}
+
+EventLoop &HttpClient::getLoop()
+{
+    return loop;
+}
+
+Resolver &HttpClient::getResolver()
+{
+    return resolver;
+}
+
+bool HttpClient::parseUrl(const std::string &url, std::string &host, int &port, std::string &target)
+{
+    const std::string scheme = "http://";
+    if (url.compare(0, scheme.length(), scheme) != 0)
+    {
+        return false;
+    }
+    size_t hostStart = scheme.length();
+    size_t pathStart = url.find_first_of("/?", hostStart);
+    std::string authority = url.substr(hostStart, pathStart == std::string::npos ? std::string::npos : pathStart - hostStart);
+    target = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+    if (target[0] == '?')
+    {
+        target = "/" + target;
+    }
+
+    // IPv6-адрес записывается в квадратных скобках: http://[::1]:8080/announce
+    size_t portSeparator;
+    if (!authority.empty() && authority[0] == '[')
+    {
+        size_t bracket = authority.find(']');
+        if (bracket == std::string::npos)
+        {
+            return false;
+        }
+        host = authority.substr(1, bracket - 1);
+        portSeparator = authority.find(':', bracket);
+    }
+    else
+    {
+        portSeparator = authority.find(':');
+        host = authority.substr(0, portSeparator);
+    }
+    port = 80;
+    if (portSeparator != std::string::npos)
+    {
+        port = std::atoi(authority.c_str() + portSeparator + 1);
+    }
+    return !host.empty() && port > 0 && port < 65536;
+}
+
+bool HttpClient::inflate(const std::string &input, std::string &output)
+{
+    // 15 + 32: окно 32 КБ и автоопределение заголовка gzip или zlib; -15 - deflate без заголовка,
+    // который отправляют некоторые серверы вместо zlib
+    for (int windowBits : {15 + 32, -15})
+    {
+        z_stream stream{};
+        if (inflateInit2(&stream, windowBits) != Z_OK)
+        {
+            return false;
+        }
+        stream.next_in = (Bytef *)input.data();
+        stream.avail_in = input.size();
+        output.clear();
+        char buffer[HTTP_BUFFER_SIZE];
+        int result;
+        do
+        {
+            stream.next_out = (Bytef *)buffer;
+            stream.avail_out = sizeof(buffer);
+            result = ::inflate(&stream, Z_NO_FLUSH);
+            output.append(buffer, sizeof(buffer) - stream.avail_out);
+        } while (result == Z_OK && output.size() <= HTTP_MAX_BODY_SIZE);
+        inflateEnd(&stream);
+        if (result == Z_STREAM_END)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void HttpClient::get(const std::string &url, const Parameters &parameters, long timeoutMs, Callback callback)
+{
+    int id = nextRequestId++;
+    Request &request = requests[id];
+    request.id = id;
+    request.callback = std::move(callback);
+    std::weak_ptr<bool> token = alive;
+
+    std::string target;
+    if (!parseUrl(url, request.host, request.port, target))
+    {
+        // Обработчик не вызывается внутри get(), чтобы вызывающему не нужно было учитывать повторный вход
+        loop.post([this, token, id, url]() {
+            if (!token.expired())
+            {
+                HttpResponse response;
+                response.error = url.compare(0, 8, "https://") == 0 ? "HTTPS не поддерживается: " + url
+                                                                    : "Неподдерживаемый URL " + url;
+                complete(id, std::move(response));
+            }
+        });
+        return;
+    }
+    request.key = request.host + ":" + std::to_string(request.port);
+
+    char separator = target.find('?') == std::string::npos ? '?' : '&';
+    for (const auto &[name, value] : parameters)
+    {
+        target += separator + urlEncode(name) + "=" + urlEncode(value);
+        separator = '&';
+    }
+    std::string hostHeader = request.host.find(':') != std::string::npos ? "[" + request.host + "]" : request.host;
+    if (request.port != 80)
+    {
+        hostHeader += ":" + std::to_string(request.port);
+    }
+    request.data = "GET " + target + " HTTP/1.1\r\n" +
+                   "Host: " + hostHeader + "\r\n" +
+                   "User-Agent: torrent-client\r\n"
+                   "Accept-Encoding: gzip, deflate\r\n"
+                   "Connection: keep-alive\r\n\r\n";
+
+    request.timer = loop.addTimer(
+        timeoutMs,
+        [this, token, id]() {
+            if (token.expired() || !requests.count(id))
+            {
+                return;
+            }
+            for (const auto &[fd, connection] : connections)
+            {
+                if (connection.requestId == id)
+                {
+                    closeConnection(fd);
+                    break;
+                }
+            }
+            HttpResponse response;
+            response.error = "Тайм-аут HTTP-запроса";
+            complete(id, std::move(response));
+        },
+        false);
+    loop.post([this, token, id]() {
+        if (!token.expired())
+        {
+            startRequest(id);
+        }
+    });
+}
+
+void HttpClient::startRequest(int requestId)
+{
+    auto request = requests.find(requestId);
+    if (request == requests.end())
+    {
+        return;
+    }
+    // Простаивающее соединение с тем же сервером используется повторно
+    for (auto &[fd, connection] : connections)
+    {
+        if (connection.requestId == 0 && connection.key == request->second.key)
+        {
+            loop.cancelTimer(connection.idleTimer);
+            connection.idleTimer = 0;
+            connection.requestId = requestId;
+            connection.reused = true;
+            connection.output = request->second.data;
+            watch(connection);
+            return;
+        }
+    }
+    // Пока имя разрешается, запрос может завершиться по тайм-ауту
+    std::weak_ptr<bool> token = alive;
+    resolver.resolve(request->second.host, request->second.port, SOCK_STREAM,
+                     [this, token, requestId](std::vector<struct sockaddr_storage> addresses) {
+                         if (token.expired())
+                         {
+                             return;
+                         }
+                         auto request = requests.find(requestId);
+                         if (request == requests.end())
+                         {
+                             return;
+                         }
+                         if (addresses.empty())
+                         {
+                             HttpResponse response;
+                             response.error = "Не удалось разрешить адрес " + request->second.host;
+                             complete(requestId, std::move(response));
+                         }
+                         else if (openConnection(request->second, addresses) < 0)
+                         {
+                             HttpResponse response;
+                             response.error = "Не удалось подключиться к " + request->second.key;
+                             complete(requestId, std::move(response));
+                         }
+                     });
+}
+
+int HttpClient::openConnection(const Request &request, const std::vector<struct sockaddr_storage> &addresses)
+{
+    for (const struct sockaddr_storage &address : addresses)
+    {
+        socklen_t length = Resolver::addressLength(address);
+        int fd = socket(address.ss_family, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        if (connect(fd, (const struct sockaddr *)&address, length) < 0 && errno != EINPROGRESS)
+        {
+            close(fd);
+            continue;
+        }
+        Connection &connection = connections[fd];
+        connection = Connection();
+        connection.fd = fd;
+        connection.key = request.key;
+        connection.requestId = request.id;
+        connection.output = request.data;
+        watch(connection);
+        return fd;
+    }
+    return -1;
+}
+
+void HttpClient::watch(const Connection &connection)
+{
+    short events = POLLIN;
+    if (!connection.connected || !connection.output.empty())
+    {
+        events |= POLLOUT;
+    }
+    int fd = connection.fd;
+    loop.watchFd(fd, events, [this, fd](short revents) { onEvent(fd, revents); });
+}
+
+void HttpClient::onEvent(int fd, short revents)
+{
+    auto iter = connections.find(fd);
+    if (iter == connections.end())
+    {
+        return;
+    }
+    Connection &connection = iter->second;
+
+    if (!connection.connected)
+    {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0)
+        {
+            finish(fd, false, "Не удалось подключиться к " + connection.key);
+            return;
+        }
+        if (!(revents & POLLOUT))
+        {
+            return;
+        }
+        onConnected(connection);
+    }
+    if ((revents & POLLOUT) && !flush(connection))
+    {
+        finish(fd, false, "Ошибка отправки HTTP-запроса");
+        return;
+    }
+    if (revents & (POLLIN | POLLHUP | POLLERR))
+    {
+        bool open = receive(connection);
+        // Простаивающее соединение закрыто сервером
+        if (connection.requestId == 0)
+        {
+            if (!open || !connection.input.empty())
+            {
+                closeConnection(fd);
+            }
+            return;
+        }
+        try
+        {
+            if (parse(connection))
+            {
+                finish(fd, true);
+                return;
+            }
+        }
+        catch (const std::runtime_error &e)
+        {
+            finish(fd, false, e.what());
+            return;
+        }
+        if (!open)
+        {
+            // Ответ без длины и chunked заканчивается закрытием соединения
+            if (connection.headersDone && !connection.chunked && connection.contentLength < 0)
+            {
+                connection.keepAlive = false;
+                finish(fd, true);
+            }
+            else
+            {
+                finish(fd, false, "Соединение закрыто до конца HTTP-ответа");
+            }
+            return;
+        }
+    }
+    watch(connection);
+}
+
+void HttpClient::onConnected(Connection &connection)
+{
+    connection.connected = true;
+    watch(connection);
+}
+
+bool HttpClient::flush(Connection &connection)
+{
+    while (!connection.output.empty())
+    {
+        ssize_t sent = send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        connection.output.erase(0, sent);
+    }
+    return true;
+}
+
+bool HttpClient::receive(Connection &connection)
+{
+    char buffer[HTTP_BUFFER_SIZE];
+    while (true)
+    {
+        ssize_t received = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (received > 0)
+        {
+            connection.input.append(buffer, received);
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            return true;
+        }
+        return false;
+    }
+}
+
+bool HttpClient::parse(Connection &connection)
+{
+    if (!connection.headersDone && !parseHeaders(connection))
+    {
+        return false;
+    }
+    if (connection.chunked)
+    {
+        return parseChunks(connection);
+    }
+    HttpResponse &response = connection.response;
+    if (connection.contentLength < 0)
+    {
+        response.body += connection.input;
+        connection.input.clear();
+        if (response.body.size() > HTTP_MAX_BODY_SIZE)
+        {
+            throw std::runtime_error("Слишком большой HTTP-ответ");
+        }
+        return false;
+    }
+    size_t needed = connection.contentLength - response.body.size();
+    response.body.append(connection.input, 0, needed);
+    connection.input.erase(0, needed);
+    return (long long)response.body.size() == connection.contentLength;
+}
+
+bool HttpClient::parseHeaders(Connection &connection)
+{
+    size_t end = connection.input.find("\r\n\r\n");
+    if (end == std::string::npos)
+    {
+        if (connection.input.size() > HTTP_MAX_HEADER_SIZE)
+        {
+            throw std::runtime_error("Слишком длинные заголовки HTTP-ответа");
+        }
+        return false;
+    }
+    HttpResponse &response = connection.response;
+    size_t lineEnd = connection.input.find("\r\n");
+    std::string statusLine = connection.input.substr(0, lineEnd);
+    // HTTP/1.1 200 OK
+    if (statusLine.compare(0, 5, "HTTP/") != 0 || statusLine.find(' ') == std::string::npos)
+    {
+        throw std::runtime_error("Некорректная строка статуса HTTP-ответа");
+    }
+    response.status = std::atoi(statusLine.c_str() + statusLine.find(' ') + 1);
+    if (response.status < 100)
+    {
+        throw std::runtime_error("Некорректный код HTTP-ответа");
+    }
+    // В HTTP/1.0 соединение по умолчанию закрывается после ответа
+    connection.keepAlive = statusLine.compare(0, 8, "HTTP/1.0") != 0;
+
+    for (size_t start = lineEnd + 2; start < end;)
+    {
+        lineEnd = connection.input.find("\r\n", start);
+        std::string line = connection.input.substr(start, lineEnd - start);
+        start = lineEnd + 2;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+        {
+            continue;
+        }
+        std::string name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+        size_t valueEnd = line.find_last_not_of(" \t");
+        std::string value = valueStart == std::string::npos ? "" : line.substr(valueStart, valueEnd - valueStart + 1);
+        response.headers[name] = value;
+    }
+    connection.input.erase(0, end + 4);
+    connection.headersDone = true;
+
+    auto header = [&response](const std::string &name) {
+        auto iter = response.headers.find(name);
+        std::string value = iter == response.headers.end() ? "" : iter->second;
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+        return value;
+    };
+    if (header("connection") == "close")
+    {
+        connection.keepAlive = false;
+    }
+    else if (header("connection") == "keep-alive")
+    {
+        connection.keepAlive = true;
+    }
+    connection.chunked = header("transfer-encoding").find("chunked") != std::string::npos;
+    if (!connection.chunked && !header("content-length").empty())
+    {
+        connection.contentLength = std::atoll(header("content-length").c_str());
+        if (connection.contentLength < 0 || connection.contentLength > HTTP_MAX_BODY_SIZE)
+        {
+            throw std::runtime_error("Некорректная длина HTTP-ответа");
+        }
+    }
+    // У этих ответов нет тела независимо от заголовков
+    if (response.status == 204 || response.status == 304 || response.status < 200)
+    {
+        connection.chunked = false;
+        connection.contentLength = 0;
+    }
+    // Без длины конец ответа определяется только закрытием соединения
+    if (!connection.chunked && connection.contentLength < 0)
+    {
+        connection.keepAlive = false;
+    }
+    return true;
+}
+
+bool HttpClient::parseChunks(Connection &connection)
+{
+    std::string &input = connection.input;
+    std::string &body = connection.response.body;
+    while (true)
+    {
+        switch (connection.chunkState)
+        {
+        case chunkSize:
+        {
+            size_t lineEnd = input.find("\r\n");
+            if (lineEnd == std::string::npos)
+            {
+                return false;
+            }
+            // Расширения части после ';' игнорируются
+            char *end = nullptr;
+            connection.chunkRemaining = std::strtoll(input.c_str(), &end, 16);
+            if (end == input.c_str() || connection.chunkRemaining < 0 ||
+                body.size() + connection.chunkRemaining > HTTP_MAX_BODY_SIZE)
+            {
+                throw std::runtime_error("Некорректный размер части HTTP-ответа");
+            }
+            input.erase(0, lineEnd + 2);
+            connection.chunkState = connection.chunkRemaining == 0 ? chunkTrailer : chunkData;
+            break;
+        }
+        case chunkData:
+        {
+            size_t taken = std::min<size_t>(input.size(), connection.chunkRemaining);
+            body.append(input, 0, taken);
+            input.erase(0, taken);
+            connection.chunkRemaining -= taken;
+            if (connection.chunkRemaining > 0)
+            {
+                return false;
+            }
+            connection.chunkState = chunkEnd;
+            break;
+        }
+        case chunkEnd:
+            if (input.size() < 2)
+            {
+                return false;
+            }
+            if (input.compare(0, 2, "\r\n") != 0)
+            {
+                throw std::runtime_error("Некорректное окончание части HTTP-ответа");
+            }
+            input.erase(0, 2);
+            connection.chunkState = chunkSize;
+            break;
+        case chunkTrailer:
+        {
+            size_t lineEnd = input.find("\r\n");
+            if (lineEnd == std::string::npos)
+            {
+                return false;
+            }
+            input.erase(0, lineEnd + 2);
+            // Пустая строка завершает ответ
+            if (lineEnd == 0)
+            {
+                return true;
+            }
+            break;
+        }
+        }
+    }
+}
+
+void HttpClient::finish(int fd, bool complete, const std::string &error)
+{
+    Connection &connection = connections[fd];
+    int requestId = connection.requestId;
+    HttpResponse response = std::move(connection.response);
+
+    if (!complete)
+    {
+        // Сервер мог закрыть простаивавшее соединение одновременно с отправкой запроса:
+        // если ответ еще не начался, запрос один раз повторяется по новому соединению
+        bool retry = connection.reused && !connection.headersDone && connection.input.empty();
+        closeConnection(fd);
+        auto request = requests.find(requestId);
+        if (retry && request != requests.end() && !request->second.retried)
+        {
+            request->second.retried = true;
+            startRequest(requestId);
+            return;
+        }
+        response = HttpResponse();
+        response.error = error;
+        this->complete(requestId, std::move(response));
+        return;
+    }
+
+    std::string encoding;
+    auto header = response.headers.find("content-encoding");
+    if (header != response.headers.end())
+    {
+        encoding = header->second;
+        std::transform(encoding.begin(), encoding.end(), encoding.begin(), ::tolower);
+    }
+    if (encoding == "gzip" || encoding == "x-gzip" || encoding == "deflate")
+    {
+        std::string decoded;
+        if (inflate(response.body, decoded))
+        {
+            response.body = std::move(decoded);
+        }
+        else
+        {
+            response = HttpResponse();
+            response.error = "Не удалось распаковать HTTP-ответ";
+            connection.keepAlive = false;
+        }
+    }
+
+    if (connection.keepAlive)
+    {
+        // Соединение возвращается в пул до следующего запроса к тому же серверу
+        std::string key = connection.key;
+        connection = Connection();
+        connection.fd = fd;
+        connection.key = key;
+        connection.connected = true;
+        std::weak_ptr<bool> token = alive;
+        connection.idleTimer = loop.addTimer(
+            HTTP_IDLE_TIMEOUT,
+            [this, token, fd]() {
+                auto iter = connections.find(fd);
+                if (!token.expired() && iter != connections.end() && iter->second.requestId == 0)
+                {
+                    closeConnection(fd);
+                }
+            },
+            false);
+        watch(connection);
+    }
+    else
+    {
+        closeConnection(fd);
+    }
+    this->complete(requestId, std::move(response));
+}
+
+void HttpClient::closeConnection(int fd)
+{
+    auto iter = connections.find(fd);
+    if (iter == connections.end())
+    {
+        return;
+    }
+    if (iter->second.idleTimer)
+    {
+        loop.cancelTimer(iter->second.idleTimer);
+    }
+    loop.unwatchFd(fd);
+    close(fd);
+    connections.erase(iter);
+}
+
+void HttpClient::complete(int requestId, HttpResponse response)
+{
+    auto request = requests.find(requestId);
+    if (request == requests.end())
+    {
+        return;
+    }
+    loop.cancelTimer(request->second.timer);
+    Callback callback = std::move(request->second.callback);
+    requests.erase(request);
+    callback(std::move(response));
+}
@@ -0,0 +1,116 @@
+#ifndef HTTPCLIENT_H
+#define HTTPCLIENT_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+#include <vector>
+
+#include "eventloop.h"
+#include "resolver.h"
+
+struct HttpResponse
+{
+    int status = 0;               // Код ответа (0 - ошибка соединения или тайм-аут)
+    std::map<std::string, std::string> headers; // Заголовки ответа (имена в нижнем регистре)
+    std::string body;             // Тело ответа (после снятия chunked и gzip)
+    std::string error;            // Описание ошибки при status == 0
+};
+
+/*
+ Неблокирующий клиент HTTP/1.1 на цикле событий: запросы GET без отдельных потоков.
+ Соединения с одним сервером переиспользуются (keep-alive), ответ может быть передан
+ с Content-Length, chunked или до закрытия соединения, gzip и deflate распаковываются zlib.
+ Имя сервера разрешается асинхронно (Resolver) и кэшируется. HTTPS не поддерживается: такой URL
+ завершается ошибкой.
+ Все методы и обработчики выполняются в потоке цикла событий.
+ */
+class HttpClient {
+    public:
+    using Callback = std::function<void(HttpResponse response)>;
+    using Parameters = std::vector<std::pair<std::string, std::string>>;
+
+    private:
+    struct Request
+    {
+        int id;                       // Идентификатор запроса
+        std::string key;              // host:port сервера
+        std::string host;             // Имя сервера
+        int port;                     // Порт сервера
+        std::string data;             // Текст запроса
+        Callback callback;            // Получатель ответа
+        int timer = 0;                // Таймер тайм-аута
+        bool retried = false;         // Запрос уже повторялся после обрыва keep-alive
+    };
+
+    // Разбор тела в кодировке chunked
+    enum ChunkState
+    {
+        chunkSize,                    // Ожидается строка с размером части
+        chunkData,                    // Данные части
+        chunkEnd,                     // CRLF после данных части
+        chunkTrailer                  // Заголовки после последней части
+    };
+
+    struct Connection
+    {
+        int fd = -1;                  // Сокет
+        std::string key;              // host:port сервера
+        bool connected = false;       // Соединение установлено
+        bool reused = false;          // Текущий запрос отправлен по уже использованному соединению
+        int requestId = 0;            // Выполняемый запрос (0 - соединение простаивает)
+        int idleTimer = 0;            // Таймер закрытия простаивающего соединения
+        std::string output;           // Неотправленная часть запроса
+        std::string input;            // Принятые, но не разобранные данные
+        HttpResponse response;        // Разбираемый ответ
+        bool headersDone = false;     // Заголовки ответа разобраны
+        bool chunked = false;         // Тело передается частями
+        long long contentLength = -1; // Длина тела (-1 - до закрытия соединения)
+        ChunkState chunkState = chunkSize; // Состояние разбора chunked
+        long long chunkRemaining = 0; // Остаток данных текущей части
+        bool keepAlive = true;        // Соединение можно переиспользовать после ответа
+    };
+
+    EventLoop &loop;                  // Цикл событий
+    std::map<int, Request> requests;  // Выполняемые запросы по идентификатору
+    std::map<int, Connection> connections; // Соединения по дескриптору
+    Resolver resolver;                // Разрешение имен серверов
+    int nextRequestId = 1;            // Счетчик идентификаторов запросов
+    std::shared_ptr<bool> alive;      // Признак жизни клиента для отложенных обработчиков
+
+    void startRequest(int requestId);                // Отправка запроса по свободному или новому соединению
+    // Неблокирующее соединение с первым доступным адресом; -1 при ошибке
+    int openConnection(const Request &request, const std::vector<struct sockaddr_storage> &addresses);
+    void onEvent(int fd, short revents);             // Готовность сокета
+    void onConnected(Connection &connection);        // Соединение установлено
+    bool flush(Connection &connection);              // Отправка буфера; false при ошибке
+    bool receive(Connection &connection);            // Прием данных; false при ошибке или закрытии
+    // Разбор принятого; true, если ответ получен полностью. std::runtime_error при ошибке формата
+    bool parse(Connection &connection);
+    bool parseHeaders(Connection &connection);       // Разбор строки статуса и заголовков
+    bool parseChunks(Connection &connection);        // Разбор тела chunked
+    // Завершение ответа (complete) или обрыв соединения с описанием ошибки
+    void finish(int fd, bool complete, const std::string &error = "");
+    void closeConnection(int fd);                    // Закрытие соединения
+    void complete(int requestId, HttpResponse response); // Передача ответа получателю
+    void watch(const Connection &connection);        // Подписка на нужные события сокета
+
+    public:
+    explicit HttpClient(EventLoop &loop);            // Конструктор класса
+    ~HttpClient();                                   // Деструктор класса, закрывает соединения и отменяет запросы
+    // GET url?parameters; обработчик вызывается ровно один раз (в том числе при ошибке и тайм-ауте)
+    // в одной из следующих итераций цикла, если клиент к этому времени не уничтожен
+    void get(const std::string &url, const Parameters &parameters, long timeoutMs, Callback callback);
+    size_t getConnectionCount() const;               // Количество открытых соединений
+    EventLoop &getLoop();                            // Цикл событий клиента
+    Resolver &getResolver();                         // Разрешение имен с общим кэшем (для UDP-трекеров)
+    // Разбор URL вида http://host[:port]/path; false, если URL не HTTP
+    static bool parseUrl(const std::string &url, std::string &host, int &port, std::string &target);
+    // Распаковка gzip или deflate; false, если данные повреждены
+    static bool inflate(const std::string &input, std::string &output);
+};
+
+#endif                                               // HTTPCLIENT_H
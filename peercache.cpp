@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+#include "peercache.h"
+
+#define PEER_CACHE_DIR ".torrent-client.peers" // Каталог кэшей в домашнем каталоге
+#define PEER_CACHE_SIZE 50                    // Количество сохраняемых пиров
+#define PEER_CACHE_MAX_FAILURES 3             // Пир удаляется после стольких отказов подряд
+#define PEER_CACHE_MAX_AGE (30 * 24 * 3600)   // Пир без успешных сессий за столько секунд удаляется
+#define PEER_CACHE_HALF_LIFE (24 * 3600)      // За столько секунд вес загруженного объема падает вдвое
+#define PEER_RECORD_STATS 20                  // Размер статистики в записи файла
+
+// Целые числа в файле хранятся в сетевом порядке байт
+static void putNumber(std::string &buffer, uint64_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--)
+    {
+        buffer.push_back((char)((value >> (i * 8)) & 0xff));
+    }
+}
+
+static uint64_t getNumber(const std::string &buffer, size_t offset, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value = (value << 8) | (uint8_t)buffer[offset + i];
+    }
+    return value;
+}
+
+// Пир больше не предлагается: отказы подряд или давно не было успешных сессий
+static bool expired(const CachedPeer &peer, uint32_t now)
+{
+    return peer.failures >= PEER_CACHE_MAX_FAILURES ||
+           (now > peer.lastSeen && now - peer.lastSeen > PEER_CACHE_MAX_AGE);
+}
+
+// Рейтинг пира: загруженный объем, вдвое меньший за каждые PEER_CACHE_HALF_LIFE с последней сессии
+// и за каждый отказ подряд
+static double score(const CachedPeer &peer, uint32_t now)
+{
+    double age = now > peer.lastSeen ? now - peer.lastSeen : 0;
+    return std::ldexp((double)peer.downloaded * std::exp2(-age / PEER_CACHE_HALF_LIFE), -(int)peer.failures);
+}
+
+// Действующие пиры по убыванию рейтинга; при равенстве - меньше отказов, затем недавние
+static void rank(std::vector<std::pair<std::string, CachedPeer>> &peers)
+{
+    uint32_t now = std::time(nullptr);
+    peers.erase(std::remove_if(peers.begin(), peers.end(),
+                               [now](const std::pair<std::string, CachedPeer> &peer) {
+                                   return expired(peer.second, now);
+                               }),
+                peers.end());
+    std::vector<std::pair<double, size_t>> order; // Рейтинг считается один раз на пира
+    for (size_t i = 0; i < peers.size(); i++)
+    {
+        order.emplace_back(score(peers[i].second, now), i);
+    }
+    std::sort(order.begin(), order.end(), [&peers](const auto &a, const auto &b) {
+        if (a.first != b.first)
+        {
+            return a.first > b.first;
+        }
+        const CachedPeer &first = peers[a.second].second;
+        const CachedPeer &second = peers[b.second].second;
+        if (first.failures != second.failures)
+        {
+            return first.failures < second.failures;
+        }
+        return first.lastSeen > second.lastSeen;
+    });
+    std::vector<std::pair<std::string, CachedPeer>> sorted;
+    for (const auto &[peerScore, index] : order)
+    {
+        sorted.push_back(std::move(peers[index]));
+    }
+    peers = std::move(sorted);
+}
+
+PeerCache::PeerCache(std::string path) : path(std::move(path))
+{
+}
+
+std::string PeerCache::defaultPath(const std::string &infoHash)
+{
+    const char *home = std::getenv("HOME");
+    std::string directory = home ? std::string(home) + "/" + PEER_CACHE_DIR : PEER_CACHE_DIR;
+    mkdir(directory.c_str(), 0755);
+    return directory + "/" + infoHash;
+}
+
+void PeerCache::load()
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return;
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::lock_guard<std::mutex> guard(lock);
+    size_t offset = 0;
+    while (offset < data.length())
+    {
+        size_t endpointLength = (uint8_t)data[offset];
+        if (offset + 1 + endpointLength + PEER_RECORD_STATS > data.length())
+        {
+            std::cerr << "Кэш пиров " << path << " поврежден, прочитано " << peers.size() << " записей"
+                      << std::endl;
+            break;
+        }
+        std::string endpoint = data.substr(offset + 1, endpointLength);
+        offset += 1 + endpointLength;
+        CachedPeer &peer = peers[endpoint];
+        peer.successes = getNumber(data, offset, 4);
+        peer.failures = getNumber(data, offset + 4, 4);
+        peer.downloaded = getNumber(data, offset + 8, 8);
+        peer.lastSeen = getNumber(data, offset + 16, 4);
+        offset += PEER_RECORD_STATS;
+    }
+}
+
+void PeerCache::save()
+{
+    std::vector<std::pair<std::string, CachedPeer>> best;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        best.assign(peers.begin(), peers.end());
+    }
+    rank(best);
+    best.resize(std::min(best.size(), (size_t)PEER_CACHE_SIZE));
+
+    std::string data;
+    for (const auto &[endpoint, peer] : best)
+    {
+        data.push_back((char)endpoint.length());
+        data += endpoint;
+        putNumber(data, peer.successes, 4);
+        putNumber(data, peer.failures, 4);
+        putNumber(data, peer.downloaded, 8);
+        putNumber(data, peer.lastSeen, 4);
+    }
+    // Запись через временный файл, чтобы прерванное сохранение не испортило кэш
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file << data;
+        if (!file)
+        {
+            std::cerr << "Не удалось сохранить кэш пиров " << path << std::endl;
+            return;
+        }
+    }
+    std::rename(temporaryPath.c_str(), path.c_str());
+}
+
+std::vector<Peer> PeerCache::getPeers(size_t count)
+{
+    std::vector<std::pair<std::string, CachedPeer>> best;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        best.assign(peers.begin(), peers.end());
+    }
+    rank(best);
+    std::vector<Peer> result;
+    for (const auto &[endpoint, peer] : best)
+    {
+        if (result.size() >= count)
+        {
+            break;
+        }
+        bool compact = endpoint.length() == COMPACT_PEER_LEN || endpoint.length() == COMPACT_PEER6_LEN;
+        if (!compact)
+        {
+            continue;
+        }
+        result.emplace_back(endpoint);
+    }
+    return result;
+}
+
+void PeerCache::recordSuccess(const std::string &endpoint, uint64_t downloaded)
+{
+    if (endpoint.empty())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    CachedPeer &peer = peers[endpoint];
+    peer.successes++;
+    peer.failures = 0;
+    peer.downloaded += downloaded;
+    peer.lastSeen = std::time(nullptr);
+}
+
+void PeerCache::recordFailure(const std::string &endpoint)
+{
+    if (endpoint.empty())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    auto iter = peers.find(endpoint);
+    // Незнакомые пиры, к которым не удалось подключиться, в кэш не попадают
+    if (iter != peers.end())
+    {
+        iter->second.failures++;
+    }
+}
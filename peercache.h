@@ -0,0 +1,46 @@
+#ifndef PEERCACHE_H
+#define PEERCACHE_H
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "peerretriever.h"
+
+struct CachedPeer
+{
+    uint32_t successes = 0;       // Количество успешных сессий
+    uint32_t failures = 0;        // Количество неудачных подключений подряд
+    uint64_t downloaded = 0;      // Сколько байт загружено от пира за все сессии
+    uint32_t lastSeen = 0;        // Время последней успешной сессии
+};
+
+/*
+ Кэш пиров торрента между запусками. Хранит компактные адреса пиров со статистикой
+ подключений; при старте лучшие из них ставятся в очередь еще до ответа трекера. Рейтинг - загруженный
+ объем, который со временем и с каждым отказом подряд уменьшается; пиры с несколькими отказами подряд
+ или давно без успешных сессий удаляются.
+ Файл состоит из записей: длина адреса (1 байт), компактный адрес IPv4 или IPv6, successes, failures,
+ downloaded и lastSeen в сетевом порядке байт.
+ */
+class PeerCache {
+    private:
+    const std::string path;                  // Файл кэша
+    std::map<std::string, CachedPeer> peers; // Статистика по компактному адресу
+    std::mutex lock;                         // Мьютекс для предотвращения гонок
+
+    public:
+    explicit PeerCache(std::string path);    // Конструктор класса
+    void load();                             // Чтение кэша из файла
+    void save();                             // Запись лучших пиров в файл
+    std::vector<Peer> getPeers(size_t count);    // Лучшие пиры для подключения
+    void recordSuccess(const std::string &endpoint, uint64_t downloaded); // Сессия с пиром завершена
+    void recordFailure(const std::string &endpoint);                      // Подключение не удалось
+    // Файл кэша торрента в домашнем каталоге (infoHash в шестнадцатеричном виде)
+    static std::string defaultPath(const std::string &infoHash);
+};
+
+#endif                                       // PEERCACHE_H
@@ -1,27 +1,72 @@
 #include "SharedQueue.h"
 #include <cassert>
 #include <chrono>
+#include <ctime>
 #include <cstring>
 #include <iostream>
+#include <arpa/inet.h>
 #include <netinet/in.h>
 #include <stdexcept>
 #include <unistd.h>
 #include <utility>
 
+#include "choker.h"
 #include "connect.h" // Включение заголовочного файла для соединения
 #include "peerconnection.h" // Включение заголовочного файла для соединения с пирами
+#include "sha1.h"
 #include "utils.h" // Включение загоеловочного файла утилит
 
 #define INFO_HASH_STARTING_POS 28 // Начальная позиция хэша информации в сообщении рукопожатия
 #define PEER_ID_STARTING_POS 48 // Начальная позиция идентификатора пира в сообщении рукопожатия
+#define HANDSHAKE_LEN 68        // Длина сообщения рукопожатия
 #define HASH_LEN 20             // Длина хэша в байтах
-#define DUMMY_PEER_IP "0.0.0.0" // Фиктивный IP-адрес для проверки
+#define RESERVED_STARTING_POS 20 // Начальная позиция зарезервированных байт в сообщении рукопожатия
+#define FAST_EXTENSION_BIT 0x04  // Бит Fast Extension в последнем зарезервированном байте (BEP 6)
+#define ALLOWED_FAST_COUNT 10    // Размер allowed fast набора, который мы выдаем пиру
+#define EXTENSION_PROTOCOL_BIT 0x10 // Бит протокола расширений в шестом зарезервированном байте (BEP 10)
+#define EXTENDED_HANDSHAKE_ID 0  // Идентификатор extended handshake внутри сообщения extended
+#define PEX_INTERVAL 60          // Минимальный интервал между PEX-сообщениями одному пиру (секунды)
+#define MESSAGE_POLL_INTERVAL 1000 // Ожидание сообщения пира между проверками блокировки и новых фрагментов (мс)
+#define PEER_IDLE_TIMEOUT 150    // Пир, молчащий дольше (keep-alive приходит раз в 2 минуты), отключается (секунды)
+#define KEEP_ALIVE_INTERVAL 60   // Интервал отправки keep-alive, чтобы пир не отключил нас сам (секунды)
 
-PeerConnection::PeerConnection(SharedQueue<Peer *> *queue,
+// Набор зависит только от подсети /24 пира и info_hash
+std::set<int> generateAllowedFastSet(const std::string &ip, const Sha1Digest &infoHash, int pieceCount)
+{
+    std::set<int> allowed;
+    struct in_addr address;
+    if (pieceCount <= 0 || inet_pton(AF_INET, ip.c_str(), &address) <= 0)
+    {
+        return allowed;
+    }
+    uint32_t subnet = address.s_addr & htonl(0xFFFFFF00);
+    SHA1 checksum;
+    checksum.update((const char *)&subnet, sizeof(subnet));
+    checksum.update(infoHash.data(), infoHash.size());
+    Sha1Digest x = checksum.final();
+    size_t count = std::min(ALLOWED_FAST_COUNT, pieceCount);
+    while (allowed.size() < count)
+    {
+        for (int i = 0; i < 5 && allowed.size() < count; i++)
+        {
+            uint32_t y;
+            std::memcpy(&y, x.data() + i * 4, sizeof(y));
+            allowed.insert(ntohl(y) % pieceCount);
+        }
+        x = sha1Digest((const char *)x.data(), x.size());
+    }
+    return allowed;
+}
+
+PeerConnection::PeerConnection(SharedQueue<Peer> *queue,
                                std::string clientId,
-                               std::string infoHash,
-                               PieceManager *pieceManager)
-    : queue(queue), clientId(std::move(clientId)), infoHash(std::move(infoHash)), pieceManager(pieceManager)
+                               const Sha1Digest &infoHash,
+                               PieceManager *pieceManager,
+                               RateLimiter *torrentDownloadLimiter,
+                               RateLimiter *torrentUploadLimiter,
+                               PeerExchange *peerExchange)
+    : peerExchange(peerExchange), clientId(std::move(clientId)), infoHash(infoHash), queue(queue),
+      pieceManager(pieceManager), downloadLimiter(torrentDownloadLimiter), uploadLimiter(torrentUploadLimiter)
 {
 }
 
@@ -34,60 +79,48 @@ PeerConnection::~PeerConnection()
 void PeerConnection::start()
 {
     std::cout << "Запуск потока загрузки..." << std::endl;
-    while (!(terminated || pieceManager->isComplete()))
+    while (!terminated)
     {
         peer = queue->pop_front();
-        if (peer->ip == DUMMY_PEER_IP)
+        if (!peer.isValid())
         {
             return;
         }
 
+        downloadLimiter.reset();
+        uploadLimiter.reset();
         try
         {
             if (establishNewConnection())
             {
-                while (!pieceManager->isComplete())
+                time_t lastMessageTime = std::time(nullptr);
+                time_t lastKeepAliveTime = lastMessageTime;
+                while (!terminated)
                 {
-                    BitTorrentMessage message = receiveMessage();
-                    if (message.getMessageId() > 10)
+                    // Пир может подолгу молчать (например, ждать разблокировки): тишина - не ошибка,
+                    // пока не истек интервал keep-alive, а решения choker-а применяются и без сообщений
+                    time_t currentTime = std::time(nullptr);
+                    if (waitForData(sock, MESSAGE_POLL_INTERVAL))
                     {
-                        throw std::runtime_error("Получен недопустимый идентификатор сообщения от пира " + peerId);
+                        handleMessage(receiveMessage());
+                        lastMessageTime = std::time(nullptr);
                     }
-                    switch (message.getMessageId())
+                    else if (std::difftime(currentTime, lastMessageTime) > PEER_IDLE_TIMEOUT)
                     {
-                    case choke:
-                        choked = true;
-                        break;
-
-                    case unchoke:
-                        choked = false;
-                        break;
-
-                    case piece: {
-                        requestPending = false;
-                        std::string payload = message.getPayload();
-                        int index = bytesToInt(payload.substr(0, 4));
-                        int begin = bytesToInt(payload.substr(4, 4));
-                        std::string blockData = payload.substr(8);
-                        pieceManager->blockReceived(peerId, index, begin, blockData);
-                        break;
+                        throw std::runtime_error("Пир [" + peer.ip() + "] не отвечает дольше " +
+                                                 std::to_string(PEER_IDLE_TIMEOUT) + " секунд");
                     }
-                    case have: {
-                        std::string payload = message.getPayload();
-                        int pieceIndex = bytesToInt(payload);
-                        pieceManager->updatePeer(peerId, pieceIndex);
-                        break;
-                    }
-
-                    default:
-                        break;
+                    if (std::difftime(currentTime, lastKeepAliveTime) >= KEEP_ALIVE_INTERVAL)
+                    {
+                        sendData(sock, std::string(4, '\0'), &uploadLimiter);
+                        lastKeepAliveTime = currentTime;
                     }
-                    if (!choked)
+                    sendHaves();
+                    sendPeerExchange();
+                    applyChoking();
+                    if (!requestPending)
                     {
-                        if (!requestPending)
-                        {
-                            requestPiece();
-                        }
+                        requestPiece();
                     }
                 }
             }
@@ -95,7 +128,7 @@ void PeerConnection::start()
         catch (std::exception &e)
         {
             closeSock();
-            std::cerr << "Произошла ошибка при загрузке от пира " << peerId << " [" << peer->ip << "]" << std::endl;
+            std::cerr << "Произошла ошибка при загрузке от пира " << peerId << " [" << peer.ip() << "]" << std::endl;
             std::cerr << e.what() << std::endl;
         }
     }
@@ -106,37 +139,209 @@ void PeerConnection::stop()
     terminated = true;
 }
 
-void PeerConnection::performHandshake()
+void PeerConnection::handleMessage(const BitTorrentMessage &message)
 {
-    std::cout << "Подключение к пиру [" << peer->ip << "]..." << std::endl;
-    try
+    uint8_t messageId = message.getMessageId();
+    if (messageId == (uint8_t)keepAlive)
+    {
+        return;
+    }
+    bool fastMessage = messageId >= suggestPiece && messageId <= allowedFast;
+    bool extendedMessage = messageId == extended;
+    if (messageId > port && !(fastMessage && fastExtension) && !(extendedMessage && extensionProtocol))
+    {
+        throw std::runtime_error("Получен недопустимый идентификатор сообщения от пира " + peerId);
+    }
+    std::string payload = message.getPayload();
+    switch (messageId)
+    {
+    case choke:
+        choked = true;
+        // Без Fast Extension блокировка молча отменяет все наши запросы
+        if (!fastExtension)
+        {
+            releasePendingRequest();
+        }
+        break;
+
+    case unchoke:
+        choked = false;
+        break;
+
+    case piece: {
+        requestPending = false;
+        int index = bytesToInt(payload.substr(0, 4));
+        int begin = bytesToInt(payload.substr(4, 4));
+        std::string blockData = payload.substr(8);
+        sessionDownloaded += blockData.length();
+        pieceManager->blockReceived(peerId, index, begin, blockData);
+        break;
+    }
+    case have: {
+        int pieceIndex = bytesToInt(payload);
+        pieceManager->updatePeer(peerId, pieceIndex);
+        break;
+    }
+
+    case interested:
+        peerInterested = true;
+        if (choker)
+        {
+            choker->interested(this);
+        }
+        break;
+
+    case notInterested:
+        peerInterested = false;
+        break;
+
+    case request:
+        serveRequest(payload);
+        break;
+
+    case suggestPiece:
+        suggestedPieces.insert(bytesToInt(payload));
+        break;
+
+    case allowedFast:
+        allowedFastPieces.insert(bytesToInt(payload));
+        break;
+
+    case rejectRequest: {
+        int index = bytesToInt(payload.substr(0, 4));
+        int begin = bytesToInt(payload.substr(4, 4));
+        if (requestPending && pendingPiece == index && pendingOffset == begin)
+        {
+            releasePendingRequest();
+        }
+        break;
+    }
+
+    case extended:
+        handleExtendedMessage(payload);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void PeerConnection::sendExtendedHandshake()
+{
+    std::string payload(1, (char)EXTENDED_HANDSHAKE_ID);
+    payload += peerExchange->buildHandshake();
+    sendData(sock, BitTorrentMessage(extended, payload).toString(), &uploadLimiter);
+}
+
+void PeerConnection::handleExtendedMessage(const std::string &payload)
+{
+    if (payload.empty())
+    {
+        throw std::runtime_error("Получено пустое сообщение расширения от пира " + peer.ip());
+    }
+    auto extendedId = (uint8_t)payload[0];
+    if (extendedId == EXTENDED_HANDSHAKE_ID)
+    {
+        int listenPort;
+        PeerExchange::parseHandshake(payload.substr(1), peerPexId, listenPort);
+        // Для входящего пира адрес для PEX известен только из его handshake
+        if (peerEndpoint.empty() && listenPort)
+        {
+            peerEndpoint = encodeCompactPeer(peer.ip(), listenPort);
+            peerExchange->peerConnected(peerEndpoint);
+        }
+    }
+    else if (extendedId == UT_PEX_ID)
     {
-        sock = createConnection(peer->ip, peer->port);
+        std::vector<Peer> peers = peerExchange->parseMessage(payload.substr(1));
+        for (Peer &newPeer : peers)
+        {
+            queue->push_back(std::move(newPeer));
+        }
+        if (!peers.empty())
+        {
+            std::cout << "Получено " << peers.size() << " новых пиров через PEX от [" << peer.ip() << "]" << std::endl;
+        }
     }
-    catch (std::runtime_error &e)
+}
+
+void PeerConnection::sendPeerExchange()
+{
+    time_t currentTime = std::time(nullptr);
+    if (!peerPexId || std::difftime(currentTime, lastPexTime) < PEX_INTERVAL)
+    {
+        return;
+    }
+    lastPexTime = currentTime;
+    std::string message = peerExchange->buildMessage(peerEndpoint, pexSent);
+    if (message.empty())
+    {
+        return;
+    }
+    std::string payload(1, (char)peerPexId);
+    payload += message;
+    sendData(sock, BitTorrentMessage(extended, payload).toString(), &uploadLimiter);
+}
+
+void PeerConnection::releasePendingRequest()
+{
+    if (requestPending)
     {
-        throw std::runtime_error("Невозможно подключиться к пиру [" + peer->ip + "]");
+        pieceManager->requestRejected(pendingPiece, pendingOffset);
+        requestPending = false;
     }
-    std::cout << "Установлено TCP-соединение с пиром по сокету " << sock << ": УСПЕШНО" << std::endl;
+}
 
-    std::cout << "Отправка сообщения рукопожатия пиру [" << peer->ip << "]..." << std::endl;
+void PeerConnection::performHandshake()
+{
     std::string handshakeMessage = createHandshakeMessage();
-    sendData(sock, handshakeMessage);
-    std::cout << "Отправлено сообщение рукопожатия: УСПЕШНО" << std::endl;
+    std::string reply;
+    if (peer.sock >= 0)
+    {
+        // Входящее соединение: рукопожатие пира уже прочитано слушателем, отвечаем своим
+        sock = peer.sock;
+        reply = peer.handshake;
+        std::cout << "Отправка ответного рукопожатия входящему пиру [" << peer.ip() << "]..." << std::endl;
+        sendData(sock, handshakeMessage);
+    }
+    else
+    {
+        std::cout << "Подключение к пиру [" << peer.ip() << "]..." << std::endl;
+        try
+        {
+            sock = createConnection((struct sockaddr *)&peer.address, peer.addressLength());
+        }
+        catch (std::runtime_error &e)
+        {
+            throw std::runtime_error("Невозможно подключиться к пиру [" + peer.ip() + "]");
+        }
+        std::cout << "Установлено TCP-соединение с пиром по сокету " << sock << ": УСПЕШНО" << std::endl;
 
-    std::cout << "Получение ответа на сообщение рукопожатия от пира [" << peer->ip << "]..." << std::endl;
-    std::string reply = receiveData(sock, handshakeMessage.length());
+        std::cout << "Отправка сообщения рукопожатия пиру [" << peer.ip() << "]..." << std::endl;
+        sendData(sock, handshakeMessage);
+        std::cout << "Отправлено сообщение рукопожатия: УСПЕШНО" << std::endl;
+
+        std::cout << "Получение ответа на сообщение рукопожатия от пира [" << peer.ip() << "]..." << std::endl;
+        reply = receiveData(sock, handshakeMessage.length());
+    }
     if (reply.empty())
     {
         throw std::runtime_error("Получение рукопожатия от пира: НЕ УДАЛОСЬ [Нет ответа от пира]");
     }
+    // Зарезервированные байты и peer_id читаются только из рукопожатия полной длины
+    if (reply.size() < HANDSHAKE_LEN)
+    {
+        throw std::runtime_error("Получение рукопожатия от пира: НЕ УДАЛОСЬ [Неполное сообщение рукопожатия]");
+    }
     peerId = reply.substr(PEER_ID_STARTING_POS, HASH_LEN);
+    fastExtension = (reply[RESERVED_STARTING_POS + 7] & FAST_EXTENSION_BIT) != 0;
+    extensionProtocol = (reply[RESERVED_STARTING_POS + 5] & EXTENSION_PROTOCOL_BIT) != 0;
     std::cout << "Получен ответ на сообщение рукопожатия от пира: УСПЕШНО" << std::endl;
 
-    std::string receivedInfoHash = reply.substr(INFO_HASH_STARTING_POS, HASH_LEN);
-    if ((receivedInfoHash == infoHash) != 0)
+    // Хэш сравнивается прямо в ответе, без промежуточной строки
+    if (reply.compare(INFO_HASH_STARTING_POS, HASH_LEN, (const char *)infoHash.data(), infoHash.size()) != 0)
     {
-        throw std::runtime_error("Выполнение рукопожатия с пиром " + peer->ip +
+        throw std::runtime_error("Выполнение рукопожатия с пиром " + peer.ip() +
                                  ": НЕ УДАЛОСЬ [Получен несовпадающий хэш информации]");
     }
     std::cout << "Сравнение хэшей: УСПЕШНО" << std::endl;
@@ -144,21 +349,157 @@ void PeerConnection::performHandshake()
 
 void PeerConnection::receiveBitField()
 {
-    std::cout << "Получение сообщения BitField от пира [" << peer->ip << "]..." << std::endl;
+    std::cout << "Получение сообщения BitField от пира [" << peer.ip() << "]..." << std::endl;
     BitTorrentMessage message = receiveMessage();
-    if (message.getMessageId() != bitField)
+    if (message.getMessageId() == (uint8_t)keepAlive)
     {
-        throw std::runtime_error("Получение BitField от пира: НЕ УДАЛОСЬ [Неверный идентификатор сообщения]");
-    } // Возможна ошибка
-    peerBitField = message.getPayload();
+        receiveBitField();
+        return;
+    }
+    int byteCount = (pieceManager->getPieceCount() + 7) / 8;
+    switch (message.getMessageId())
+    {
+    case bitField:
+        peerBitField = message.getPayload();
+        break;
+
+    case haveAll:
+    case haveNone:
+        if (!fastExtension)
+        {
+            throw std::runtime_error("Получение BitField от пира: НЕ УДАЛОСЬ [Fast Extension не согласован]");
+        }
+        peerBitField.assign(byteCount, 0);
+        if (message.getMessageId() == haveAll)
+        {
+            for (int i = 0; i < pieceManager->getPieceCount(); i++)
+            {
+                setPiece(peerBitField, i);
+            }
+        }
+        break;
+
+    default:
+        // Пир без фрагментов вправе не отправлять BitField: первое сообщение обрабатывается как обычное
+        peerBitField.assign(byteCount, 0);
+        pieceManager->addPeer(peerId, peerBitField);
+        handleMessage(message);
+        std::cout << "Пир [" << peer.ip() << "] не отправил BitField: пустое битовое поле" << std::endl;
+        return;
+    }
 
     pieceManager->addPeer(peerId, peerBitField);
     std::cout << "Получено сообщение BitField от пира: УСПЕШНО" << std::endl;
 }
 
+void PeerConnection::sendBitField()
+{
+    haveCursor = 0;
+    pieceManager->getCompletedSince(haveCursor);
+    std::string ownBitField = pieceManager->getBitField();
+    bool haveNothing = ownBitField.find_first_not_of('\0') == std::string::npos;
+    if (fastExtension)
+    {
+        if (pieceManager->isComplete())
+        {
+            sendData(sock, BitTorrentMessage(haveAll).toString(), &uploadLimiter);
+        }
+        else if (haveNothing)
+        {
+            sendData(sock, BitTorrentMessage(haveNone).toString(), &uploadLimiter);
+        }
+        else
+        {
+            sendData(sock, BitTorrentMessage(bitField, ownBitField).toString(), &uploadLimiter);
+        }
+        sendAllowedFast();
+        return;
+    }
+    // Пустое битовое поле можно не отправлять
+    if (haveNothing)
+    {
+        return;
+    }
+    std::cout << "Отправка сообщения BitField пиру [" << peer.ip() << "]..." << std::endl;
+    sendData(sock, BitTorrentMessage(bitField, ownBitField).toString(), &uploadLimiter);
+}
+
+void PeerConnection::sendAllowedFast()
+{
+    ourAllowedFast = generateAllowedFastSet(peer.ip(), infoHash, pieceManager->getPieceCount());
+    for (int index : ourAllowedFast)
+    {
+        uint32_t pieceIndex = htonl(index);
+        std::string payload((char *)&pieceIndex, sizeof(pieceIndex));
+        sendData(sock, BitTorrentMessage(allowedFast, payload).toString(), &uploadLimiter);
+    }
+}
+
+void PeerConnection::sendHaves()
+{
+    for (int index : pieceManager->getCompletedSince(haveCursor))
+    {
+        uint32_t pieceIndex = htonl(index);
+        std::string payload((char *)&pieceIndex, sizeof(pieceIndex));
+        sendData(sock, BitTorrentMessage(have, payload).toString(), &uploadLimiter);
+    }
+}
+
+void PeerConnection::applyChoking()
+{
+    bool wanted = chokeWanted;
+    if (wanted == amChoking)
+    {
+        return;
+    }
+    std::cout << (wanted ? "Блокировка" : "Разблокировка") << " отдачи пиру [" << peer.ip() << "]" << std::endl;
+    sendData(sock, BitTorrentMessage(wanted ? choke : unchoke).toString(), &uploadLimiter);
+    amChoking = wanted;
+}
+
+void PeerConnection::serveRequest(const std::string &payload)
+{
+    if (payload.length() != 12)
+    {
+        throw std::runtime_error("Получен некорректный запрос от пира " + peer.ip());
+    }
+    int index = bytesToInt(payload.substr(0, 4));
+    int begin = bytesToInt(payload.substr(4, 4));
+    int length = bytesToInt(payload.substr(8, 4));
+    // Заблокированному пиру отдаются только фрагменты из его allowed fast набора
+    bool allowed = !amChoking || (fastExtension && ourAllowedFast.count(index));
+    if (allowed && pieceManager->sendBlock(sock, index, begin, length, &uploadLimiter))
+    {
+        return;
+    }
+    if (fastExtension)
+    {
+        // С Fast Extension пир должен узнать об отказе явно, чтобы сразу перезапросить блок у другого
+        sendData(sock, BitTorrentMessage(rejectRequest, payload).toString(), &uploadLimiter);
+    }
+    if (allowed)
+    {
+        std::cerr << "Отклонен запрос пира [" << peer.ip() << "]: кусок " << index << ", смещение " << begin
+                  << ", длина " << length << std::endl;
+    }
+}
+
 void PeerConnection::requestPiece()
 {
-    Block *block = pieceManager->nextRequest(peerId);
+    Block *block;
+    if (choked)
+    {
+        // Заблокированный пир отдает только фрагменты из allowed fast набора
+        if (allowedFastPieces.empty())
+        {
+            return;
+        }
+        block = pieceManager->nextRequest(peerId, allowedFastPieces, true);
+    }
+    else
+    {
+        block = pieceManager->nextRequest(peerId, suggestedPieces);
+    }
 
     if (!block)
     {
@@ -179,28 +520,30 @@ void PeerConnection::requestPiece()
     }
 
     std::stringstream info;
-    info << "Отправка сообщения запроса пиру " << peer->ip << " ";
+    info << "Отправка сообщения запроса пиру " << peer.ip() << " ";
     info << "[Кусок: " << std::to_string(block->piece) << " ";
     info << "Смещение: " << std::to_string(block->offset) << " ";
     info << "Длина: " << std::to_string(block->length) << "]";
     std::cout << info.str() << std::endl;
     std::string requestMessage = BitTorrentMessage(request, payload).toString();
-    sendData(sock, requestMessage);
+    sendData(sock, requestMessage, &uploadLimiter);
     requestPending = true;
+    pendingPiece = block->piece;
+    pendingOffset = block->offset;
     std::cout << "Отправлено сообщение запроса: УСПЕШНО" << std::endl;
 }
 
 void PeerConnection::sendInterested()
 {
-    std::cout << "Отправка сообщения Interested пиру [" << peer->ip << "]..." << std::endl;
+    std::cout << "Отправка сообщения Interested пиру [" << peer.ip() << "]..." << std::endl;
     std::string interestedMessage = BitTorrentMessage(interested).toString();
-    sendData(sock, interestedMessage);
+    sendData(sock, interestedMessage, &uploadLimiter);
     std::cout << "Отправлено сообщение Interested: УСПЕШНО" << std::endl;
 }
 
 void PeerConnection::receiveUnchoke()
 {
-    std::cout << "Получение сообщения Unchoke от пира [" << peer->ip << "]..." << std::endl;
+    std::cout << "Получение сообщения Unchoke от пира [" << peer.ip() << "]..." << std::endl;
     BitTorrentMessage message = receiveMessage();
     if (message.getMessageId() != unchoke)
     {
@@ -216,14 +559,31 @@ bool PeerConnection::establishNewConnection()
     try
     {
         performHandshake();
+        sendBitField();
+        if (extensionProtocol)
+        {
+            sendExtendedHandshake();
+        }
+        if (peer.sock < 0)
+        {
+            peerEndpoint = peer.compact();
+            peerExchange->peerConnected(peerEndpoint);
+        }
         receiveBitField();
         sendInterested();
+        sessionDownloaded = 0;
+        connected = true;
         return true;
     }
     catch (const std::runtime_error &e)
     {
-        std::cerr << "Произошла ошибка при подключении к пиру [" << peer->ip << "]" << std::endl;
+        std::cerr << "Произошла ошибка при подключении к пиру [" << peer.ip() << "]" << std::endl;
         std::cerr << e.what() << std::endl;
+        if (peerCache && peer.sock < 0)
+        {
+            peerCache->recordFailure(peer.compact());
+        }
+        closeSock();
         return false;
     }
 }
@@ -239,23 +599,25 @@ std::string PeerConnection::createHandshakeMessage()
     {
         reserved.push_back('\0');
     }
+    reserved[5] |= EXTENSION_PROTOCOL_BIT;
+    reserved[7] |= FAST_EXTENSION_BIT;
     buffer << reserved;
-    buffer << hexDecode(infoHash);
+    buffer.write((const char *)infoHash.data(), infoHash.size());
     buffer << clientId;
     assert(buffer.str().length() == protocol.length() + 49);
     return buffer.str();
 }
 
-BitTorrentMessage PeerConnection::receiveMessage(int bufferSize) const
+BitTorrentMessage PeerConnection::receiveMessage(int bufferSize)
 {
-    std::string reply = receiveData(sock, 0);
+    std::string reply = receiveData(sock, 0, &downloadLimiter);
     if (reply.empty())
     {
         return BitTorrentMessage(keepAlive);
     }
     auto messageId = (uint8_t)reply[0];
     std::string payload = reply.substr(1);
-    std::cout << "Получено сообщение с ID " << (int)messageId << " от пира [" << peer->ip << "]" << std::endl;
+    std::cout << "Получено сообщение с ID " << (int)messageId << " от пира [" << peer.ip() << "]" << std::endl;
     return BitTorrentMessage(messageId, payload);
 }
 
@@ -264,13 +626,75 @@ const std::string &PeerConnection::getPeerId() const
     return peerId;
 }
 
+void PeerConnection::setRateLimits(long downloadLimit, long uploadLimit)
+{
+    downloadLimiter.setRate(downloadLimit);
+    uploadLimiter.setRate(uploadLimit);
+}
+
+void PeerConnection::setPeerCache(PeerCache *cache)
+{
+    peerCache = cache;
+}
+
+void PeerConnection::setChoker(Choker *choker)
+{
+    this->choker = choker;
+}
+
+double PeerConnection::getDownloadRate() const
+{
+    return downloadLimiter.getThroughput();
+}
+
+double PeerConnection::getUploadRate() const
+{
+    return uploadLimiter.getThroughput();
+}
+
+bool PeerConnection::isConnected() const
+{
+    return connected;
+}
+
+bool PeerConnection::isPeerInterested() const
+{
+    return peerInterested;
+}
+
+void PeerConnection::setChoking(bool choke)
+{
+    chokeWanted = choke;
+}
+
 void PeerConnection::closeSock()
 {
     if (sock)
     {
         close(sock);
         sock = {};
-        requestPending = false;
+        releasePendingRequest();
+        fastExtension = false;
+        extensionProtocol = false;
+        peerPexId = 0;
+        lastPexTime = 0;
+        pexSent.clear();
+        if (connected && peerCache)
+        {
+            peerCache->recordSuccess(peerEndpoint, sessionDownloaded);
+        }
+        if (!peerEndpoint.empty())
+        {
+            peerExchange->peerDisconnected(peerEndpoint);
+            peerEndpoint.clear();
+        }
+        suggestedPieces.clear();
+        allowedFastPieces.clear();
+        ourAllowedFast.clear();
+        amChoking = true;
+        chokeWanted = true;
+        peerInterested = false;
+        connected = false;
         if (!peerBitField.empty())
         {
             peerBitField.clear();
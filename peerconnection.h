@@ -2,8 +2,13 @@
 #define PEERCONNECTION_H
 #include "SharedQueue.h"
 #include "bittorrentmessage.h"
+#include "peercache.h"
+#include "peerexchange.h"
 #include "peerretriever.h"
 #include "piecemanager.h"
+#include "ratelimiter.h"
+#include "sha1.h"
+#include <atomic>
 #include <cstdint>
 #include <initializer_list>
 #include <ios>
@@ -12,43 +17,92 @@
 #include <map>
 #include <memory>
 #include <regex>
+#include <set>
 #include <sstream>
 #include <string>
 
 using byte = unsigned char;
 
+class Choker;
+
+// Каноничный allowed fast набор из BEP 6 для пира с адресом ip (пустой для IPv6)
+std::set<int> generateAllowedFastSet(const std::string &ip, const Sha1Digest &infoHash, int pieceCount);
+
 class PeerConnection {
     private:
     int sock{};              // Сокет для соединения с пиром
     bool choked = true;      // Пир заблокирован передачей данных
     bool terminated = false; // Признак завершения соединения
     bool requestPending = false; // Флаг, указывающий, ожидается ли ответ на запрос к пиру
+    bool amChoking = true;       // Мы блокируем отдачу данных пиру
+    std::atomic<bool> chokeWanted{true};     // Решение choker-а о блокировке пира
+    std::atomic<bool> peerInterested{false}; // Пир заинтересован в наших фрагментах
+    std::atomic<bool> connected{false};      // Соединение с пиром установлено
+    bool fastExtension = false;  // Пир поддерживает Fast Extension (BEP 6)
+    bool extensionProtocol = false; // Пир поддерживает протокол расширений (BEP 10)
+    int peerPexId = 0;           // Идентификатор ut_pex у пира (0 - не поддерживается)
+    std::string peerEndpoint;    // Компактный адрес пира для PEX (пустой, пока неизвестен)
+    std::set<std::string> pexSent;   // Пиры, о которых этому пиру уже сообщено
+    time_t lastPexTime = 0;      // Время последней отправки PEX-сообщения
+    PeerExchange *peerExchange;  // Обмен списками пиров торрента
+    PeerCache *peerCache = nullptr; // Статистика пиров между запусками (может отсутствовать)
+    Choker *choker = nullptr;    // Выбор разблокируемых пиров (может отсутствовать)
+    uint64_t sessionDownloaded = 0; // Загружено от текущего пира за сессию
+    int pendingPiece = -1;       // Фрагмент ожидающего ответа запроса
+    int pendingOffset = -1;      // Смещение ожидающего ответа запроса
+    std::set<int> suggestedPieces;   // Фрагменты, которые пир советует загрузить
+    std::set<int> allowedFastPieces; // Фрагменты, которые пир отдает нам даже при блокировке
+    std::set<int> ourAllowedFast;    // Фрагменты, которые мы отдаем пиру даже при блокировке
+    size_t haveCursor = 0;       // Позиция в списке проверенных фрагментов, о которых пир уже знает
     const std::string clientId; // Идентификатор клиента
-    const std::string infoHash; // Хэш информации
-    SharedQueue<Peer *> *queue; // Очередь для обработки пиров
-    Peer *peer;                 // Пир, с которым установлено соединение
+    const Sha1Digest infoHash;  // Хэш информации
+    SharedQueue<Peer> *queue;  // Очередь для обработки пиров
+    Peer peer;                  // Пир, с которым установлено соединение
     std::string peerBitField;   // Битовое поле пира
     std::string peerId;         // Идентификатор пира
     PieceManager *pieceManager; // Менеджер кусков файла
+    RateLimiter downloadLimiter; // Лимит загрузки от пира (родитель - лимит торрента)
+    RateLimiter uploadLimiter;   // Лимит отдачи пиру (родитель - лимит торрента)
 
                                 // Методы для управления соединением
     std::string createHandshakeMessage(); // Создание сообщения рукопожатия
     void performHandshake();              // Выполнение рукопожатия
     void receiveBitField();               // Получение битового поля от пира
+    void sendBitField();                  // Отправка нашего битового поля пиру (или have_all/have_none)
+    void sendAllowedFast();               // Отправка нашего allowed fast набора пиру
+    void handleMessage(const BitTorrentMessage &message); // Обработка сообщения от пира
+    void releasePendingRequest();         // Возврат ожидающего запроса в общий пул
+    void sendExtendedHandshake();         // Отправка extended handshake (BEP 10)
+    void handleExtendedMessage(const std::string &payload); // Обработка сообщения расширения
+    void sendPeerExchange();              // Периодическая отправка PEX-сообщения (BEP 11)
+    void sendHaves();                     // Уведомление пира о новых проверенных фрагментах
+    void applyChoking();                  // Отправка choke/unchoke, если решение choker-а изменилось
+    void serveRequest(const std::string &payload); // Отдача запрошенного пиром блока
     void sendInterested(); // Отправка сообщения о заинтересованности пиру
     void receiveUnchoke(); // Получение разблокировки от пира
     void requestPiece();   // Запрос куска файла у пира
     void closeSock();      // Закрытие сокета соединения
     bool establishNewConnection();                              // Установка нового соединения
-    BitTorrentMessage receiveMessage(int bufferSize = 0) const; // Получение сообщения от пира
+    BitTorrentMessage receiveMessage(int bufferSize = 0);       // Получение сообщения от пира
 
     public:
     const std::string &getPeerId() const;                // Получение идентификатора пира
+    void setRateLimits(long downloadLimit, long uploadLimit); // Лимиты пира, байт/с (0 - без ограничения)
+    void setPeerCache(PeerCache *cache);                 // Учет результатов сессий в кэше пиров
+    void setChoker(Choker *choker);                      // Разблокировка заинтересовавшегося пира без ожидания
+    double getDownloadRate() const;                      // Текущая скорость загрузки от пира
+    double getUploadRate() const;                        // Текущая скорость отдачи пиру
+    bool isConnected() const;                            // Установлено ли соединение с пиром
+    bool isPeerInterested() const;                       // Заинтересован ли пир в наших фрагментах
+    void setChoking(bool choke);                         // Решение choker-а; применяется потоком соединения
 
-    explicit PeerConnection(SharedQueue<Peer *> *queue,
+    explicit PeerConnection(SharedQueue<Peer> *queue,
                             std::string clientId,
-                            std::string infoHash,
-                            PieceManager *pieceManager); // Конструктор класса
+                            const Sha1Digest &infoHash,
+                            PieceManager *pieceManager,
+                            RateLimiter *torrentDownloadLimiter,
+                            RateLimiter *torrentUploadLimiter,
+                            PeerExchange *peerExchange); // Конструктор класса
     ~PeerConnection();                                   // Деструктор класса
     void start();                                        // Метод запуска соединения
     void stop();                                         // Метод завершения соединения
@@ -0,0 +1,153 @@
+#include <stdexcept>
+
+#include "bencode.h"
+#include "peerexchange.h"
+
+#define MAX_PEX_PEERS 50        // Максимальное количество добавленных/удаленных пиров в одном сообщении
+#define CLIENT_VERSION "torrent-client"
+#define MAX_DISCOVERED_PEERS 2000 // Предел памяти о пирах, уже переданных в очередь
+
+PeerExchange::PeerExchange(const int listenPort) : listenPort(listenPort)
+{
+}
+
+void PeerExchange::peerConnected(const std::string &endpoint)
+{
+    if (endpoint.empty())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    connected.insert(endpoint);
+    discovered.erase(endpoint);
+}
+
+void PeerExchange::peerDisconnected(const std::string &endpoint)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    connected.erase(endpoint);
+}
+
+std::string PeerExchange::buildHandshake()
+{
+    auto extensions = BDictionary::create();
+    (*extensions)[BString::create("ut_pex")] = BInteger::create(UT_PEX_ID);
+    auto handshake = BDictionary::create();
+    (*handshake)[BString::create("m")] = std::move(extensions);
+    (*handshake)[BString::create("p")] = BInteger::create(listenPort);
+    (*handshake)[BString::create("v")] = BString::create(CLIENT_VERSION);
+    return encode(std::move(handshake));
+}
+
+void PeerExchange::parseHandshake(const std::string &payload, int &pexId, int &listenPort)
+{
+    pexId = 0;
+    listenPort = 0;
+    auto handshake = std::dynamic_pointer_cast<BDictionary>(std::shared_ptr<BItem>(decode(payload)));
+    if (!handshake)
+    {
+        throw std::runtime_error("Некорректный extended handshake [Не словарь]");
+    }
+    auto extensions = std::dynamic_pointer_cast<BDictionary>(handshake->getValue("m"));
+    if (extensions)
+    {
+        auto pex = std::dynamic_pointer_cast<BInteger>(extensions->getValue("ut_pex"));
+        if (pex)
+        {
+            pexId = (int)pex->value();
+        }
+    }
+    auto port = std::dynamic_pointer_cast<BInteger>(handshake->getValue("p"));
+    if (port && port->value() > 0 && port->value() < 65536)
+    {
+        listenPort = (int)port->value();
+    }
+}
+
+std::string PeerExchange::buildMessage(const std::string &endpoint, std::set<std::string> &sent)
+{
+    std::string added;
+    std::string dropped;
+    std::string added6;   // IPv6-пиры передаются в отдельных ключах (BEP 11)
+    std::string dropped6;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        int count = 0;
+        for (const std::string &peer : connected)
+        {
+            if (count >= MAX_PEX_PEERS)
+            {
+                break;
+            }
+            if (peer != endpoint && sent.insert(peer).second)
+            {
+                (peer.length() == COMPACT_PEER6_LEN ? added6 : added) += peer;
+                count++;
+            }
+        }
+        count = 0;
+        for (auto iter = sent.begin(); iter != sent.end() && count < MAX_PEX_PEERS;)
+        {
+            if (connected.count(*iter) == 0)
+            {
+                (iter->length() == COMPACT_PEER6_LEN ? dropped6 : dropped) += *iter;
+                iter = sent.erase(iter);
+                count++;
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+    if (added.empty() && dropped.empty() && added6.empty() && dropped6.empty())
+    {
+        return "";
+    }
+    auto message = BDictionary::create();
+    (*message)[BString::create("added")] = BString::create(added);
+    (*message)[BString::create("added.f")] = BString::create(std::string(added.length() / COMPACT_PEER_LEN, '\0'));
+    (*message)[BString::create("dropped")] = BString::create(dropped);
+    if (!added6.empty() || !dropped6.empty())
+    {
+        (*message)[BString::create("added6")] = BString::create(added6);
+        (*message)[BString::create("added6.f")] =
+            BString::create(std::string(added6.length() / COMPACT_PEER6_LEN, '\0'));
+        (*message)[BString::create("dropped6")] = BString::create(dropped6);
+    }
+    return encode(std::move(message));
+}
+
+std::vector<Peer> PeerExchange::parseMessage(const std::string &payload)
+{
+    auto message = std::dynamic_pointer_cast<BDictionary>(std::shared_ptr<BItem>(decode(payload)));
+    if (!message)
+    {
+        throw std::runtime_error("Некорректное PEX-сообщение [Не словарь]");
+    }
+    std::vector<Peer> fresh;
+    std::lock_guard<std::mutex> guard(lock);
+    if (discovered.size() > MAX_DISCOVERED_PEERS)
+    {
+        discovered.clear();
+    }
+    for (const auto &[key, entryLength] : {std::make_pair("added", COMPACT_PEER_LEN),
+                                           std::make_pair("added6", COMPACT_PEER6_LEN)})
+    {
+        auto addedItem = std::dynamic_pointer_cast<BString>(message->getValue(key));
+        if (!addedItem)
+        {
+            continue;
+        }
+        std::string added = addedItem->value();
+        for (size_t offset = 0; offset + entryLength <= added.length(); offset += entryLength)
+        {
+            std::string peer = added.substr(offset, entryLength);
+            if (connected.count(peer) == 0 && discovered.insert(peer).second)
+            {
+                fresh.emplace_back(peer);
+            }
+        }
+    }
+    return fresh;
+}
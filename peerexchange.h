@@ -0,0 +1,38 @@
+#ifndef PEEREXCHANGE_H
+#define PEEREXCHANGE_H
+
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "peerretriever.h"
+
+#define UT_PEX_ID 1 // Наш идентификатор расширения ut_pex в extended handshake
+
+/*
+ Обмен списками пиров (BEP 11) поверх протокола расширений (BEP 10).
+ Хранит подключенных пиров торрента в компактном виде и формирует для каждого
+ соединения разницу между текущим списком и тем, что этому пиру уже отправлено.
+ */
+class PeerExchange {
+    private:
+    const int listenPort;             // Порт для входящих соединений (ключ "p" в handshake)
+    std::set<std::string> connected;  // Подключенные пиры (6 байт на пира)
+    std::set<std::string> discovered; // Пиры, уже переданные в очередь через PEX
+    std::mutex lock;                  // Мьютекс для предотвращения гонок
+
+    public:
+    explicit PeerExchange(int listenPort);  // Конструктор класса
+    void peerConnected(const std::string &endpoint);    // Пир подключен
+    void peerDisconnected(const std::string &endpoint); // Пир отключен
+    std::string buildHandshake();           // Словарь extended handshake с поддержкой ut_pex
+    // Разбор extended handshake: идентификатор ut_pex пира и его порт для входящих соединений
+    static void parseHandshake(const std::string &payload, int &pexId, int &listenPort);
+    // PEX-сообщение для пира endpoint; sent - пиры, о которых ему уже сообщено (обновляется)
+    std::string buildMessage(const std::string &endpoint, std::set<std::string> &sent);
+    // Разбор PEX-сообщения; возвращает пиров, которых еще нет в очереди и среди подключенных
+    std::vector<Peer> parseMessage(const std::string &payload);
+};
+
+#endif                                      // PEEREXCHANGE_H
@@ -0,0 +1,227 @@
+#include <arpa/inet.h>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <netinet/in.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "connect.h"
+#include "peerlistener.h"
+
+#define HANDSHAKE_LEN 68            // Длина рукопожатия с протоколом "BitTorrent protocol"
+#define INFO_HASH_STARTING_POS 28   // Начальная позиция хэша информации в сообщении рукопожатия
+#define HASH_LEN 20                 // Длина хэша в байтах
+#define HANDSHAKE_TIMEOUT 5         // Время ожидания рукопожатия (секунды)
+#define MAX_PENDING_HANDSHAKES 64   // Максимальное количество соединений без рукопожатия
+#define POLL_INTERVAL 500           // Интервал проверки остановки потока (миллисекунды)
+#define LISTEN_BACKLOG 32           // Длина очереди входящих соединений
+#define PROTOCOL_NAME_LEN 19        // Длина строки "BitTorrent protocol"
+
+PeerListener::PeerListener(const int port) : port(port)
+{
+}
+
+PeerListener::~PeerListener()
+{
+    stop();
+}
+
+bool PeerListener::start()
+{
+    if (running)
+    {
+        return true;
+    }
+    // Двухстековый сокет принимает и IPv6, и IPv4 (как ::ffff:a.b.c.d); без IPv6 - только IPv4
+    struct sockaddr_storage address {};
+    socklen_t addressLength;
+    listenSock = socket(AF_INET6, SOCK_STREAM, 0);
+    if (listenSock >= 0)
+    {
+        int v6only = 0;
+        setsockopt(listenSock, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+        auto *ipv6 = (struct sockaddr_in6 *)&address;
+        ipv6->sin6_family = AF_INET6;
+        ipv6->sin6_addr = in6addr_any;
+        ipv6->sin6_port = htons(port);
+        addressLength = sizeof(struct sockaddr_in6);
+    }
+    else
+    {
+        listenSock = socket(AF_INET, SOCK_STREAM, 0);
+        auto *ipv4 = (struct sockaddr_in *)&address;
+        ipv4->sin_family = AF_INET;
+        ipv4->sin_addr.s_addr = htonl(INADDR_ANY);
+        ipv4->sin_port = htons(port);
+        addressLength = sizeof(struct sockaddr_in);
+    }
+    if (listenSock < 0)
+    {
+        std::cerr << "Не удалось создать слушающий сокет" << std::endl;
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if (bind(listenSock, (struct sockaddr *)&address, addressLength) < 0 || listen(listenSock, LISTEN_BACKLOG) < 0 ||
+        !setSocketBlocking(listenSock, false))
+    {
+        std::cerr << "Не удалось открыть порт " << port << " для входящих соединений" << std::endl;
+        close(listenSock);
+        listenSock = -1;
+        return false;
+    }
+    running = true;
+    acceptThread = std::thread(&PeerListener::acceptLoop, this);
+    std::cout << "Ожидание входящих соединений на порту " << port << std::endl;
+    return true;
+}
+
+void PeerListener::stop()
+{
+    if (!running)
+    {
+        return;
+    }
+    running = false;
+    if (acceptThread.joinable())
+    {
+        acceptThread.join();
+    }
+    for (PendingHandshake &conn : pending)
+    {
+        close(conn.peer.sock);
+    }
+    pending.clear();
+    close(listenSock);
+    listenSock = -1;
+}
+
+void PeerListener::registerTorrent(const std::string &infoHash, Handler handler)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    torrents[infoHash] = std::move(handler);
+}
+
+void PeerListener::unregisterTorrent(const std::string &infoHash)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    torrents.erase(infoHash);
+}
+
+void PeerListener::acceptLoop()
+{
+    std::vector<struct pollfd> fds;
+    while (running)
+    {
+        fds.clear();
+        fds.push_back({listenSock, POLLIN, 0});
+        for (PendingHandshake &conn : pending)
+        {
+            fds.push_back({conn.peer.sock, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), POLL_INTERVAL) < 0)
+        {
+            continue;
+        }
+
+        // Обход с конца, чтобы удаление не сдвигало еще не проверенные соединения
+        time_t currentTime = std::time(nullptr);
+        for (int i = (int)pending.size() - 1; i >= 0; i--)
+        {
+            bool done;
+            if (fds[i + 1].revents)
+            {
+                done = readHandshake(pending[i]);
+            }
+            else
+            {
+                done = std::difftime(currentTime, pending[i].acceptedAt) >= HANDSHAKE_TIMEOUT;
+                if (done)
+                {
+                    close(pending[i].peer.sock);
+                }
+            }
+            if (done)
+            {
+                pending.erase(pending.begin() + i);
+            }
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            acceptConnection();
+        }
+    }
+}
+
+void PeerListener::acceptConnection()
+{
+    PendingHandshake conn;
+    socklen_t length = sizeof(conn.peer.address);
+    int sock = accept(listenSock, (struct sockaddr *)&conn.peer.address, &length);
+    if (sock < 0)
+    {
+        return;
+    }
+    if (pending.size() >= MAX_PENDING_HANDSHAKES || !setSocketBlocking(sock, false))
+    {
+        close(sock);
+        return;
+    }
+    conn.peer.normalize();
+    conn.peer.sock = sock;
+    conn.acceptedAt = std::time(nullptr);
+    pending.push_back(std::move(conn));
+}
+
+bool PeerListener::readHandshake(PendingHandshake &conn)
+{
+    char buffer[HANDSHAKE_LEN];
+    long bytesRead = recv(conn.peer.sock, buffer, HANDSHAKE_LEN - conn.peer.handshake.length(), 0);
+    if (bytesRead <= 0)
+    {
+        close(conn.peer.sock);
+        return true;
+    }
+    conn.peer.handshake.append(buffer, bytesRead);
+    if (conn.peer.handshake.length() < HANDSHAKE_LEN)
+    {
+        return false;
+    }
+    if (!dispatch(conn))
+    {
+        close(conn.peer.sock);
+    }
+    return true;
+}
+
+bool PeerListener::dispatch(PendingHandshake &conn)
+{
+    if (conn.peer.handshake[0] != PROTOCOL_NAME_LEN)
+    {
+        return false;
+    }
+    std::string infoHash = conn.peer.handshake.substr(INFO_HASH_STARTING_POS, HASH_LEN);
+    Handler handler;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto iter = torrents.find(infoHash);
+        if (iter == torrents.end())
+        {
+            return false;
+        }
+        handler = iter->second;
+    }
+    if (!setSocketBlocking(conn.peer.sock, true))
+    {
+        return false;
+    }
+    if (!handler(conn.peer))
+    {
+        return false;
+    }
+    std::cout << "Принято входящее соединение от пира [" << conn.peer.ip() << "]" << std::endl;
+    return true;
+}
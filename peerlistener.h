@@ -0,0 +1,52 @@
+#ifndef PEERLISTENER_H
+#define PEERLISTENER_H
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "peerretriever.h"
+
+/*
+ Принимает входящие соединения на порту, который клиент анонсирует трекеру.
+ Дочитывает рукопожатие, по info_hash находит зарегистрированный торрент
+ и передает ему уже открытый сокет вместе с полученным рукопожатием.
+ */
+class PeerListener {
+    public:
+    // Обработчик входящего пира; возвращает false, если торрент не может принять соединение
+    using Handler = std::function<bool(Peer &peer)>;
+
+    explicit PeerListener(int port); // Конструктор класса
+    ~PeerListener();                 // Деструктор класса
+    bool start();                    // Открытие порта и запуск потока приема
+    void stop();                     // Остановка приема и закрытие порта
+    void registerTorrent(const std::string &infoHash, Handler handler); // infoHash - 20 байт
+    void unregisterTorrent(const std::string &infoHash);
+
+    private:
+    struct PendingHandshake
+    {
+        Peer peer;               // Адрес пира, сокет и прочитанная часть рукопожатия
+        time_t acceptedAt;       // Время принятия соединения
+    };
+
+    const int port;                            // Порт для входящих соединений
+    int listenSock = -1;                       // Слушающий сокет
+    std::atomic<bool> running{false};          // Признак работы потока приема
+    std::thread acceptThread;                  // Поток приема соединений
+    std::map<std::string, Handler> torrents;   // Торренты по info_hash
+    std::vector<PendingHandshake> pending;     // Соединения, ожидающие рукопожатия
+    std::mutex lock;                           // Мьютекс для списка торрентов
+
+    void acceptLoop();                         // Цикл приема соединений
+    void acceptConnection();                   // Прием нового соединения
+    bool readHandshake(PendingHandshake &conn); // Чтение рукопожатия; true - соединение обработано
+    bool dispatch(PendingHandshake &conn);     // Передача соединения торренту
+};
+
+#endif                                         // PEERLISTENER_H
@@ -1,15 +1,43 @@
 #include "bencode.h"
+#include <algorithm>
+#include <arpa/inet.h>
 #include <bitset>
-#include <cpr/cpr.h>
+#include <cstring>
 #include <iostream>
 #include <random>
 #include <stdexcept>
 #include <string>
 #include <utility>
 
+#include "httpclient.h"
 #include "peerretriever.h"
+#include "udptracker.h"
 #include "utils.h"
 #define TRACKER_TIMEOUT 15000 // Определяет тайм-аут для трекера в миллисекундах
+#define DEFAULT_ANNOUNCE_INTERVAL 1800 // Интервал анонса, если трекер его не указал (секунды)
+
+// Целое значение ключа словаря или fallback, если ключа нет или он другого типа
+static int integerValue(const std::shared_ptr<BDictionary> &dictionary, const std::string &key, int fallback)
+{
+    auto value = std::dynamic_pointer_cast<BInteger>(dictionary->getValue(key));
+    return value ? (int)value->value() : fallback;
+}
+
+// Имя события в запросе к HTTP-трекеру (BEP 3)
+static std::string eventName(TrackerEvent event)
+{
+    switch (event)
+    {
+    case eventCompleted:
+        return "completed";
+    case eventStarted:
+        return "started";
+    case eventStopped:
+        return "stopped";
+    default:
+        return "";
+    }
+}
 
 PeerRetriever::PeerRetriever(
     std::string peerId, std::string announceUrl, std::string infoHash, int port, const unsigned long fileSize)
@@ -22,46 +50,213 @@ PeerRetriever::PeerRetriever(
     this->port = port;
 }
 
-std::vector<Peer *> PeerRetriever::retrievePeers(unsigned long bytesDownloaded)
+void PeerRetriever::retrievePeers(HttpClient &http,
+                                  unsigned long bytesDownloaded,
+                                  unsigned long bytesUploaded,
+                                  int numWant,
+                                  TrackerEvent event,
+                                  PeersCallback done)
 {
     // Формирует строку с информацией о параметрах запроса.
     std::stringstream info;
     info << "Retrieving peers from " << announceUrl << " with the following parameters..." << std::endl;
-    // хэш информации будет закодирован в URL-формате библиотекой cpr
-    info << "info_hash: " << infoHash << std::endl;
+    // хэш информации будет закодирован в URL-формате клиентом HTTP
+    info << "info_hash: " << hexEncode(infoHash) << std::endl;
     info << "peer_id: " << peerId << std::endl;
     info << "port: " << port << std::endl;
-    info << "uploaded: " << 0 << std::endl;
+    info << "uploaded: " << std::to_string(bytesUploaded) << std::endl;
     info << "downloaded: " << std::to_string(bytesDownloaded) << std::endl;
     info << "left: " << std::to_string(fileSize - bytesDownloaded) << std::endl;
+    info << "numwant: " << std::to_string(numWant) << std::endl;
     info << "compact: " << std::to_string(1);
+    if (event != eventNone)
+    {
+        info << std::endl << "event: " << eventName(event);
+    }
+    interval = 0;
+    std::shared_ptr<PeerRetriever> self = shared_from_this();
+
+    // udp:// трекеры обслуживаются по протоколу BEP 15 на том же цикле событий
+    std::string udpHost;
+    int udpPort;
+    if (UdpTracker::parseUrl(announceUrl, udpHost, udpPort))
+    {
+        auto tracker = std::make_shared<UdpTracker>(http.getLoop(), http.getResolver(), udpHost, udpPort);
+        tracker->announce(infoHash, peerId, port, bytesDownloaded, fileSize - bytesDownloaded, bytesUploaded, event,
+                          numWant, [self, done](const UdpAnnounceResult &result, const std::string &error) {
+                              if (!error.empty())
+                              {
+                                  std::cerr << error << std::endl;
+                                  done({});
+                                  return;
+                              }
+                              // В BEP 15 нет минимального интервала
+                              self->interval = result.interval > 0 ? result.interval : DEFAULT_ANNOUNCE_INTERVAL;
+                              self->minInterval = 0;
+                              self->seeders = result.seeders;
+                              self->leechers = result.leechers;
+                              done(result.peers);
+                          });
+        return;
+    }
 
     // Выполняет HTTP-запрос к трекеру.
-    cpr::Response res = cpr::Get(cpr::Url{announceUrl},
-                                 cpr::Parameters{{"info_hash", std::string(hexDecode(infoHash))},
-                                                 {"peer_id", std::string(peerId)},
-                                                 {"port", std::to_string(port)},
-                                                 {"uploaded", std::to_string(0)},
-                                                 {"downloaded", std::to_string(bytesDownloaded)},
-                                                 {"left", std::to_string(fileSize - bytesDownloaded)},
-                                                 {"compact", std::to_string(1)}},
-                                 cpr::Timeout{TRACKER_TIMEOUT});
-
-    // Если ответ успешно получен
-    if (res.status_code == 200)
-    {
-        // Декодирует ответ и получает список пиров.
-        std::vector<Peer *> peers = decodeResponse(res.text);
-        return peers;
+    HttpClient::Parameters parameters = {{"info_hash", infoHash},
+                                         {"peer_id", std::string(peerId)},
+                                         {"port", std::to_string(port)},
+                                         {"uploaded", std::to_string(bytesUploaded)},
+                                         {"downloaded", std::to_string(bytesDownloaded)},
+                                         {"left", std::to_string(fileSize - bytesDownloaded)},
+                                         {"numwant", std::to_string(numWant)},
+                                         {"compact", std::to_string(1)}};
+    if (event != eventNone)
+    {
+        parameters.push_back({"event", eventName(event)});
     }
-    else
+    http.get(announceUrl,
+             parameters,
+             TRACKER_TIMEOUT,
+             [self, done](HttpResponse res) {
+                 // Если ответ успешно получен, декодирует его и получает список пиров.
+                 // В случае ошибки в запросе передает пустой вектор.
+                 std::vector<Peer> peers;
+                 if (res.status == 200)
+                 {
+                     try
+                     {
+                         peers = self->decodeResponse(res.body);
+                     }
+                     catch (const std::runtime_error &e)
+                     {
+                         self->interval = 0;
+                         std::cerr << e.what() << std::endl;
+                     }
+                 }
+                 else if (!res.error.empty())
+                 {
+                     std::cerr << res.error << std::endl;
+                 }
+                 done(std::move(peers));
+             });
+}
+
+void PeerRetriever::scrape(HttpClient &http, ScrapeCallback done)
+{
+    std::shared_ptr<PeerRetriever> self = shared_from_this();
+    std::string udpHost;
+    int udpPort;
+    if (UdpTracker::parseUrl(announceUrl, udpHost, udpPort))
+    {
+        auto tracker = std::make_shared<UdpTracker>(http.getLoop(), http.getResolver(), udpHost, udpPort);
+        tracker->scrape({infoHash}, [self, done](const std::vector<UdpScrapeResult> &results, const std::string &error) {
+            if (!error.empty() || results.empty())
+            {
+                std::cerr << error << std::endl;
+                done(false);
+                return;
+            }
+            self->seeders = results[0].seeders;
+            self->leechers = results[0].leechers;
+            self->completed = results[0].completed;
+            done(true);
+        });
+        return;
+    }
+
+    std::string url = scrapeUrl(announceUrl);
+    if (url.empty())
+    {
+        http.getLoop().post([done]() { done(false); });
+        return;
+    }
+    http.get(url, {{"info_hash", infoHash}}, TRACKER_TIMEOUT, [self, done](HttpResponse res) {
+        bool success = false;
+        if (res.status == 200)
+        {
+            try
+            {
+                success = self->decodeScrape(res.body);
+            }
+            catch (const std::runtime_error &e)
+            {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+        done(success);
+    });
+}
+
+bool PeerRetriever::decodeScrape(const std::string &response)
+{
+    // Ответ: {"files": {<info_hash>: {"complete", "downloaded", "incomplete"}}}.
+    // Трекер может прислать статистику и других раздач, поэтому ищется ключ с нашим хэшем.
+    auto responseDict = std::dynamic_pointer_cast<BDictionary>(std::shared_ptr<BItem>(decode(response)));
+    if (!responseDict)
+    {
+        return false;
+    }
+    auto files = std::dynamic_pointer_cast<BDictionary>(responseDict->getValue("files"));
+    if (!files)
+    {
+        return false;
+    }
+    for (const auto &item : *files)
+    {
+        auto stats = std::dynamic_pointer_cast<BDictionary>(item.second);
+        if (item.first->value() != infoHash || !stats)
+        {
+            continue;
+        }
+        seeders = integerValue(stats, "complete", -1);
+        leechers = integerValue(stats, "incomplete", -1);
+        completed = integerValue(stats, "downloaded", -1);
+        return seeders >= 0 || leechers >= 0;
+    }
+    return false;
+}
+
+std::string PeerRetriever::scrapeUrl(const std::string &announceUrl)
+{
+    std::string udpHost;
+    int udpPort;
+    if (UdpTracker::parseUrl(announceUrl, udpHost, udpPort))
     {
-        // В случае ошибки в запросе возвращает пустой вектор.
-        return std::vector<Peer *>();
+        return announceUrl;
     }
+    size_t slash = announceUrl.rfind('/');
+    if (slash == std::string::npos || announceUrl.compare(slash + 1, 8, "announce") != 0)
+    {
+        return "";
+    }
+    return announceUrl.substr(0, slash + 1) + "scrape" + announceUrl.substr(slash + 9);
+}
+
+int PeerRetriever::getInterval() const
+{
+    return interval;
 }
 
-std::vector<Peer *> PeerRetriever::decodeResponse(std::string response)
+int PeerRetriever::getMinInterval() const
+{
+    return minInterval;
+}
+
+int PeerRetriever::getSeeders() const
+{
+    return seeders;
+}
+
+int PeerRetriever::getLeechers() const
+{
+    return leechers;
+}
+
+int PeerRetriever::getCompleted() const
+{
+    return completed;
+}
+
+std::vector<Peer> PeerRetriever::decodeResponse(const std::string &response)
 {
     // декодирует
     std::shared_ptr<BItem> decodedResponse = decode(response);
@@ -72,43 +267,36 @@ std::vector<Peer *> PeerRetriever::decodeResponse(std::string response)
     {
         throw std::runtime_error("Response returned by the tracker is not in the correct format. [Not a dictionary]");
     }
-    // Получает значение 'peers' из словаря.
+    // Получает значение 'peers' (IPv4) и 'peers6' (IPv6, BEP 7) из словаря.
     std::shared_ptr<BItem> peersValue = responseDict->getValue("peers");
-    if (!peersValue)
+    auto peers6Value = std::dynamic_pointer_cast<BString>(responseDict->getValue("peers6"));
+    if (!peersValue && !peers6Value)
     {
         throw std::runtime_error("Response returned by the tracker is not in the correct format. ['peers' not found]");
     }
+    // Темп анонсов, заданный трекером, и размер раздачи (если трекер их сообщил)
+    interval = integerValue(responseDict, "interval", DEFAULT_ANNOUNCE_INTERVAL);
+    if (interval <= 0)
+    {
+        interval = DEFAULT_ANNOUNCE_INTERVAL;
+    }
+    minInterval = std::max(integerValue(responseDict, "min interval", 0), 0);
+    seeders = integerValue(responseDict, "complete", seeders);
+    leechers = integerValue(responseDict, "incomplete", leechers);
     // Инициализирует вектор для хранения пиров.
-    std::vector<Peer *> peers;
+    std::vector<Peer> peers;
 
     // Обрабатывает случай, когда информация о пирах отправляется в компактном виде.
-    if (typeid(*peersValue) == typeid(BString))
+    // Трекер, знающий только о IPv6-пирах, может не прислать 'peers'.
+    if (!peersValue)
+    {
+        peers.reserve(peers6Value->length() / COMPACT_PEER6_LEN);
+    }
+    else if (typeid(*peersValue) == typeid(BString))
     {
         // Разбирает информацию о пирах.
-        const int peerInfoSize = 6;
         std::string peersString = std::dynamic_pointer_cast<BString>(peersValue)->value();
-
-        // Проверяет целостность данных.
-        if (peersString.length() % peerInfoSize != 0)
-        {
-            throw std::runtime_error(
-                "Received malformed 'peers' from tracker. ['peers' length needs to be divisible by 6]");
-        }
-        // Извлекает IP-адреса и порты каждого пира из компактного представления.
-        const int peerNum = peersString.length() / peerInfoSize;
-        for (int i = 0; i < peerNum; i++)
-        {
-            int offset = i * peerInfoSize;
-            std::stringstream peerIp;
-            peerIp << std::to_string((uint8_t)peersString[offset]) << ".";
-            peerIp << std::to_string((uint8_t)peersString[offset + 1]) << ".";
-            peerIp << std::to_string((uint8_t)peersString[offset + 2]) << ".";
-            peerIp << std::to_string((uint8_t)peersString[offset + 3]);
-            int peerPort = bytesToInt(peersString.substr(offset + 4, 2));
-            // Создает новый объект Peer и добавляет его в вектор пиров.
-            Peer *newPeer = new Peer{peerIp.str(), peerPort};
-            peers.push_back(newPeer);
-        }
+        peers = decodeCompactPeers(peersString);
     }
     // Обрабатывает случай, когда информация о пирах хранится в виде списка.
     else if (typeid(*peersValue) == typeid(BList))
@@ -132,9 +320,12 @@ std::vector<Peer *> PeerRetriever::decodeResponse(std::string response)
                 throw std::runtime_error("Received malformed 'peers' from tracker. [Item does not contain key 'port']");
             int peerPort = (int)std::dynamic_pointer_cast<BInteger>(tempPeerPort)->value();
 
-            // Создает новый объект Peer и добавляет его в вектор пиров.
-            Peer *newPeer = new Peer{peerIp, peerPort};
-            peers.push_back(newPeer);
+            // Пиры с именем хоста вместо IP-адреса пропускаются.
+            Peer newPeer(peerIp, peerPort);
+            if (newPeer.isValid())
+            {
+                peers.push_back(std::move(newPeer));
+            }
         }
     }
     else
@@ -142,5 +333,169 @@ std::vector<Peer *> PeerRetriever::decodeResponse(std::string response)
         throw std::runtime_error(
             "Response returned by the tracker is not in the correct format. ['peers' has the wrong type]");
     }
+    if (peers6Value)
+    {
+        std::vector<Peer> peers6 = decodeCompactPeers(peers6Value->value(), COMPACT_PEER6_LEN);
+        peers.insert(peers.end(), std::make_move_iterator(peers6.begin()), std::make_move_iterator(peers6.end()));
+    }
     return peers;
 }
+
+std::vector<Peer> decodeCompactPeers(std::string_view peersString, size_t entryLength)
+{
+    // Проверяет целостность данных.
+    if (peersString.length() % entryLength != 0)
+    {
+        throw std::runtime_error("Received malformed 'peers' from tracker. ['peers' length needs to be divisible by " +
+                                 std::to_string(entryLength) + "]");
+    }
+    std::vector<Peer> peers;
+    peers.reserve(peersString.length() / entryLength);
+    for (size_t offset = 0; offset < peersString.length(); offset += entryLength)
+    {
+        peers.emplace_back(peersString.substr(offset, entryLength));
+    }
+    return peers;
+}
+
+std::string encodeCompactPeer(const std::string &ip, int port)
+{
+    Peer peer(ip, port);
+    return peer.compact();
+}
+
+Peer::Peer(const std::string &ip, int port)
+{
+    auto *ipv4 = (struct sockaddr_in *)&address;
+    auto *ipv6 = (struct sockaddr_in6 *)&address;
+    if (inet_pton(AF_INET, ip.c_str(), &ipv4->sin_addr) > 0)
+    {
+        ipv4->sin_family = AF_INET;
+        ipv4->sin_port = htons(port);
+    }
+    else if (inet_pton(AF_INET6, ip.c_str(), &ipv6->sin6_addr) > 0)
+    {
+        ipv6->sin6_family = AF_INET6;
+        ipv6->sin6_port = htons(port);
+        normalize();
+    }
+}
+
+Peer::Peer(std::string_view compact)
+{
+    // Компактная запись уже в сетевом порядке байт, как и sockaddr_in/sockaddr_in6
+    if (compact.length() == COMPACT_PEER_LEN)
+    {
+        auto *ipv4 = (struct sockaddr_in *)&address;
+        ipv4->sin_family = AF_INET;
+        std::memcpy(&ipv4->sin_addr, compact.data(), 4);
+        std::memcpy(&ipv4->sin_port, compact.data() + 4, 2);
+    }
+    else if (compact.length() == COMPACT_PEER6_LEN)
+    {
+        auto *ipv6 = (struct sockaddr_in6 *)&address;
+        ipv6->sin6_family = AF_INET6;
+        std::memcpy(&ipv6->sin6_addr, compact.data(), 16);
+        std::memcpy(&ipv6->sin6_port, compact.data() + 16, 2);
+    }
+}
+
+void Peer::normalize()
+{
+    if (address.ss_family != AF_INET6)
+    {
+        return;
+    }
+    auto *ipv6 = (struct sockaddr_in6 *)&address;
+    if (!IN6_IS_ADDR_V4MAPPED(&ipv6->sin6_addr))
+    {
+        return;
+    }
+    struct sockaddr_in ipv4 {};
+    ipv4.sin_family = AF_INET;
+    ipv4.sin_port = ipv6->sin6_port;
+    std::memcpy(&ipv4.sin_addr, ipv6->sin6_addr.s6_addr + 12, 4);
+    std::memset(&address, 0, sizeof(address));
+    std::memcpy(&address, &ipv4, sizeof(ipv4));
+}
+
+bool Peer::isValid() const
+{
+    return address.ss_family != AF_UNSPEC;
+}
+
+std::string Peer::ip() const
+{
+    char buffer[INET6_ADDRSTRLEN] = "";
+    if (address.ss_family == AF_INET)
+    {
+        inet_ntop(AF_INET, &((const struct sockaddr_in *)&address)->sin_addr, buffer, sizeof(buffer));
+    }
+    else if (address.ss_family == AF_INET6)
+    {
+        inet_ntop(AF_INET6, &((const struct sockaddr_in6 *)&address)->sin6_addr, buffer, sizeof(buffer));
+    }
+    return buffer;
+}
+
+int Peer::port() const
+{
+    if (address.ss_family == AF_INET)
+    {
+        return ntohs(((const struct sockaddr_in *)&address)->sin_port);
+    }
+    if (address.ss_family == AF_INET6)
+    {
+        return ntohs(((const struct sockaddr_in6 *)&address)->sin6_port);
+    }
+    return 0;
+}
+
+socklen_t Peer::addressLength() const
+{
+    if (address.ss_family == AF_INET)
+    {
+        return sizeof(struct sockaddr_in);
+    }
+    return address.ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : 0;
+}
+
+std::string Peer::compact() const
+{
+    if (address.ss_family == AF_INET)
+    {
+        const auto *ipv4 = (const struct sockaddr_in *)&address;
+        std::string compact((const char *)&ipv4->sin_addr, 4);
+        compact.append((const char *)&ipv4->sin_port, 2);
+        return compact;
+    }
+    if (address.ss_family == AF_INET6)
+    {
+        const auto *ipv6 = (const struct sockaddr_in6 *)&address;
+        std::string compact((const char *)&ipv6->sin6_addr, 16);
+        compact.append((const char *)&ipv6->sin6_port, 2);
+        return compact;
+    }
+    return "";
+}
+
+bool Peer::sameEndpoint(const Peer &other) const
+{
+    if (address.ss_family != other.address.ss_family)
+    {
+        return false;
+    }
+    if (address.ss_family == AF_INET)
+    {
+        const auto *a = (const struct sockaddr_in *)&address;
+        const auto *b = (const struct sockaddr_in *)&other.address;
+        return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+    }
+    if (address.ss_family == AF_INET6)
+    {
+        const auto *a = (const struct sockaddr_in6 *)&address;
+        const auto *b = (const struct sockaddr_in6 *)&other.address;
+        return std::memcmp(&a->sin6_addr, &b->sin6_addr, 16) == 0 && a->sin6_port == b->sin6_port;
+    }
+    return false;
+}
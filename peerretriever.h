@@ -1,8 +1,8 @@
 #ifndef PEERRETRIEVER_H
 #define PEERRETRIEVER_H
 
-#include <cpr/cpr.h>
 #include <cstdint>
+#include <functional>
 #include <initializer_list>
 #include <ios>
 #include <istream>
@@ -12,21 +12,77 @@
 #include <regex>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <sys/socket.h>
 #include <vector>
 
+#define COMPACT_PEER_LEN 6   // Компактная запись IPv4-пира: адрес и порт
+#define COMPACT_PEER6_LEN 18 // Компактная запись IPv6-пира: адрес и порт
+#define DEFAULT_NUMWANT 50   // Количество пиров, запрашиваемое у трекера по умолчанию
+
+class HttpClient;
+
+// События announce в нумерации BEP 15 (HTTP-трекеру передается имя события)
+enum TrackerEvent
+{
+    eventNone = 0,
+    eventCompleted = 1,
+    eventStarted = 2,
+    eventStopped = 3
+};
+
+/*
+ Пир хранит адрес в двоичном виде, как он пришел от трекера, DHT или PEX,
+ и передает его в connect() без преобразования в строку и обратно.
+ Строковое представление (ip()) нужно только для журналов и сравнения подсетей.
+ */
 struct Peer
 {
-    std::string ip;               // IP-адрес пира
-    int port;                     // Порт пира
+    struct sockaddr_storage address {}; // Адрес и порт пира в сетевом порядке байт (AF_UNSPEC - заглушка)
+    int sock = -1;                // Сокет входящего соединения (-1 для пиров от трекера)
+    std::string handshake;        // Рукопожатие, уже полученное от входящего пира
+
+    Peer() = default;             // Пустой адрес: заглушка для завершения потоков
+    Peer(const std::string &ip, int port); // Адрес из текстового IPv4/IPv6 (пустой, если IP некорректен)
+    // Адрес из компактной записи: 6 байт для IPv4, 18 байт для IPv6
+    explicit Peer(std::string_view compact);
+    bool isValid() const;         // Задан ли адрес
+    std::string ip() const;       // Текстовый IP-адрес
+    int port() const;             // Порт
+    socklen_t addressLength() const;       // Размер адреса для connect()
+    std::string compact() const;  // Компактная запись (6 байт для IPv4, 18 для IPv6)
+    void normalize();             // IPv4-mapped IPv6 (::ffff:a.b.c.d) -> IPv4
+    bool sameEndpoint(const Peer &other) const; // Совпадают ли адрес и порт
 };
 
-class PeerRetriever {
+// Разбор компактного списка пиров: IPv4 и порт (6 байт, "peers") или IPv6 и порт (18 байт, "peers6", BEP 7).
+// Адреса копируются напрямую, единственное выделение памяти - сам вектор.
+std::vector<Peer> decodeCompactPeers(std::string_view peersString, size_t entryLength = COMPACT_PEER_LEN);
+
+// Компактное представление пира (6 байт для IPv4, 18 для IPv6); пустая строка, если IP некорректен
+std::string encodeCompactPeer(const std::string &ip, int port);
+
+/*
+ Запросы к одному трекеру. HTTP-трекеры опрашиваются через неблокирующий HttpClient, UDP-трекеры -
+ через неблокирующий UdpTracker на том же цикле событий; обработчик вызывается в потоке цикла.
+ Объект создается через std::make_shared и живет, пока не вызван обработчик.
+ */
+class PeerRetriever : public std::enable_shared_from_this<PeerRetriever> {
+    public:
+    using PeersCallback = std::function<void(std::vector<Peer> peers)>; // Получатель пиров
+    using ScrapeCallback = std::function<void(bool success)>;           // Получатель результата scrape
+
     private:
     std::string announceUrl;      // URL трекера
-    std::string infoHash;         // Хэш информации
+    std::string infoHash;         // Хэш информации (20 байт)
     std::string peerId;           // Идентификатор пира
     int port;                     // Порт для соединения с пирами
     const unsigned long fileSize; // Размер файла
+    int interval = 0;             // Интервал повторного анонса из ответа трекера (0 - трекер не ответил)
+    int minInterval = 0;          // Минимальный интервал внеочередного анонса (0 - не задан)
+    int seeders = -1;             // Количество раздающих по данным трекера (-1 - неизвестно)
+    int leechers = -1;            // Количество качающих (-1 - неизвестно)
+    int completed = -1;           // Количество завершенных загрузок (только scrape)
     /*
      декодирует строку ответа, отправленную трекером
      если строка может быть успешно декодирована, возвращает список указателей на структуры peer
@@ -36,7 +92,8 @@ class PeerRetriever {
      param response: ответ от трекера в виде строки.
      return вектор, содержащий информацию обо всех пирах.
      */
-    std::vector<Peer *> decodeResponse(std::string response);
+    std::vector<Peer> decodeResponse(const std::string &response);
+    bool decodeScrape(const std::string &response); // Разбор ответа scrape; false, если нашей раздачи в нем нет
 
     public:
     explicit PeerRetriever(std::string peerId,
@@ -44,7 +101,24 @@ class PeerRetriever {
                            std::string infoHash,
                            int port,
                            unsigned long fileSize);                       // Конструктор класса
-    std::vector<Peer *> retrievePeers(unsigned long bytesDownloaded = 0); // Метод для извлечения списка пиров
+    // Метод для извлечения списка пиров; numWant - сколько пиров запросить у трекера,
+    // event - событие анонса. При ошибке обработчик получает пустой список, а getInterval() возвращает 0
+    void retrievePeers(HttpClient &http,
+                       unsigned long bytesDownloaded,
+                       unsigned long bytesUploaded,
+                       int numWant,
+                       TrackerEvent event,
+                       PeersCallback done);
+    // Запрос статистики раздачи без анонса; false, если трекер ее не дал
+    void scrape(HttpClient &http, ScrapeCallback done);
+    int getInterval() const;      // Интервал повторного анонса (секунды)
+    int getMinInterval() const;   // Минимальный интервал анонса (секунды)
+    int getSeeders() const;       // Количество раздающих
+    int getLeechers() const;      // Количество качающих
+    int getCompleted() const;     // Количество завершенных загрузок
+    // URL для scrape по соглашению: последний компонент пути "announce" заменяется на "scrape";
+    // пустая строка, если трекер scrape не поддерживает
+    static std::string scrapeUrl(const std::string &announceUrl);
 };
 
 #endif                                                                    // PEERRETRIEVER_H
@@ -1,6 +1,7 @@
 #include "sha1.h"
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -26,13 +27,16 @@ Piece::~Piece()
     }
 }
 
-// Сбрасывает состояние всех блоков фрагмента на Missing
+// Сбрасывает состояние всех блоков фрагмента на Missing и начинает хэш заново
 void Piece::reset()
 {
+    std::lock_guard<std::mutex> guard(hashLock);
     for (Block *block : blocks)
     {
         block->status = Missing;
     }
+    hasher = SHA1();
+    hashedBlocks = 0;
 }
 
 // Возвращает следующий блок для загрузки (состояние блока меняется на Pending)
@@ -49,6 +53,19 @@ Block *Piece::nextRequest()
     return nullptr;
 }
 
+// Возвращает ожидающий блок в состояние Missing (запрос отклонен или отменен)
+void Piece::releaseBlock(int offset)
+{
+    for (Block *block : blocks)
+    {
+        if (block->offset == offset && block->status == Pending)
+        {
+            block->status = Missing;
+            return;
+        }
+    }
+}
+
 // Устанавливает состояние блока в Retrieved и сохраняет полученные данные
 void Piece::blockReceived(int offset, std::string data)
 {
@@ -56,8 +73,15 @@ void Piece::blockReceived(int offset, std::string data)
     {
         if (block->offset == offset)
         {
+            std::lock_guard<std::mutex> guard(hashLock);
+            if (block->status == Retrieved)
+            {
+                // Повторный ответ на тот же запрос: данные блока уже могли войти в хэш
+                return;
+            }
             block->status = Retrieved;
-            block->data = data;
+            block->data = std::move(data);
+            advanceHash();
             return;
         }
     }
@@ -71,11 +95,41 @@ bool Piece::isComplete()
     return std::all_of(blocks.begin(), blocks.end(), [](Block *block) { return block->status == Retrieved; });
 }
 
-// Проверяет соответствие хэш-значения данных фрагмента ожидаемому значению
+// Добавляет в hasher блоки, полученные подряд за уже учтенными (вызывается под hashLock)
+void Piece::advanceHash()
+{
+    while (hashedBlocks < blocks.size() && blocks[hashedBlocks]->status == Retrieved)
+    {
+        hasher.update(blocks[hashedBlocks]->data.data(), blocks[hashedBlocks]->data.size());
+        hashedBlocks++;
+    }
+}
+
+// Проверяет соответствие хэш-значения данных фрагмента ожидаемому значению: блоки к этому
+// моменту уже учтены в хэше, остается только его завершение
 bool Piece::isHashMatching()
 {
-    std::string pieceHash = hexDecode(sha1(getData()));
-    return pieceHash == hashValue;
+    std::lock_guard<std::mutex> guard(hashLock);
+    advanceHash();
+    if (hashedBlocks < blocks.size())
+    {
+        return false;
+    }
+    // Завершается копия: повторная проверка того же фрагмента дает тот же результат
+    SHA1 checksum = hasher;
+    return isDigestMatching(checksum.final());
+}
+
+// Проверяет хэш-значение данных фрагмента, уже записанных в память (отображенный файл)
+bool Piece::isHashMatching(const char *data, size_t length) const
+{
+    return isDigestMatching(sha1Digest(data, length));
+}
+
+// Сравнивает уже вычисленный двоичный хэш данных фрагмента с ожидаемым
+bool Piece::isDigestMatching(const Sha1Digest &digest) const
+{
+    return hashValue.size() == digest.size() && memcmp(digest.data(), hashValue.data(), digest.size()) == 0;
 }
 
 // Получает данные всех блоков фрагмента и объединяет их в одну строку
@@ -2,9 +2,12 @@
 #define PIECE_H
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "sha1.h"
+
 enum BlockStatus
 {
     Missing = 0,                 // Фрагмент отсутствует в настоящий момент
@@ -24,6 +27,12 @@ struct Block
 class Piece {
     private:
     const std::string hashValue; // Хэш-значение для проверки целостности фрагмента
+    SHA1 hasher;                 // Хэш блоков, полученных подряд с начала фрагмента
+    size_t hashedBlocks = 0;     // Количество блоков, учтенных в hasher
+    std::mutex hashLock;         // Мьютекс hasher: блоки фрагмента принимаются из разных потоков
+
+    // Добавляет в hasher блоки, полученные подряд за уже учтенными (вызывается под hashLock)
+    void advanceHash();
 
     public:
     const int index;             // Индекс фрагмента
@@ -34,16 +43,24 @@ class Piece {
 
     // Деструктор класса Piece
     ~Piece();
-    // Сбрасывает состояние всех блоков фрагмента на Missing
+    // Сбрасывает состояние всех блоков фрагмента на Missing и начинает хэш заново
     void reset();
     // Возвращает следующий блок для загрузки (состояние блока меняется на Pending)
     Block *nextRequest();
-    // Устанавливает состояние блока в Retrieved и сохраняет полученные данные
+    // Возвращает ожидающий блок в состояние Missing (запрос отклонен или отменен)
+    void releaseBlock(int offset);
+    // Устанавливает состояние блока в Retrieved и сохраняет полученные данные; если блок продолжает
+    // непрерывное начало фрагмента, хэш сразу продвигается по нему и по уже полученным следующим блокам
     void blockReceived(int offset, std::string data);
     // Проверяет, загружены ли все блоки фрагмента
     bool isComplete();
-    // Проверяет соответствие хэш-значения данных фрагмента ожидаемому значению
+    // Проверяет соответствие хэш-значения данных фрагмента ожидаемому значению: блоки к этому
+    // моменту уже учтены в хэше, остается только его завершение
     bool isHashMatching();
+    // Проверяет хэш-значение данных фрагмента, уже записанных в память (отображенный файл)
+    bool isHashMatching(const char *data, size_t length) const;
+    // Сравнивает уже вычисленный двоичный хэш данных фрагмента с ожидаемым
+    bool isDigestMatching(const Sha1Digest &digest) const;
     // Получает данные всех блоков фрагмента и объединяет их в одну строку
     std::string getData();
 };
@@ -0,0 +1,166 @@
+#include <algorithm>
+
+#include "piececache.h"
+
+PieceCache::PieceCache(size_t capacity) : capacity(capacity)
+{
+}
+
+PieceCache::Data PieceCache::get(int index, const Loader &load)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto found = entries.find(index);
+        if (found != entries.end() && found->second.data)
+        {
+            hits++;
+            move(found->second, frequentQueue);
+            return found->second.data;
+        }
+        misses++;
+    }
+
+    // Чтение с диска не держит блокировку: другие соединения тем временем обслуживаются из кэша
+    Data data = std::make_shared<const std::string>(load(index));
+    std::lock_guard<std::mutex> guard(lock);
+    if (capacity == 0)
+    {
+        return data;
+    }
+    auto found = entries.find(index);
+    if (found != entries.end() && found->second.data)
+    {
+        // Фрагмент успел загрузить другой поток
+        move(found->second, frequentQueue);
+        return found->second.data;
+    }
+    if (found != entries.end())
+    {
+        // Попадание в призрачный список: фрагмент вытеснен зря, соответствующий список увеличивается
+        Entry &entry = found->second;
+        size_t recentGhosts = queues[recentGhost].size();
+        size_t frequentGhosts = queues[frequentGhost].size();
+        if (entry.queue == recentGhost)
+        {
+            target = std::min(capacity, target + std::max<size_t>(frequentGhosts / recentGhosts, 1));
+            replace(false);
+        }
+        else
+        {
+            target -= std::min(target, std::max<size_t>(recentGhosts / frequentGhosts, 1));
+            replace(true);
+        }
+        entry.data = data;
+        move(entry, frequentQueue);
+        return data;
+    }
+
+    // Полный промах
+    size_t recent = queues[recentQueue].size() + queues[recentGhost].size();
+    size_t total = recent + queues[frequentQueue].size() + queues[frequentGhost].size();
+    if (recent >= capacity)
+    {
+        if (queues[recentQueue].size() < capacity)
+        {
+            dropLast(recentGhost);
+            replace(false);
+        }
+        else
+        {
+            // T1 занимает весь кэш: самый старый незакрепленный фрагмент удаляется без следа
+            int victim = lastUnpinned(recentQueue);
+            if (victim >= 0)
+            {
+                queues[recentQueue].erase(entries[victim].position);
+                entries.erase(victim);
+            }
+        }
+    }
+    else if (total >= capacity)
+    {
+        if (total >= 2 * capacity)
+        {
+            dropLast(frequentGhost);
+        }
+        replace(false);
+    }
+    Entry &entry = entries[index];
+    entry.queue = recentQueue;
+    queues[recentQueue].push_front(index);
+    entry.position = queues[recentQueue].begin();
+    entry.data = data;
+    return data;
+}
+
+void PieceCache::move(Entry &entry, Queue queue)
+{
+    queues[queue].splice(queues[queue].begin(), queues[entry.queue], entry.position);
+    entry.queue = queue;
+    entry.position = queues[queue].begin();
+}
+
+void PieceCache::replace(bool inFrequentGhost)
+{
+    // Освобождается место под один фрагмент (и под ранее закрепленные, если они уже отправлены)
+    while (queues[recentQueue].size() + queues[frequentQueue].size() >= capacity)
+    {
+        size_t recent = queues[recentQueue].size();
+        Queue first = recent > 0 && (recent > target || (inFrequentGhost && recent == target)) ? recentQueue
+                                                                                               : frequentQueue;
+        Queue second = first == recentQueue ? frequentQueue : recentQueue;
+        Queue queue = first;
+        int victim = lastUnpinned(first);
+        if (victim < 0)
+        {
+            queue = second;
+            victim = lastUnpinned(second);
+        }
+        if (victim < 0)
+        {
+            return;
+        }
+        Entry &entry = entries[victim];
+        entry.data.reset();
+        move(entry, queue == recentQueue ? recentGhost : frequentGhost);
+    }
+}
+
+void PieceCache::dropLast(Queue queue)
+{
+    if (!queues[queue].empty())
+    {
+        entries.erase(queues[queue].back());
+        queues[queue].pop_back();
+    }
+}
+
+int PieceCache::lastUnpinned(Queue queue) const
+{
+    for (auto iter = queues[queue].rbegin(); iter != queues[queue].rend(); ++iter)
+    {
+        // Ссылка на данные вне кэша означает, что фрагмент еще отправляется
+        if (entries.at(*iter).data.use_count() == 1)
+        {
+            return *iter;
+        }
+    }
+    return -1;
+}
+
+unsigned long PieceCache::getHits()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return hits;
+}
+
+unsigned long PieceCache::getMisses()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return misses;
+}
+
+size_t PieceCache::getSize()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return queues[recentQueue].size() + queues[frequentQueue].size();
+}
@@ -0,0 +1,68 @@
+#ifndef PIECECACHE_H
+#define PIECECACHE_H
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#define DEFAULT_READ_CACHE_SIZE (64 << 20) // Размер кэша отдаваемых фрагментов по умолчанию (64 МБ)
+
+/*
+ Кэш проверенных фрагментов в памяти для отдачи пирам с вытеснением ARC (Adaptive Replacement Cache).
+ Фрагменты, запрошенные один раз, и фрагменты, запрошенные повторно, хранятся в отдельных
+ списках (T1 и T2), а ключи недавно вытесненных - в "призрачных" списках (B1 и B2). Попадание
+ в призрачный список сдвигает границу между T1 и T2, поэтому однократный проход по всей раздаче
+ не вытесняет популярные фрагменты. Кэш общий для всех соединений торрента.
+
+ Данные фрагмента передаются получателю по shared_ptr: пока фрагмент отправляется (ссылка
+ удерживается), он закреплен и не вытесняется. Если закреплено все, размер временно превышается.
+ */
+class PieceCache {
+    public:
+    using Data = std::shared_ptr<const std::string>;
+    // Чтение фрагмента index с диска при промахе
+    using Loader = std::function<std::string(int index)>;
+
+    private:
+    // Список, в котором находится фрагмент
+    enum Queue
+    {
+        recentQueue,                   // T1: запрошен один раз
+        frequentQueue,                 // T2: запрошен повторно
+        recentGhost,                   // B1: вытеснен из T1, данных нет
+        frequentGhost                  // B2: вытеснен из T2, данных нет
+    };
+
+    struct Entry
+    {
+        Queue queue;                   // Текущий список
+        std::list<int>::iterator position; // Место в списке
+        Data data;                     // Данные (nullptr в призрачных списках)
+    };
+
+    const size_t capacity;             // Емкость в фрагментах (c)
+    size_t target = 0;                 // Желаемый размер T1 (p)
+    std::list<int> queues[4];          // Списки по Queue, недавние - в начале
+    std::unordered_map<int, Entry> entries; // Фрагменты кэша и призрачных списков
+    unsigned long hits = 0;            // Попадания
+    unsigned long misses = 0;          // Промахи
+    std::mutex lock;                   // Мьютекс для предотвращения гонок
+
+    void move(Entry &entry, Queue queue); // Перенос в начало списка queue
+    void replace(bool inFrequentGhost); // Вытеснение из T1 или T2 в соответствующий призрачный список
+    void dropLast(Queue queue);         // Удаление последнего элемента призрачного списка
+    int lastUnpinned(Queue queue) const; // Самый старый незакрепленный фрагмент списка; -1, если нет
+
+    public:
+    explicit PieceCache(size_t capacity); // Конструктор класса, емкость в фрагментах
+    // Данные фрагмента из кэша или от load (загружаются вне блокировки)
+    Data get(int index, const Loader &load);
+    unsigned long getHits();            // Количество попаданий
+    unsigned long getMisses();          // Количество промахов
+    size_t getSize();                   // Количество фрагментов с данными
+};
+
+#endif                                  // PIECECACHE_H
@@ -1,11 +1,18 @@
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <ctime>
 #include <iomanip>
+#include <arpa/inet.h>
+#include <fcntl.h>
 #include <iostream>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "piece.h"
+#include "connect.h"
+#include "hashqueue.h"
+#include "sha1multi.h"
 #include "piecemanager.h"
 #include "utils.h"
 
@@ -13,22 +20,67 @@
 #define MAX_PENDING_TIME 5          // Максимальное время ожидания блока (5 секунд)
 #define PROGRESS_BAR_WIDTH 40       // Ширина полосы прогресса
 #define PROGRESS_DISPLAY_INTERVAL 1 // Интервал отображения прогресса (0.5 секунд)
+#define MAX_REQUEST_LENGTH 131072   // Максимальная длина запрашиваемого пиром блока (2 ^ 17)
+#define RECHECK_MEMORY 268435456    // Память под фрагменты, ожидающие проверки при перепроверке (256 МБ)
+
+PieceManager::PieceManager(const TorrentFile &fileParser,
+                           const std::string &downloadDirectory,
+                           const int maximumConnections,
+                           StorageMode storageMode,
+                           AllocationMode allocationMode)
+    : PieceManager(fileParser,
+                   createStorage(fileParser, downloadDirectory, storageMode, allocationMode),
+                   maximumConnections)
+{
+    if (storageMode == storageMmap)
+    {
+        // Отображение одного файла; многофайловый торрент (или ошибка отображения) пишется через storage
+        auto disk = dynamic_cast<FileStorage *>(storage.get());
+        if (disk->getFileCount() != 1 || !mapFile(disk->getFilePath(0), allocationMode))
+        {
+            std::cerr << "Отображение в память недоступно, запись через файловое хранилище" << std::endl;
+        }
+    }
+}
 
-PieceManager::PieceManager(const TorrentFile &fileParser, const std::string &downloadPath, const int maximumConnections)
-    : fileParser(fileParser), maximumConnections(maximumConnections), pieceLength(fileParser.getPieceLength())
+PieceManager::PieceManager(const TorrentFile &fileParser, std::unique_ptr<Storage> storage, int maximumConnections)
+    : storage(std::move(storage)), pieceLength(fileParser.getPieceLength()), fileParser(fileParser),
+      maximumConnections(maximumConnections)
 {
+    this->storage->open();
+    this->storage->preallocate();
     missingPieces = initiatePieces();
-    downloadedFile.open(downloadPath, std::ios::binary | std::ios::out);
-    downloadedFile.seekp(fileParser.getFileSize() - 1);
-    downloadedFile.write("", 1);
+    ownBitField.assign((totalPieces + 7) / 8, 0);
 
     startingTime = std::time(nullptr);
-    std::thread progressThread([this] { this->trackProgress(); });
-    progressThread.detach();
+    progressThread = std::thread([this] { this->trackProgress(); });
+}
+
+std::unique_ptr<Storage> PieceManager::createStorage(const TorrentFile &fileParser,
+                                                     const std::string &downloadDirectory,
+                                                     StorageMode storageMode,
+                                                     AllocationMode allocationMode)
+{
+    switch (storageMode)
+    {
+    case storageMemory:
+        return std::unique_ptr<Storage>(new MemoryStorage(fileParser.getFileSize()));
+    case storageNull:
+        return std::unique_ptr<Storage>(new NullStorage());
+    default:
+        return std::unique_ptr<Storage>(new FileStorage(fileParser.getFiles(), downloadDirectory, allocationMode));
+    }
 }
 
 PieceManager::~PieceManager()
 {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    progressWakeup.notify_all();
+    progressThread.join();
+
     for (Piece *piece : missingPieces)
     {
         delete piece;
@@ -44,7 +96,42 @@ PieceManager::~PieceManager()
         delete pending;
     }
 
-    downloadedFile.close();
+    storage->flush();
+    if (mapping)
+    {
+        // Перед закрытием все измененные страницы сбрасываются на диск
+        msync(mapping, mappingLength, MS_SYNC);
+        munmap(mapping, mappingLength);
+    }
+}
+
+bool PieceManager::mapFile(const std::string &downloadPath, AllocationMode allocationMode)
+{
+    int fd = open(downloadPath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    mappingLength = fileParser.getFileSize();
+    void *address = MAP_FAILED;
+    // Отображение требует файла полного размера, поэтому allocateNone здесь означает разреженный файл
+    if (mappingLength > 0 &&
+        FileStorage::allocate(fd, mappingLength, allocationMode == allocateNone ? allocateSparse : allocationMode))
+    {
+        address = mmap(nullptr, mappingLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    // Отображение держит файл открытым само
+    close(fd);
+    if (address == MAP_FAILED)
+    {
+        std::cerr << "Не удалось отобразить " << downloadPath << " в память" << std::endl;
+        mappingLength = 0;
+        return false;
+    }
+    mapping = (char *)address;
+    // Пиры запрашивают блоки вразнобой, упреждающее чтение соседних страниц бесполезно
+    madvise(mapping, mappingLength, MADV_RANDOM);
+    return true;
 }
 
 std::vector<Piece *> PieceManager::initiatePieces()
@@ -54,7 +141,7 @@ std::vector<Piece *> PieceManager::initiatePieces()
     std::vector<Piece *> torrentPieces;
     missingPieces.reserve(totalPieces);
 
-    long totalLength = fileParser.getFileSize();
+    totalLength = fileParser.getFileSize();
 
     int blockCount = ceil(pieceLength / BLOCK_SIZE);
     long remLength = pieceLength;
@@ -63,8 +150,9 @@ std::vector<Piece *> PieceManager::initiatePieces()
     {
         if (i == totalPieces - 1)
         {
-            remLength = totalLength % pieceLength;
-            blockCount = std::max((int)ceil(remLength / BLOCK_SIZE), 1);
+            // Суммарный размер многофайлового торрента часто кратен размеру фрагмента
+            remLength = totalLength - (long)i * pieceLength;
+            blockCount = (remLength + BLOCK_SIZE - 1) / BLOCK_SIZE;
         }
         std::vector<Block *> blocks;
         blocks.reserve(blockCount);
@@ -78,7 +166,7 @@ std::vector<Piece *> PieceManager::initiatePieces()
             int blockSize = BLOCK_SIZE;
             if (i == totalPieces - 1 && offset == blockCount - 1)
             {
-                blockSize = remLength % BLOCK_SIZE;
+                blockSize = remLength - (long)offset * BLOCK_SIZE;
             }
             block->length = blockSize;
             blocks.push_back(block);
@@ -92,11 +180,109 @@ std::vector<Piece *> PieceManager::initiatePieces()
 bool PieceManager::isComplete()
 {
     lock.lock();
-    bool isComplete = havePieces.size() == totalPieces;
+    bool isComplete = havePieces.size() == (size_t)totalPieces;
     lock.unlock();
     return isComplete;
 }
 
+void PieceManager::setCompletionHandler(std::function<void()> handler)
+{
+    lock.lock();
+    completionHandler = std::move(handler);
+    lock.unlock();
+}
+
+void PieceManager::setDirectWrites(bool enabled)
+{
+    // Каждый поток загрузки пишет не больше одного фрагмента одновременно
+    auto disk = dynamic_cast<FileStorage *>(storage.get());
+    if (enabled && disk && !mapping)
+    {
+        disk->enableDirectWrites(pieceLength, maximumConnections);
+    }
+}
+
+void PieceManager::setReadCacheSize(size_t bytes)
+{
+    // Отображенный файл и так отдается из памяти, а хранилище в памяти не нуждается в кэше
+    size_t capacity = bytes / pieceLength;
+    bool useful = !mapping && storage->isReadable() && !dynamic_cast<MemoryStorage *>(storage.get());
+    readCache.reset(capacity > 0 && useful ? new PieceCache(capacity) : nullptr);
+}
+
+unsigned long PieceManager::getCacheHits()
+{
+    return readCache ? readCache->getHits() : 0;
+}
+
+unsigned long PieceManager::getCacheMisses()
+{
+    return readCache ? readCache->getMisses() : 0;
+}
+
+int PieceManager::recheck()
+{
+    // Свежесозданные файлы (в том числе отображенный в память) перепроверять незачем
+    if (!storage->hasData() || (!mapping && !storage->isReadable()))
+    {
+        return 0;
+    }
+    lock.lock();
+    std::vector<Piece *> candidates = missingPieces;
+    lock.unlock();
+
+    // Фрагменты читаются последовательно, а хешируются пачками в нескольких потоках;
+    // число потоков ограничено памятью под прочитанные, но еще не проверенные фрагменты
+    int lanes = sha1MultiBufferLanes();
+    long threads = std::min<long>(std::max(1u, std::thread::hardware_concurrency()),
+                                  RECHECK_MEMORY / (2L * lanes * pieceLength));
+    std::atomic<int> verified{0};
+    bool completed = false;
+    {
+        HashQueue queue(std::max<long>(threads, 1));
+        for (Piece *piece : candidates)
+        {
+            std::string data(getPieceSize(piece->index), '\0');
+            long offset = (long)piece->index * pieceLength;
+            if (mapping)
+            {
+                std::copy(mapping + offset, mapping + offset + data.size(), &data[0]);
+            }
+            else
+            {
+                try
+                {
+                    storage->readBlock(offset, &data[0], data.size());
+                }
+                catch (const std::runtime_error &)
+                {
+                    // Файл короче ожидаемого: фрагмент еще не загружен
+                    continue;
+                }
+            }
+            queue.submit(std::move(data), [this, piece, &verified, &completed](const Sha1Digest &digest) {
+                if (!piece->isDigestMatching(digest))
+                {
+                    return;
+                }
+                lock.lock();
+                missingPieces.erase(std::remove(missingPieces.begin(), missingPieces.end(), piece),
+                                    missingPieces.end());
+                pieceVerified(piece);
+                completed = havePieces.size() == (size_t)totalPieces;
+                lock.unlock();
+                verified++;
+            });
+        }
+        queue.wait();
+    }
+    if (completed && completionHandler)
+    {
+        completionHandler();
+    }
+    return verified;
+}
+
 void PieceManager::addPeer(const std::string &peerId, std::string bitField)
 {
     lock.lock();
@@ -137,10 +323,10 @@ void PieceManager::removePeer(const std::string &peerId)
     }
 }
 
-Block *PieceManager::nextRequest(std::string peerId)
+Block *PieceManager::nextRequest(std::string peerId, const std::set<int> &preferredPieces, bool preferredOnly)
 {
     lock.lock();
-    if (missingPieces.empty())
+    if (missingPieces.empty() && ongoingPieces.empty())
     {
         lock.unlock();
         return nullptr;
@@ -152,18 +338,98 @@ Block *PieceManager::nextRequest(std::string peerId)
         return nullptr;
     }
 
-    Block *block = expiredRequest(peerId);
-    if (!block)
+    Block *block = nextPreferred(peerId, preferredPieces);
+    if (!block && !preferredOnly)
     {
-        block = nextOngoing(peerId);
+        block = expiredRequest(peerId);
+        if (!block)
+        {
+            block = nextOngoing(peerId);
+        }
         if (!block)
-            block = getRarestPiece(peerId)->nextRequest();
+        {
+            Piece *rarest = getRarestPiece(peerId);
+            if (rarest)
+            {
+                block = rarest->nextRequest();
+            }
+        }
     }
     lock.unlock();
 
     return block;
 }
 
+Block *PieceManager::nextPreferred(const std::string &peerId, const std::set<int> &preferredPieces)
+{
+    for (int index : preferredPieces)
+    {
+        if (index < 0 || index >= totalPieces || !hasPiece(peers[peerId], index))
+        {
+            continue;
+        }
+        Piece *target = nullptr;
+        for (Piece *piece : ongoingPieces)
+        {
+            if (piece->index == index)
+            {
+                target = piece;
+                break;
+            }
+        }
+        if (!target)
+        {
+            auto iter = std::find_if(missingPieces.begin(), missingPieces.end(),
+                                     [index](const Piece *piece) { return piece->index == index; });
+            if (iter == missingPieces.end())
+            {
+                continue;
+            }
+            target = *iter;
+            missingPieces.erase(iter);
+            ongoingPieces.push_back(target);
+        }
+        Block *block = target->nextRequest();
+        if (block)
+        {
+            addPendingRequest(block);
+            return block;
+        }
+    }
+    return nullptr;
+}
+
+void PieceManager::addPendingRequest(Block *block)
+{
+    auto newPendingRequest = new PendingRequest;
+    newPendingRequest->block = block;
+    newPendingRequest->timestamp = std::time(nullptr);
+    pendingRequests.push_back(newPendingRequest);
+}
+
+void PieceManager::requestRejected(int pieceIndex, int blockOffset)
+{
+    lock.lock();
+    for (auto iter = pendingRequests.begin(); iter != pendingRequests.end(); ++iter)
+    {
+        if ((*iter)->block->piece == pieceIndex && (*iter)->block->offset == blockOffset)
+        {
+            delete *iter;
+            pendingRequests.erase(iter);
+            break;
+        }
+    }
+    for (Piece *piece : ongoingPieces)
+    {
+        if (piece->index == pieceIndex)
+        {
+            piece->releaseBlock(blockOffset);
+            break;
+        }
+    }
+    lock.unlock();
+}
+
 Block *PieceManager::expiredRequest(std::string peerId)
 {
     time_t currentTime = std::time(nullptr);
@@ -191,11 +457,7 @@ Block *PieceManager::nextOngoing(std::string peerId)
             Block *block = piece->nextRequest();
             if (block)
             {
-                auto currentTime = std::time(nullptr);
-                auto newPendingRequest = new PendingRequest;
-                newPendingRequest->block = block;
-                newPendingRequest->timestamp = std::time(nullptr);
-                pendingRequests.push_back(newPendingRequest);
+                addPendingRequest(block);
                 return block;
             }
         }
@@ -216,7 +478,7 @@ Piece *PieceManager::getRarestPiece(std::string peerId)
         }
     }
 
-    Piece *rarest;
+    Piece *rarest = nullptr;
     int leastCount = INT16_MAX;
     for (auto const &[piece, count] : pieceCount)
     {
@@ -227,6 +489,10 @@ Piece *PieceManager::getRarestPiece(std::string peerId)
         }
     }
 
+    if (!rarest)
+    {
+        return nullptr;
+    }
     missingPieces.erase(std::remove(missingPieces.begin(), missingPieces.end(), rarest), missingPieces.end());
     ongoingPieces.push_back(rarest);
     return rarest;
@@ -234,6 +500,11 @@ Piece *PieceManager::getRarestPiece(std::string peerId)
 
 void PieceManager::blockReceived(std::string peerId, int pieceIndex, int blockOffset, std::string data)
 {
+    if (mapping)
+    {
+        mappedBlockReceived(pieceIndex, blockOffset, data);
+        return;
+    }
     PendingRequest *requestToRemove = nullptr;
     lock.lock();
     for (PendingRequest *pending : pendingRequests)
@@ -270,9 +541,13 @@ void PieceManager::blockReceived(std::string peerId, int pieceIndex, int blockOf
             lock.lock();
             ongoingPieces.erase(std::remove(ongoingPieces.begin(), ongoingPieces.end(), targetPiece),
                                 ongoingPieces.end());
-            havePieces.push_back(targetPiece);
-            piecesDownloadedInInterval++;
+            pieceVerified(targetPiece);
+            bool completed = havePieces.size() == (size_t)totalPieces;
             lock.unlock();
+            if (completed && completionHandler)
+            {
+                completionHandler();
+            }
         }
         else
         {
@@ -281,11 +556,97 @@ void PieceManager::blockReceived(std::string peerId, int pieceIndex, int blockOf
     }
 }
 
+void PieceManager::mappedBlockReceived(int pieceIndex, int blockOffset, const std::string &data)
+{
+    long pieceStart = (long)pieceIndex * pieceLength;
+    Piece *targetPiece = nullptr;
+    bool pieceComplete = false;
+    lock.lock();
+    for (auto iter = pendingRequests.begin(); iter != pendingRequests.end(); ++iter)
+    {
+        if ((*iter)->block->piece == pieceIndex && (*iter)->block->offset == blockOffset)
+        {
+            delete *iter;
+            pendingRequests.erase(iter);
+            break;
+        }
+    }
+    for (Piece *piece : ongoingPieces)
+    {
+        if (piece->index == pieceIndex)
+        {
+            targetPiece = piece;
+            break;
+        }
+    }
+    // Копирование под lock: проверяемый фрагмент уже убран из ongoingPieces, и запоздавший
+    // дубликат блока не может изменить его данные во время или после проверки хэша
+    if (targetPiece && blockOffset >= 0 && blockOffset + (long)data.size() <= getPieceSize(pieceIndex))
+    {
+        std::copy(data.begin(), data.end(), mapping + pieceStart + blockOffset);
+        targetPiece->blockReceived(blockOffset, std::string()); // Данные уже в отображении
+        pieceComplete = targetPiece->isComplete();
+        if (pieceComplete)
+        {
+            ongoingPieces.erase(std::remove(ongoingPieces.begin(), ongoingPieces.end(), targetPiece),
+                                ongoingPieces.end());
+        }
+    }
+    lock.unlock();
+    if (!targetPiece)
+        throw std::runtime_error("Отстуствие куска");
+    if (!pieceComplete)
+    {
+        return;
+    }
+
+    long pieceSize = getPieceSize(pieceIndex);
+    bool matching = targetPiece->isHashMatching(mapping + pieceStart, pieceSize);
+    if (matching)
+    {
+        // Запись на диск запускается сразу, чтобы грязные страницы не копились до munmap
+        long pageSize = sysconf(_SC_PAGESIZE);
+        long syncStart = pieceStart / pageSize * pageSize;
+        msync(mapping + syncStart, pieceStart + pieceSize - syncStart, MS_ASYNC);
+    }
+    lock.lock();
+    bool completed = false;
+    if (matching)
+    {
+        pieceVerified(targetPiece);
+        completed = havePieces.size() == (size_t)totalPieces;
+    }
+    else
+    {
+        targetPiece->reset();
+        ongoingPieces.push_back(targetPiece);
+    }
+    lock.unlock();
+    if (completed && completionHandler)
+    {
+        completionHandler();
+    }
+}
+
+void PieceManager::pieceVerified(Piece *piece)
+{
+    havePieces.push_back(piece);
+    setPiece(ownBitField, piece->index);
+    completedOrder.push_back(piece->index);
+    piecesDownloadedInInterval++;
+}
+
 void PieceManager::write(Piece *piece)
 {
-    long position = piece->index * fileParser.getPieceLength();
-    downloadedFile.seekp(position);
-    downloadedFile << piece->getData();
+    long position = (long)piece->index * pieceLength;
+    // Блоки пишутся одним векторным вызовом на каждый файл, без склейки фрагмента в одну строку
+    std::vector<struct iovec> buffers;
+    buffers.reserve(piece->blocks.size());
+    for (Block *block : piece->blocks)
+    {
+        buffers.push_back({(void *)block->data.data(), block->data.size()});
+    }
+    storage->writePiece(position, buffers.data(), (int)buffers.size());
 }
 
 unsigned long PieceManager::bytesDownloaded()
@@ -296,14 +657,109 @@ unsigned long PieceManager::bytesDownloaded()
     return bytesDownloaded;
 }
 
+unsigned long PieceManager::bytesUploaded()
+{
+    return uploaded;
+}
+
+bool PieceManager::havePiece(int index)
+{
+    if (index < 0 || index >= totalPieces)
+    {
+        return false;
+    }
+    lock.lock();
+    bool result = hasPiece(ownBitField, index);
+    lock.unlock();
+    return result;
+}
+
+std::string PieceManager::getBitField()
+{
+    lock.lock();
+    std::string result = ownBitField;
+    lock.unlock();
+    return result;
+}
+
+std::vector<int> PieceManager::getCompletedSince(size_t &cursor)
+{
+    lock.lock();
+    std::vector<int> result(completedOrder.begin() + std::min(cursor, completedOrder.size()), completedOrder.end());
+    cursor = completedOrder.size();
+    lock.unlock();
+    return result;
+}
+
+int PieceManager::getPieceCount() const
+{
+    return totalPieces;
+}
+
+long PieceManager::getPieceSize(int index) const
+{
+    if (index == totalPieces - 1)
+    {
+        return totalLength - (long)index * pieceLength;
+    }
+    return pieceLength;
+}
+
+bool PieceManager::sendBlock(int sock, int index, int begin, int length, RateLimiter *limiter)
+{
+    if (!havePiece(index) || (!mapping && !storage->isReadable()))
+    {
+        return false;
+    }
+    if (begin < 0 || length <= 0 || length > MAX_REQUEST_LENGTH || begin + (long)length > getPieceSize(index))
+    {
+        return false;
+    }
+    // Заголовок сообщения piece: длина, идентификатор, индекс и смещение; сами данные идут следом из файла
+    uint32_t header[3] = {htonl(9 + length), htonl(index), htonl(begin)};
+    std::string message((char *)header, sizeof(header));
+    message.insert(4, 1, (char)7);
+    sendData(sock, message, limiter);
+    long offset = (long)index * pieceLength + begin;
+    if (mapping)
+    {
+        // Страницы отдаваемого блока подгружаются заранее, остальное отдает page cache
+        long pageSize = sysconf(_SC_PAGESIZE);
+        long adviseStart = offset / pageSize * pageSize;
+        madvise(mapping + adviseStart, offset + length - adviseStart, MADV_WILLNEED);
+        sendMemoryData(sock, mapping + offset, length, limiter);
+    }
+    else if (readCache)
+    {
+        // Фрагмент читается с диска один раз и отдается из памяти всем соединениям; пока данные
+        // отправляются, ссылка на них закрепляет фрагмент в кэше
+        PieceCache::Data piece = readCache->get(index, [this](int pieceIndex) {
+            std::string data(getPieceSize(pieceIndex), '\0');
+            storage->readBlock((long)pieceIndex * pieceLength, &data[0], data.size());
+            return data;
+        });
+        sendMemoryData(sock, piece->data() + begin, length, limiter);
+    }
+    else
+    {
+        storage->send(sock, offset, length, limiter);
+    }
+    uploaded += length;
+    return true;
+}
+
 void PieceManager::trackProgress()
 {
-    usleep(pow(10, 6));
-    while (!isComplete())
+    // Ожидание прерывается при уничтожении объекта, иначе поток обратился бы к освобожденной памяти
+    std::unique_lock<std::mutex> guard(lock);
+    progressWakeup.wait_for(guard, std::chrono::seconds(1), [this] { return stopping; });
+    while (!stopping && havePieces.size() != (size_t)totalPieces)
     {
+        guard.unlock();
         displayProgressBar();
         piecesDownloadedInInterval = 0;
-        usleep(PROGRESS_DISPLAY_INTERVAL * pow(10, 6));
+        guard.lock();
+        progressWakeup.wait_for(guard, std::chrono::seconds(PROGRESS_DISPLAY_INTERVAL), [this] { return stopping; });
     }
 }
 
@@ -1,16 +1,33 @@
 #ifndef PIECEMANAGER_H
 #define PIECEMANAGER_H
 
+#include <atomic>
+#include <condition_variable>
 #include <ctime>
-#include <fstream>
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <thread>
 #include <vector>
 
+#include "filestorage.h"
 #include "piece.h"
+#include "piececache.h"
+#include "ratelimiter.h"
 #include "torrentfile.h"
 
+// Способ хранения загружаемого файла
+enum StorageMode
+{
+    storageStream,            // Запись фрагментов через FileStorage (pwritev), отдача через sendfile
+    storageMmap,              // Файл отображен в память: блоки, проверка хэша и отдача работают с отображением
+                              // (только однофайловый торрент, многофайловый пишется через FileStorage)
+    storageMemory,            // Данные хранятся в памяти (MemoryStorage)
+    storageNull               // Проверенные фрагменты отбрасываются (NullStorage), отдачи нет
+};
+
 struct PendingRequest
 {
     Block *block; // Указатель на блок данных, ожидающий загрузки
@@ -27,34 +44,82 @@ class PieceManager {
     std::vector<Piece *> ongoingPieces; // Фрагменты, которые находятся в процессе загрузки
     std::vector<Piece *> havePieces;               // Загруженные фрагменты
     std::vector<PendingRequest *> pendingRequests; // Ожидающие запросы на загрузку блоков
-    std::ofstream downloadedFile; // Файл, в который происходит запись загруженных данных
+    std::unique_ptr<Storage> storage; // Хранилище, в которое записываются загруженные данные
+    std::unique_ptr<PieceCache> readCache; // Кэш отдаваемых фрагментов (nullptr - отдача через sendfile)
+    char *mapping = nullptr;      // Отображение файла в память (storageMmap), nullptr - запись через поток
+    size_t mappingLength = 0;     // Размер отображения
+    std::string ownBitField;      // Битовое поле проверенных фрагментов (наше для пиров)
+    std::vector<int> completedOrder; // Индексы проверенных фрагментов в порядке завершения
+    std::atomic<unsigned long> uploaded{0}; // Количество отданных пирам байт
+    std::function<void()> completionHandler; // Вызывается после проверки последнего фрагмента
     const long pieceLength;              // Размер фрагмента
     const TorrentFile &fileParser;       // Парсер торрент-файла
     const int maximumConnections;        // Максимальное количество соединений
     int piecesDownloadedInInterval = 0; // Количество загруженных фрагментов за интервал времени
     time_t startingTime;                       // Время начала загрузки
     int totalPieces{};                         // Общее количество фрагментов
+    long totalLength = 0;                      // Общий размер данных торрента
 
     std::mutex lock;                           // Мьютекс для предотвращения гонок
+    std::thread progressThread;                // Поток отображения прогресса
+    bool stopping = false;                     // Объект уничтожается: поток прогресса завершается
+    std::condition_variable progressWakeup;    // Пробуждение потока прогресса при уничтожении
 
     std::vector<Piece *> initiatePieces();     // Инициализация фрагментов и блоков
     Block *expiredRequest(std::string peerId); // Поиск просроченных запросов
     Block *nextOngoing(std::string peerId);    // Поиск следующего блока для загрузки
     Piece *getRarestPiece(std::string peerId); // Получение редкого фрагмента для загрузки
+    Block *nextPreferred(const std::string &peerId, const std::set<int> &preferredPieces); // Блок из набора
+    void addPendingRequest(Block *block);      // Регистрация запроса для отслеживания таймаута
     void write(Piece *piece);                  // Запись данных фрагмента в файл
+    // Создание файла нужного размера и его отображение
+    bool mapFile(const std::string &downloadPath, AllocationMode allocationMode);
+    // Хранилище для способа хранения storageMode
+    static std::unique_ptr<Storage> createStorage(const TorrentFile &fileParser,
+                                                  const std::string &downloadDirectory,
+                                                  StorageMode storageMode,
+                                                  AllocationMode allocationMode);
+    // Прием блока прямо в отображение файла, проверка хэша фрагмента по отображению
+    void mappedBlockReceived(int pieceIndex, int blockOffset, const std::string &data);
+    void pieceVerified(Piece *piece);          // Учет проверенного фрагмента (вызывается под lock)
     void displayProgressBar();                 // Отображение прогресса загрузки
     void trackProgress();                      // Отслеживание прогресса загрузки
 
     public:
-    explicit PieceManager(const TorrentFile &fileParser, const std::string &downloadPath, int maximumConnections);
+    explicit PieceManager(const TorrentFile &fileParser,
+                          const std::string &downloadDirectory,
+                          int maximumConnections,
+                          StorageMode storageMode = storageStream,
+                          AllocationMode allocationMode = allocateFull);
+    // Загрузка в заданное хранилище (например, в конвейер через NullStorage)
+    PieceManager(const TorrentFile &fileParser, std::unique_ptr<Storage> storage, int maximumConnections);
     ~PieceManager();
     bool isComplete();
+    void setCompletionHandler(std::function<void()> handler); // Уведомление о завершении загрузки
+    void setDirectWrites(bool enabled);       // Запись проверенных фрагментов с O_DIRECT (до начала загрузки)
+    void setReadCacheSize(size_t bytes);      // Размер кэша отдаваемых фрагментов (0 - без кэша, до начала отдачи)
+    unsigned long getCacheHits();             // Попадания в кэш отдаваемых фрагментов
+    unsigned long getCacheMisses();           // Промахи кэша отдаваемых фрагментов
+    // Проверка хэшей данных, уже лежащих в хранилище (продолжение загрузки): совпавшие фрагменты
+    // считаются загруженными. Вызывается до начала загрузки; возвращает количество таких фрагментов
+    int recheck();
     void blockReceived(std::string peerId, int pieceIndex, int blockOffset, std::string data);
     void addPeer(const std::string &peerId, std::string bitField);
     void removePeer(const std::string &peerId);
     void updatePeer(const std::string &peerId, int index);
     unsigned long bytesDownloaded();
-    Block *nextRequest(std::string peerId);
+    unsigned long bytesUploaded();
+    // Следующий блок для запроса у пира; preferredPieces (suggest, allowed fast) проверяются первыми,
+    // а при preferredOnly другие фрагменты не рассматриваются
+    Block *nextRequest(std::string peerId, const std::set<int> &preferredPieces = {}, bool preferredOnly = false);
+    void requestRejected(int pieceIndex, int blockOffset); // Возврат отклоненного/отмененного блока в пул
+    bool havePiece(int index);                // Проверен ли фрагмент (можно ли его отдавать)
+    std::string getBitField();                // Наше битовое поле для отправки пирам
+    std::vector<int> getCompletedSince(size_t &cursor); // Фрагменты, проверенные после позиции cursor
+    int getPieceCount() const;                // Общее количество фрагментов
+    long getPieceSize(int index) const;       // Размер фрагмента с учетом последнего
+    // Отдача блока пиру: проверяет запрос и отправляет данные из файла без копирования в память процесса
+    bool sendBlock(int sock, int index, int begin, int length, RateLimiter *limiter);
 };
 
 #endif // PIECEMANAGER_H
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <thread>
+
+#include "ratelimiter.h"
+
+#define MIN_BURST 16384          // Минимальная емкость корзины (один блок)
+#define MEASURE_WINDOW_MS 1000   // Окно измерения фактической скорости
+
+RateLimiter::RateLimiter(RateLimiter *parent, long rate, long burst) : parent(parent)
+{
+    setRate(rate, burst);
+    windowStart = lastRefill;
+}
+
+void RateLimiter::setRate(long rate, long burst)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    this->rate = std::max(rate, 0L);
+    this->burst = burst > 0 ? burst : std::max(this->rate, (long)MIN_BURST);
+    tokens = this->burst;
+    lastRefill = Clock::now();
+}
+
+long RateLimiter::getRate() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return rate;
+}
+
+void RateLimiter::reset()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    tokens = burst;
+    lastRefill = windowStart = Clock::now();
+    bytesInWindow = 0;
+    throughput = 0;
+}
+
+void RateLimiter::refill(Clock::time_point now)
+{
+    double elapsed = std::chrono::duration<double>(now - lastRefill).count();
+    tokens = std::min((double)burst, tokens + elapsed * rate);
+    lastRefill = now;
+}
+
+void RateLimiter::roll(Clock::time_point now) const
+{
+    auto elapsed = std::chrono::duration<double, std::milli>(now - windowStart).count();
+    if (elapsed < MEASURE_WINDOW_MS)
+    {
+        return;
+    }
+    double current = bytesInWindow * 1000.0 / elapsed;
+    // Если окно длилось дольше двух интервалов, старое значение уже неактуально
+    throughput = elapsed > 2 * MEASURE_WINDOW_MS ? current : (throughput + current) / 2;
+    bytesInWindow = 0;
+    windowStart = now;
+}
+
+RateLimiter::Clock::duration RateLimiter::reserve(long bytes, Clock::time_point now)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    roll(now);
+    bytesInWindow += bytes;
+    if (rate == 0)
+    {
+        return Clock::duration::zero();
+    }
+    refill(now);
+    tokens -= bytes;
+    if (tokens >= 0)
+    {
+        return Clock::duration::zero();
+    }
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-tokens / rate));
+}
+
+void RateLimiter::acquire(long bytes)
+{
+    if (bytes <= 0)
+    {
+        return;
+    }
+    auto now = Clock::now();
+    Clock::duration wait = Clock::duration::zero();
+    for (RateLimiter *level = this; level; level = level->parent)
+    {
+        wait = std::max(wait, level->reserve(bytes, now));
+    }
+    if (wait > Clock::duration::zero())
+    {
+        std::this_thread::sleep_for(wait);
+    }
+}
+
+double RateLimiter::getThroughput() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    roll(Clock::now());
+    return throughput;
+}
+
+double RateLimiter::getUtilization() const
+{
+    long limit = getRate();
+    if (limit == 0)
+    {
+        return 0;
+    }
+    return std::min(1.0, getThroughput() / limit);
+}
+
+RateLimiter &RateLimiter::globalDownload()
+{
+    static RateLimiter limiter;
+    return limiter;
+}
+
+RateLimiter &RateLimiter::globalUpload()
+{
+    static RateLimiter limiter;
+    return limiter;
+}
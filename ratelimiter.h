@@ -0,0 +1,45 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <chrono>
+#include <mutex>
+
+/*
+ Ограничитель скорости на основе token bucket.
+ Корзины образуют иерархию: глобальная -> торрент -> пир. Запрос резервирует токены
+ сразу на всей цепочке, а вызывающий поток засыпает один раз на максимальное из ожиданий.
+ Токены могут уходить в минус: каждый следующий запрос ждет дольше предыдущего,
+ поэтому порядок выдачи совпадает с порядком запросов. Скорость 0 - без ограничения.
+ */
+class RateLimiter {
+    private:
+    using Clock = std::chrono::steady_clock;
+
+    RateLimiter *parent;           // Родительская корзина (nullptr для глобальной)
+    long rate;                     // Скорость пополнения, байт/с
+    long burst;                    // Емкость корзины, байт
+    double tokens;                 // Доступные токены (отрицательное значение - очередь ожидающих)
+    Clock::time_point lastRefill;  // Время последнего пополнения
+    mutable Clock::time_point windowStart; // Начало текущего окна измерения скорости
+    mutable long bytesInWindow = 0;        // Байты, пропущенные в текущем окне
+    mutable double throughput = 0;         // Сглаженная фактическая скорость, байт/с
+    mutable std::mutex lock;       // Мьютекс для предотвращения гонок
+
+    void refill(Clock::time_point now);                         // Пополнение корзины
+    void roll(Clock::time_point now) const;                     // Пересчет скорости по окну
+    Clock::duration reserve(long bytes, Clock::time_point now); // Резервирование токенов
+
+    public:
+    explicit RateLimiter(RateLimiter *parent = nullptr, long rate = 0, long burst = 0);
+    void setRate(long rate, long burst = 0); // Изменение лимита во время работы
+    long getRate() const;                    // Текущий лимит, байт/с
+    void reset();                            // Сброс токенов и статистики (новый пир)
+    void acquire(long bytes);                // Ожидание разрешения на передачу bytes байт
+    double getThroughput() const;            // Фактическая скорость, байт/с
+    double getUtilization() const;           // Доля использования лимита (0..1, 0 без лимита)
+
+    static RateLimiter &globalDownload();    // Общий лимит загрузки клиента
+    static RateLimiter &globalUpload();      // Общий лимит отдачи клиента
+};
+
+#endif                                       // RATELIMITER_H
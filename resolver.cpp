@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <csignal>
+#include <netdb.h>
+#include <netinet/in.h>
+
+#include "resolver.h"
+
+struct Resolver::Query
+{
+    struct gaicb request {};              // Запрос getaddrinfo_a
+    struct addrinfo hints {};             // Ограничения запроса
+    std::string host;                     // Имя сервера
+    std::string service;                  // Порт сервера
+    std::string key;                      // Ключ кэша
+    std::shared_ptr<Shared> shared;       // Кэш и цикл событий
+    Callback callback;                    // Получатель адресов
+};
+
+Resolver::Resolver(EventLoop &loop) : loop(loop), shared(std::make_shared<Shared>())
+{
+    shared->loop = &loop;
+}
+
+Resolver::~Resolver()
+{
+    // Запросы, которые еще выполняются, завершатся в потоках glibc без обращения к циклу
+    std::lock_guard<std::mutex> guard(shared->lock);
+    shared->loop = nullptr;
+}
+
+socklen_t Resolver::addressLength(const struct sockaddr_storage &address)
+{
+    return address.ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+void Resolver::resolve(const std::string &host, int port, int socketType, Callback callback)
+{
+    std::string key = host + ":" + std::to_string(port) + "/" + std::to_string(socketType);
+    {
+        std::lock_guard<std::mutex> guard(shared->lock);
+        auto cached = shared->cache.find(key);
+        if (cached != shared->cache.end())
+        {
+            loop.post([callback = std::move(callback), addresses = cached->second]() { callback(addresses); });
+            return;
+        }
+    }
+
+    auto *query = new Query();
+    query->host = host;
+    query->service = std::to_string(port);
+    query->key = key;
+    query->shared = shared;
+    query->callback = std::move(callback);
+    query->hints.ai_family = AF_UNSPEC;
+    query->hints.ai_socktype = socketType;
+    query->request.ar_name = query->host.c_str();
+    query->request.ar_service = query->service.c_str();
+    query->request.ar_request = &query->hints;
+
+    struct sigevent event {};
+    event.sigev_notify = SIGEV_THREAD;
+    event.sigev_notify_function = onResolved;
+    event.sigev_value.sival_ptr = query;
+    struct gaicb *list[] = {&query->request};
+    if (getaddrinfo_a(GAI_NOWAIT, list, 1, &event) != 0)
+    {
+        loop.post([callback = std::move(query->callback)]() { callback({}); });
+        delete query;
+    }
+}
+
+void Resolver::onResolved(union sigval value)
+{
+    auto *query = (Query *)value.sival_ptr;
+    std::vector<struct sockaddr_storage> addresses;
+    if (gai_error(&query->request) == 0)
+    {
+        for (struct addrinfo *candidate = query->request.ar_result; candidate; candidate = candidate->ai_next)
+        {
+            struct sockaddr_storage address {};
+            std::copy_n((const char *)candidate->ai_addr, candidate->ai_addrlen, (char *)&address);
+            addresses.push_back(address);
+        }
+        freeaddrinfo(query->request.ar_result);
+    }
+
+    std::shared_ptr<Shared> shared = query->shared;
+    std::lock_guard<std::mutex> guard(shared->lock);
+    if (shared->loop)
+    {
+        shared->loop->post([shared, key = query->key, callback = std::move(query->callback), addresses]() {
+            {
+                std::lock_guard<std::mutex> guard(shared->lock);
+                if (!shared->loop)
+                {
+                    return;
+                }
+                // Неудачный ответ не кэшируется: следующий запрос попробует снова
+                if (!addresses.empty())
+                {
+                    shared->cache[key] = addresses;
+                }
+            }
+            callback(addresses);
+        });
+    }
+    delete query;
+}
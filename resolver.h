@@ -0,0 +1,52 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+#include "eventloop.h"
+
+/*
+ Асинхронное разрешение имен для цикла событий. Запрос выполняет getaddrinfo_a в потоке glibc,
+ адреса передаются обработчику в потоке цикла, поэтому медленный DNS не останавливает таймеры
+ и сокеты цикла. Результаты кэшируются на время жизни объекта.
+ */
+class Resolver {
+    public:
+    // Адреса сервера в порядке getaddrinfo (пустой список - имя не разрешено)
+    using Callback = std::function<void(std::vector<struct sockaddr_storage> addresses)>;
+
+    private:
+    // Состояние, общее с потоками glibc: переживает объект, пока не завершены его запросы
+    struct Shared
+    {
+        std::mutex lock;                  // Мьютекс для предотвращения гонок
+        EventLoop *loop;                  // Цикл событий (nullptr - объект уничтожен)
+        std::map<std::string, std::vector<struct sockaddr_storage>> cache; // Адреса по host:port/тип сокета
+    };
+
+    struct Query;                         // Выполняемый запрос getaddrinfo_a
+
+    EventLoop &loop;                      // Цикл событий
+    std::shared_ptr<Shared> shared;       // Кэш и признак жизни для потоков glibc
+
+    static void onResolved(union sigval value); // Завершение запроса (в потоке glibc)
+
+    public:
+    explicit Resolver(EventLoop &loop);   // Конструктор класса
+    ~Resolver();                          // Деструктор класса, обработчики незавершенных запросов не вызываются
+    Resolver(const Resolver &) = delete;
+    Resolver &operator=(const Resolver &) = delete;
+    // Разрешение host:port для сокетов типа socketType; обработчик вызывается в одной из следующих
+    // итераций цикла, даже если адреса уже есть в кэше
+    void resolve(const std::string &host, int port, int socketType, Callback callback);
+    // Длина адреса для connect() по его семейству
+    static socklen_t addressLength(const struct sockaddr_storage &address);
+};
+
+#endif                                    // RESOLVER_H
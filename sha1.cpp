@@ -1,9 +1,12 @@
 #include "sha1.h"
+#include "sha1kernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <fstream>
-#include <iomanip>
-#include <sstream>
+#include <stdexcept>
 
-#define SHA1_ROL(value, bits) (((value) << (bits)) | (((value) & 0xffffffff) >> (32 - (bits))))
+#define SHA1_ROL(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
 #define SHA1_BLK(i)                                                                                                    \
     (block[i & 15] = SHA1_ROL(block[(i + 13) & 15] ^ block[(i + 8) & 15] ^ block[(i + 2) & 15] ^ block[i & 15], 1))
 
@@ -28,72 +31,215 @@
     z += (w ^ x ^ y) + SHA1_BLK(i) + SHA1_CONST4 + SHA1_ROL(v, 5);                                                     \
     w = SHA1_ROL(w, 30);
 
-SHA1::SHA1()
+#define SHA1_STREAM_BUFFER 65536 // Размер порции чтения из потока
+
+// Самая быстрая реализация, доступная на процессоре
+static SHA1::Kernel detectKernel()
 {
-    reset();
+#if defined(SHA1_KERNELS_X86)
+    if (sha1CpuHasShaNi())
+    {
+        return SHA1::kernelShaNi;
+    }
+    if (sha1CpuHasAvx2())
+    {
+        return SHA1::kernelAvx2;
+    }
+    if (sha1CpuHasSsse3())
+    {
+        return SHA1::kernelSsse3;
+    }
+#endif
+#if defined(SHA1_KERNELS_ARMV8)
+    if (sha1CpuHasArmv8())
+    {
+        return SHA1::kernelArmv8;
+    }
+#endif
+    return SHA1::kernelScalar;
 }
 
-void SHA1::update(const std::string &s)
+// Функция сжатия реализации
+static Sha1Compress kernelFunction(SHA1::Kernel kernel)
 {
-    std::istringstream is(s);
-    update(is);
+    switch (kernel)
+    {
+#if defined(SHA1_KERNELS_X86)
+    case SHA1::kernelSsse3:
+        return sha1CompressSsse3;
+    case SHA1::kernelAvx2:
+        return sha1CompressAvx2;
+    case SHA1::kernelShaNi:
+        return sha1CompressShaNi;
+#endif
+#if defined(SHA1_KERNELS_ARMV8)
+    case SHA1::kernelArmv8:
+        return sha1CompressArmv8;
+#endif
+    default:
+        return sha1CompressScalar;
+    }
 }
 
-void SHA1::update(std::istream &is)
+// Выбранная реализация; определяется при первом обращении
+static std::atomic<SHA1::Kernel> &activeKernel()
 {
-    std::string rest_of_buffer;
-    read(is, rest_of_buffer, BLOCK_BYTES - buffer.size());
-    buffer += rest_of_buffer;
+    static std::atomic<SHA1::Kernel> kernel(detectKernel());
+    return kernel;
+}
 
-    while (is)
+void sha1CompressScalar(uint32_t state[5], const unsigned char *data, size_t count)
+{
+    for (; count > 0; count--, data += 64)
     {
-        uint32 block[BLOCK_INTS];
-        buffer_to_block(buffer, block);
-        transform(block);
-        read(is, buffer, BLOCK_BYTES);
+        uint32_t block[16];
+        for (unsigned int i = 0; i < 16; i++)
+        {
+            block[i] = (uint32_t)data[4 * i + 3] | (uint32_t)data[4 * i + 2] << 8 | (uint32_t)data[4 * i + 1] << 16 |
+                       (uint32_t)data[4 * i + 0] << 24;
+        }
+
+        uint32_t a = state[0];
+        uint32_t b = state[1];
+        uint32_t c = state[2];
+        uint32_t d = state[3];
+        uint32_t e = state[4];
+
+        for (int i = 0; i <= 15; ++i)
+        {
+            SHA1_R0(a, b, c, d, e, i);
+            std::swap(a, b);
+            std::swap(a, c);
+            std::swap(a, d);
+            std::swap(a, e);
+        }
+        for (int i = 16; i <= 19; ++i)
+        {
+            SHA1_R1(a, b, c, d, e, i);
+            std::swap(a, b);
+            std::swap(a, c);
+            std::swap(a, d);
+            std::swap(a, e);
+        }
+        for (int i = 20; i <= 39; ++i)
+        {
+            SHA1_R2(a, b, c, d, e, i);
+            std::swap(a, b);
+            std::swap(a, c);
+            std::swap(a, d);
+            std::swap(a, e);
+        }
+        for (int i = 40; i <= 59; ++i)
+        {
+            SHA1_R3(a, b, c, d, e, i);
+            std::swap(a, b);
+            std::swap(a, c);
+            std::swap(a, d);
+            std::swap(a, e);
+        }
+        for (int i = 60; i <= 79; ++i)
+        {
+            SHA1_R4(a, b, c, d, e, i);
+            std::swap(a, b);
+            std::swap(a, c);
+            std::swap(a, d);
+            std::swap(a, e);
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
     }
 }
 
-std::string SHA1::final()
+SHA1::SHA1()
 {
-    uint64 total_bits = (transforms * BLOCK_BYTES + buffer.size()) * 8;
+    reset();
+}
+
+void SHA1::update(const std::string &s)
+{
+    update(s.data(), s.size());
+}
 
-    buffer += 0x80;
-    unsigned int orig_size = buffer.size();
-    while (buffer.size() < BLOCK_BYTES)
+void SHA1::update(std::istream &is)
+{
+    char chunk[SHA1_STREAM_BUFFER];
+    while (is.read(chunk, sizeof(chunk)) || is.gcount() > 0)
     {
-        buffer += (char)0x00;
+        update(chunk, is.gcount());
     }
+}
 
-    uint32 block[BLOCK_INTS];
-    buffer_to_block(buffer, block);
-
-    if (orig_size > BLOCK_BYTES - 8)
+void SHA1::update(const char *data, size_t length)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    if (bufferLength > 0)
     {
-        transform(block);
-        for (unsigned int i = 0; i < BLOCK_INTS - 2; i++)
+        size_t taken = std::min<size_t>(BLOCK_BYTES - bufferLength, length);
+        memcpy(buffer + bufferLength, bytes, taken);
+        bufferLength += taken;
+        bytes += taken;
+        length -= taken;
+        if (bufferLength < BLOCK_BYTES)
         {
-            block[i] = 0;
+            return;
         }
+        transform(buffer, 1);
+        bufferLength = 0;
+    }
+    // Целые блоки сжимаются прямо из памяти одним вызовом реализации
+    size_t blocks = length / BLOCK_BYTES;
+    if (blocks > 0)
+    {
+        transform(bytes, blocks);
+        bytes += blocks * BLOCK_BYTES;
+        length -= blocks * BLOCK_BYTES;
     }
+    memcpy(buffer, bytes, length);
+    bufferLength = length;
+}
+
+void SHA1::update(const uint8_t *data, size_t length)
+{
+    update((const char *)data, length);
+}
+
+Sha1Digest SHA1::final()
+{
+    uint64 total_bits = (transforms * BLOCK_BYTES + bufferLength) * 8;
 
-    block[BLOCK_INTS - 1] = total_bits;
-    block[BLOCK_INTS - 2] = (total_bits >> 32);
-    transform(block);
+    buffer[bufferLength++] = 0x80;
+    if (bufferLength > BLOCK_BYTES - 8)
+    {
+        memset(buffer + bufferLength, 0, BLOCK_BYTES - bufferLength);
+        transform(buffer, 1);
+        bufferLength = 0;
+    }
+    memset(buffer + bufferLength, 0, BLOCK_BYTES - 8 - bufferLength);
+    for (int i = 0; i < 8; i++)
+    {
+        buffer[BLOCK_BYTES - 1 - i] = (unsigned char)(total_bits >> (8 * i));
+    }
+    transform(buffer, 1);
 
-    std::ostringstream result;
+    Sha1Digest result;
     for (unsigned int i = 0; i < DIGEST_INTS; i++)
     {
-        result << std::hex << std::setfill('0') << std::setw(8);
-        result << (digest[i] & 0xffffffff);
+        for (int j = 0; j < 4; j++)
+        {
+            result[4 * i + j] = (uint8_t)(digest[i] >> (24 - 8 * j));
+        }
     }
 
     reset();
 
-    return result.str();
+    return result;
 }
 
-std::string SHA1::from_file(const std::string &filename)
+Sha1Digest SHA1::from_file(const std::string &filename)
 {
     std::ifstream stream(filename.c_str(), std::ios::binary);
     SHA1 checksum;
@@ -101,6 +247,60 @@ std::string SHA1::from_file(const std::string &filename)
     return checksum.final();
 }
 
+bool SHA1::isSupported(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case kernelScalar:
+        return true;
+#if defined(SHA1_KERNELS_X86)
+    case kernelSsse3:
+        return sha1CpuHasSsse3();
+    case kernelAvx2:
+        return sha1CpuHasAvx2();
+    case kernelShaNi:
+        return sha1CpuHasShaNi();
+#endif
+#if defined(SHA1_KERNELS_ARMV8)
+    case kernelArmv8:
+        return sha1CpuHasArmv8();
+#endif
+    default:
+        return false;
+    }
+}
+
+void SHA1::setKernel(Kernel kernel)
+{
+    if (!isSupported(kernel))
+    {
+        throw std::runtime_error(std::string("Реализация SHA-1 недоступна: ") + getKernelName(kernel));
+    }
+    activeKernel() = kernel;
+}
+
+SHA1::Kernel SHA1::getKernel()
+{
+    return activeKernel();
+}
+
+const char *SHA1::getKernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case kernelSsse3:
+        return "ssse3";
+    case kernelAvx2:
+        return "avx2";
+    case kernelShaNi:
+        return "sha-ni";
+    case kernelArmv8:
+        return "armv8";
+    default:
+        return "scalar";
+    }
+}
+
 void SHA1::reset()
 {
     digest[0] = 0x67452301;
@@ -110,86 +310,49 @@ void SHA1::reset()
     digest[4] = 0xc3d2e1f0;
 
     transforms = 0;
-    buffer = "";
+    bufferLength = 0;
 }
 
-void SHA1::transform(uint32 block[BLOCK_BYTES])
+void SHA1::transform(const unsigned char *blocks, size_t count)
 {
-    uint32 a = digest[0];
-    uint32 b = digest[1];
-    uint32 c = digest[2];
-    uint32 d = digest[3];
-    uint32 e = digest[4];
-
-    for (int i = 0; i <= 15; ++i)
-    {
-        SHA1_R0(a, b, c, d, e, i);
-        std::swap(a, b);
-        std::swap(a, c);
-        std::swap(a, d);
-        std::swap(a, e);
-    }
-    for (int i = 16; i <= 19; ++i)
-    {
-        SHA1_R1(a, b, c, d, e, i);
-        std::swap(a, b);
-        std::swap(a, c);
-        std::swap(a, d);
-        std::swap(a, e);
-    }
-    for (int i = 20; i <= 39; ++i)
-    {
-        SHA1_R2(a, b, c, d, e, i);
-        std::swap(a, b);
-        std::swap(a, c);
-        std::swap(a, d);
-        std::swap(a, e);
-    }
-    for (int i = 40; i <= 59; ++i)
-    {
-        SHA1_R3(a, b, c, d, e, i);
-        std::swap(a, b);
-        std::swap(a, c);
-        std::swap(a, d);
-        std::swap(a, e);
-    }
-    for (int i = 60; i <= 79; ++i)
-    {
-        SHA1_R4(a, b, c, d, e, i);
-        std::swap(a, b);
-        std::swap(a, c);
-        std::swap(a, d);
-        std::swap(a, e);
-    }
+    kernelFunction(activeKernel())(digest, blocks, count);
+    transforms += count;
+}
 
-    digest[0] += a;
-    digest[1] += b;
-    digest[2] += c;
-    digest[3] += d;
-    digest[4] += e;
+Sha1Digest sha1Digest(const std::string &string)
+{
+    SHA1 checksum;
+    checksum.update(string);
+    return checksum.final();
+}
 
-    transforms++;
+Sha1Digest sha1Digest(const char *data, size_t length)
+{
+    SHA1 checksum;
+    checksum.update(data, length);
+    return checksum.final();
 }
 
-void SHA1::buffer_to_block(const std::string &buffer, uint32 block[BLOCK_BYTES])
+std::string sha1Hex(const Sha1Digest &digest)
 {
-    for (unsigned int i = 0; i < BLOCK_INTS; i++)
+    static const char hexDigits[] = "0123456789abcdef";
+
+    std::string hex;
+    hex.reserve(digest.size() * 2);
+    for (uint8_t c : digest)
     {
-        block[i] = (buffer[4 * i + 3] & 0xff) | (buffer[4 * i + 2] & 0xff) << 8 | (buffer[4 * i + 1] & 0xff) << 16 |
-                   (buffer[4 * i + 0] & 0xff) << 24;
+        hex.push_back(hexDigits[c >> 4]);
+        hex.push_back(hexDigits[c & 15]);
     }
+    return hex;
 }
 
-void SHA1::read(std::istream &is, std::string &s, int max)
+std::string sha1(const std::string &string)
 {
-    char sbuf[max];
-    is.read(sbuf, max);
-    s.assign(sbuf, is.gcount());
+    return sha1Hex(sha1Digest(string));
 }
 
-std::string sha1(const std::string &string)
+std::string sha1(const char *data, size_t length)
 {
-    SHA1 checksum;
-    checksum.update(string);
-    return checksum.final();
+    return sha1Hex(sha1Digest(data, length));
 }
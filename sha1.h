@@ -1,11 +1,30 @@
 #ifndef SHA1_H
 #define SHA1_H
 
+#include <array>
+#include <cstdint>
 #include <iostream>
 #include <string>
 
+typedef std::array<uint8_t, 20> Sha1Digest; // Двоичный хеш SHA-1 (160 бит)
+
+/*
+ Вычисление SHA-1. Сжатие блоков выполняется самой быстрой реализацией, доступной на процессоре
+ (выбирается при первом использовании): инструкции SHA на x86 (SHA-NI) и ARMv8, векторное
+ расписание сообщения на AVX2 или SSSE3 или переносимая реализация.
+ */
 class SHA1 {
     public:
+    // Реализация сжатия блоков
+    enum Kernel
+    {
+        kernelScalar,             // Переносимая реализация
+        kernelSsse3,              // x86: расписание сообщения на SSSE3, раунды скалярные
+        kernelShaNi,              // x86: инструкции SHA (SHA-NI)
+        kernelArmv8,              // ARMv8: криптографическое расширение
+        kernelAvx2                // x86: расписание двух блоков сразу на AVX2, раунды скалярные
+    };
+
     SHA1(); // Конструктор класса, инициализирует объект SHA-1
 
     // Обновляет хешируемые данные строкой
@@ -14,38 +33,63 @@ class SHA1 {
     // Обновляет хешируемые данные потоком ввода
     void update(std::istream &is);
 
-    // Завершает процесс хеширования и возвращает итоговый хеш в виде строки
-    std::string final();
+    // Обновляет хешируемые данные участком памяти без промежуточного копирования
+    void update(const char *data, size_t length);
+
+    // Обновляет хешируемые данные участком памяти без промежуточного копирования
+    void update(const uint8_t *data, size_t length);
+
+    // Завершает процесс хеширования и возвращает итоговый двоичный хеш; объект готов к новому хешированию
+    Sha1Digest final();
 
     // Статический метод для вычисления хеша файла по его имени.
-    static std::string from_file(const std::string &filename);
+    static Sha1Digest from_file(const std::string &filename);
+
+    // Доступна ли реализация на этом процессоре
+    static bool isSupported(Kernel kernel);
+
+    // Выбор реализации для всех объектов (тесты и замеры); std::runtime_error, если она недоступна
+    static void setKernel(Kernel kernel);
+
+    // Используемая реализация
+    static Kernel getKernel();
+
+    // Название реализации
+    static const char *getKernelName(Kernel kernel);
 
     private:
-    typedef unsigned long int uint32; // Определение типа для 32-битных беззнаковых целых чисел.
-    typedef unsigned long long uint64; // Определение типа для 64-битных беззнаковых целых чисел.
+    typedef uint32_t uint32; // Определение типа для 32-битных беззнаковых целых чисел.
+    typedef uint64_t uint64; // Определение типа для 64-битных беззнаковых целых чисел.
 
     static const unsigned int DIGEST_INTS = 5; // Количество 32-битных целых чисел в хеше (160 бит).
     static const unsigned int BLOCK_INTS = 16; // Количество 32-битных целых чисел в блоке (512 бит).
     static const unsigned int BLOCK_BYTES = BLOCK_INTS * 4; // Размер блока в байтах.
 
-    uint32 digest[DIGEST_INTS]; // Массив для хранения промежуточных значений хеша.
-    std::string buffer;         // Буфер для хранения данных перед обработкой.
-    uint64 transforms;          // Счетчик трансформаций блоков данных.
+    uint32 digest[DIGEST_INTS];        // Массив для хранения промежуточных значений хеша.
+    unsigned char buffer[BLOCK_BYTES]; // Неполный блок, ожидающий данных.
+    size_t bufferLength;               // Заполненная часть буфера.
+    uint64 transforms;                 // Счетчик трансформаций блоков данных.
 
                                 // Сбрасывает внутреннее состояние объекта SHA-1.
     void reset();
 
-    // Выполняет основное преобразование SHA-1 для одного блока данных.
-    void transform(uint32 block[BLOCK_BYTES]);
+    // Сжимает count подряд идущих блоков выбранной реализацией.
+    void transform(const unsigned char *blocks, size_t count);
+};
+
+// Двоичный SHA-1 хеш строки.
+Sha1Digest sha1Digest(const std::string &string);
 
-    // Преобразует строку в блок 32-битных целых чисел.
-    static void buffer_to_block(const std::string &buffer, uint32 block[BLOCK_BYTES]);
+// Двоичный SHA-1 хеш участка памяти.
+Sha1Digest sha1Digest(const char *data, size_t length);
 
-    // Читает данные из потока ввода в строку.
-    static void read(std::istream &is, std::string &s, int max);
-};
+// Шестнадцатеричная запись хеша (40 символов в нижнем регистре).
+std::string sha1Hex(const Sha1Digest &digest);
 
-// Функция для вычисления SHA-1 хеша строки.
+// SHA-1 хеш строки в шестнадцатеричном виде (для вывода и тестов).
 std::string sha1(const std::string &string);
 
+// SHA-1 хеш участка памяти в шестнадцатеричном виде (для вывода и тестов).
+std::string sha1(const char *data, size_t length);
+
 #endif // SHA1_H
@@ -0,0 +1,438 @@
+#include "sha1kernels.h"
+
+#if defined(SHA1_KERNELS_X86)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(SHA1_KERNELS_ARMV8)
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+#define SHA1_K0 0x5a827999 // Константа раундов 0-19
+#define SHA1_K1 0x6ed9eba1 // Константа раундов 20-39
+#define SHA1_K2 0x8f1bbcdc // Константа раундов 40-59
+#define SHA1_K3 0xca62c1d6 // Константа раундов 60-79
+
+#if defined(SHA1_KERNELS_X86)
+
+bool sha1CpuHasSsse3()
+{
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3);
+}
+
+bool sha1CpuHasShaNi()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3))
+    {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+}
+
+bool sha1CpuHasAvx2()
+{
+    unsigned int eax, ebx, ecx, edx;
+    // Регистры YMM должны сохраняться операционной системой (OSXSAVE и XCR0)
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+    {
+        return false;
+    }
+    unsigned int xcr0, xcr0High;
+    __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+    if ((xcr0 & 6) != 6)
+    {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2) && (ebx & bit_BMI2);
+}
+
+static const uint32_t roundConstants[4] = {SHA1_K0, SHA1_K1, SHA1_K2, SHA1_K3}; // Константы по двадцаткам раундов
+
+static inline uint32_t rotateLeft(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+/*
+ Скалярный раунд t. Слова a..e лежат в s, их индексы сдвигаются на каждом раунде, поэтому
+ перестановок переменных нет. Слово W[t] + K берется из wk: четверки слов идут через stride.
+ */
+template <int t, int stride>
+__attribute__((always_inline)) static inline void scalarRound(uint32_t s[5], const uint32_t *wk)
+{
+    uint32_t &a = s[(80 - t) % 5];
+    uint32_t &b = s[(81 - t) % 5];
+    uint32_t &c = s[(82 - t) % 5];
+    uint32_t &d = s[(83 - t) % 5];
+    uint32_t &e = s[(84 - t) % 5];
+    uint32_t f;
+    if constexpr (t < 20)
+    {
+        f = ((c ^ d) & b) ^ d;
+    }
+    else if constexpr (t >= 40 && t < 60)
+    {
+        f = (b & c) + ((b ^ c) & d);
+    }
+    else
+    {
+        f = b ^ c ^ d;
+    }
+    e += rotateLeft(a, 5) + f + wk[(t / 4) * stride + t % 4];
+    b = rotateLeft(b, 30);
+}
+
+// Четыре раунда группы group (0-19)
+template <int group, int stride>
+__attribute__((always_inline)) static inline void scalarRounds(uint32_t s[5], const uint32_t *wk)
+{
+    scalarRound<group * 4, stride>(s, wk);
+    scalarRound<group * 4 + 1, stride>(s, wk);
+    scalarRound<group * 4 + 2, stride>(s, wk);
+    scalarRound<group * 4 + 3, stride>(s, wk);
+}
+
+// Циклический сдвиг влево каждого 32-битного слова
+__attribute__((target("ssse3"))) static inline __m128i rotateLeft(__m128i value, int bits)
+{
+    return _mm_or_si128(_mm_slli_epi32(value, bits), _mm_srli_epi32(value, 32 - bits));
+}
+
+/*
+ Следующая четверка слов расписания W[t..t+3], t = 16 + 4 * group, из четырех предыдущих в w:
+ W[t] = rol1(W[t-3] ^ W[t-8] ^ W[t-14] ^ W[t-16]). W[t+3] зависит от W[t] из той же четверки,
+ поэтому сначала вместо W[t] берется 0, а затем последнее слово исправляется.
+ */
+template <int group>
+__attribute__((target("ssse3"), always_inline)) static inline __m128i ssse3Schedule(__m128i w[4])
+{
+    __m128i x = _mm_xor_si128(w[group % 4], _mm_alignr_epi8(w[(group + 1) % 4], w[group % 4], 8));
+    x = _mm_xor_si128(x, w[(group + 2) % 4]);
+    x = _mm_xor_si128(x, _mm_srli_si128(w[(group + 3) % 4], 4));
+    x = rotateLeft(x, 1);
+    x = _mm_xor_si128(x, rotateLeft(_mm_slli_si128(x, 12), 1));
+    w[group % 4] = x;
+    return _mm_add_epi32(x, _mm_set1_epi32((int)roundConstants[(16 + group * 4) / 20]));
+}
+
+/*
+ Группа из четырех раундов. Пока идут раунды, векторно считаются слова расписания на четыре
+ группы вперед: их вычисление не зависит от раундов и выполняется параллельно с ними.
+ */
+template <int group>
+__attribute__((target("ssse3"), always_inline)) static inline void ssse3Rounds(uint32_t s[5],
+                                                                               __m128i w[4],
+                                                                               uint32_t *wk)
+{
+    if constexpr (group < 16)
+    {
+        _mm_store_si128((__m128i *)(wk + 16 + group * 4), ssse3Schedule<group>(w));
+    }
+    scalarRounds<group, 4>(s, wk);
+    if constexpr (group < 19)
+    {
+        ssse3Rounds<group + 1>(s, w, wk);
+    }
+}
+
+// Сжатие одного блока с векторным расписанием
+__attribute__((target("ssse3"), always_inline)) static inline void ssse3Block(uint32_t state[5],
+                                                                              const unsigned char *data)
+{
+    const __m128i byteSwap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    const __m128i constant = _mm_set1_epi32((int)SHA1_K0);
+    alignas(16) uint32_t wk[80]; // Слова расписания с прибавленной константой раунда
+    __m128i w[4];                // Последние 16 слов расписания
+    for (int i = 0; i < 4; i++)
+    {
+        w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), byteSwap);
+        _mm_store_si128((__m128i *)(wk + i * 4), _mm_add_epi32(w[i], constant));
+    }
+    uint32_t s[5] = {state[0], state[1], state[2], state[3], state[4]};
+    ssse3Rounds<0>(s, w, wk);
+    for (int i = 0; i < 5; i++)
+    {
+        state[i] += s[i];
+    }
+}
+
+__attribute__((target("ssse3"))) void sha1CompressSsse3(uint32_t state[5], const unsigned char *data, size_t count)
+{
+    for (; count > 0; count--, data += 64)
+    {
+        ssse3Block(state, data);
+    }
+}
+
+// То же расписание для двух блоков сразу: блок в каждой 128-битной половине регистра
+template <int group>
+__attribute__((target("avx2"), always_inline)) static inline __m256i avx2Schedule(__m256i w[4])
+{
+    __m256i x = _mm256_xor_si256(w[group % 4], _mm256_alignr_epi8(w[(group + 1) % 4], w[group % 4], 8));
+    x = _mm256_xor_si256(x, w[(group + 2) % 4]);
+    x = _mm256_xor_si256(x, _mm256_srli_si256(w[(group + 3) % 4], 4));
+    x = _mm256_or_si256(_mm256_slli_epi32(x, 1), _mm256_srli_epi32(x, 31));
+    __m256i last = _mm256_slli_si256(x, 12);
+    x = _mm256_xor_si256(x, _mm256_or_si256(_mm256_slli_epi32(last, 1), _mm256_srli_epi32(last, 31)));
+    w[group % 4] = x;
+    return _mm256_add_epi32(x, _mm256_set1_epi32((int)roundConstants[(16 + group * 4) / 20]));
+}
+
+/*
+ Раунды первого блока пары; параллельно с ними считается расписание обоих блоков. В wk четверки
+ слов первого и второго блока чередуются, поэтому раунды второго блока идут уже без расписания.
+ */
+template <int group>
+__attribute__((target("avx2,bmi2"), always_inline)) static inline void avx2Rounds(uint32_t s[5],
+                                                                                  __m256i w[4],
+                                                                                  uint32_t *wk)
+{
+    if constexpr (group < 16)
+    {
+        _mm256_store_si256((__m256i *)(wk + 32 + group * 8), avx2Schedule<group>(w));
+    }
+    scalarRounds<group, 8>(s, wk);
+    if constexpr (group < 19)
+    {
+        avx2Rounds<group + 1>(s, w, wk);
+    }
+}
+
+// Раунды второго блока пары по готовому расписанию
+template <int group>
+__attribute__((target("avx2,bmi2"), always_inline)) static inline void avx2SecondRounds(uint32_t s[5],
+                                                                                        const uint32_t *wk)
+{
+    scalarRounds<group, 8>(s, wk + 4);
+    if constexpr (group < 19)
+    {
+        avx2SecondRounds<group + 1>(s, wk);
+    }
+}
+
+__attribute__((target("avx2,bmi2"))) void sha1CompressAvx2(uint32_t state[5], const unsigned char *data, size_t count)
+{
+    const __m256i byteSwap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                             12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    const __m256i constant = _mm256_set1_epi32((int)SHA1_K0);
+    alignas(32) uint32_t wk[160]; // Слова расписания двух блоков с константой, четверками вперемежку
+    for (; count >= 2; count -= 2, data += 128)
+    {
+        __m256i w[4];
+        for (int i = 0; i < 4; i++)
+        {
+            __m128i first = _mm_loadu_si128((const __m128i *)(data + i * 16));
+            __m128i second = _mm_loadu_si128((const __m128i *)(data + 64 + i * 16));
+            w[i] = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(first), second, 1), byteSwap);
+            _mm256_store_si256((__m256i *)(wk + i * 8), _mm256_add_epi32(w[i], constant));
+        }
+        uint32_t s[5] = {state[0], state[1], state[2], state[3], state[4]};
+        avx2Rounds<0>(s, w, wk);
+        for (int i = 0; i < 5; i++)
+        {
+            state[i] += s[i];
+            s[i] = state[i];
+        }
+        avx2SecondRounds<0>(s, wk);
+        for (int i = 0; i < 5; i++)
+        {
+            state[i] += s[i];
+        }
+    }
+    if (count > 0)
+    {
+        ssse3Block(state, data);
+    }
+}
+
+/*
+ Четыре раунда group (0-19) на инструкциях SHA. msg - четыре последних четверки слов расписания:
+ четверка M[g] лежит в msg[g % 4]; следующие четверки досчитываются по мере освобождения регистров:
+ M[t] = sha1msg2(sha1msg1(M[t-4], M[t-3]) ^ M[t-2], M[t-1]).
+ */
+template <int group>
+__attribute__((target("sha,sse4.1"), always_inline)) static inline void shaNiRounds(__m128i &abcd,
+                                                                                     __m128i &e0,
+                                                                                     __m128i &e1,
+                                                                                     __m128i msg[4])
+{
+    const __m128i current = msg[group % 4];
+    if (group == 0)
+    {
+        e0 = _mm_add_epi32(e0, current);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    }
+    else if (group % 2 == 1)
+    {
+        e1 = _mm_sha1nexte_epu32(e1, current);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, group / 5);
+    }
+    else
+    {
+        e0 = _mm_sha1nexte_epu32(e0, current);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, group / 5);
+    }
+    if (group >= 3 && group <= 18)
+    {
+        msg[(group + 1) % 4] = _mm_sha1msg2_epu32(msg[(group + 1) % 4], current);
+    }
+    if (group >= 1 && group <= 16)
+    {
+        msg[(group + 3) % 4] = _mm_sha1msg1_epu32(msg[(group + 3) % 4], current);
+    }
+    if (group >= 2 && group <= 17)
+    {
+        msg[(group + 2) % 4] = _mm_xor_si128(msg[(group + 2) % 4], current);
+    }
+}
+
+__attribute__((target("sha,sse4.1"))) void sha1CompressShaNi(uint32_t state[5], const unsigned char *data, size_t count)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1b);
+    __m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+    __m128i e1;
+    for (; count > 0; count--, data += 64)
+    {
+        __m128i abcdSaved = abcd;
+        __m128i e0Saved = e0;
+        __m128i msg[4];
+        for (int i = 0; i < 4; i++)
+        {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), byteSwap);
+        }
+        shaNiRounds<0>(abcd, e0, e1, msg);
+        shaNiRounds<1>(abcd, e0, e1, msg);
+        shaNiRounds<2>(abcd, e0, e1, msg);
+        shaNiRounds<3>(abcd, e0, e1, msg);
+        shaNiRounds<4>(abcd, e0, e1, msg);
+        shaNiRounds<5>(abcd, e0, e1, msg);
+        shaNiRounds<6>(abcd, e0, e1, msg);
+        shaNiRounds<7>(abcd, e0, e1, msg);
+        shaNiRounds<8>(abcd, e0, e1, msg);
+        shaNiRounds<9>(abcd, e0, e1, msg);
+        shaNiRounds<10>(abcd, e0, e1, msg);
+        shaNiRounds<11>(abcd, e0, e1, msg);
+        shaNiRounds<12>(abcd, e0, e1, msg);
+        shaNiRounds<13>(abcd, e0, e1, msg);
+        shaNiRounds<14>(abcd, e0, e1, msg);
+        shaNiRounds<15>(abcd, e0, e1, msg);
+        shaNiRounds<16>(abcd, e0, e1, msg);
+        shaNiRounds<17>(abcd, e0, e1, msg);
+        shaNiRounds<18>(abcd, e0, e1, msg);
+        shaNiRounds<19>(abcd, e0, e1, msg);
+        e0 = _mm_sha1nexte_epu32(e0, e0Saved);
+        abcd = _mm_add_epi32(abcd, abcdSaved);
+    }
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+#endif // SHA1_KERNELS_X86
+
+#if defined(SHA1_KERNELS_ARMV8)
+
+#if defined(__clang__)
+#define SHA1_ARMV8_TARGET __attribute__((target("crypto")))
+#else
+#define SHA1_ARMV8_TARGET __attribute__((target("arch=armv8-a+crypto")))
+#endif
+
+bool sha1CpuHasArmv8()
+{
+#if defined(__APPLE__)
+    return true; // Все процессоры Apple на ARM поддерживают расширение
+#elif defined(__linux__)
+    return getauxval(AT_HWCAP) & HWCAP_SHA1;
+#else
+    return false;
+#endif
+}
+
+// Четыре раунда group (0-19); расписание досчитывается так же, как в реализации на SHA-NI
+template <int group>
+SHA1_ARMV8_TARGET __attribute__((always_inline)) static inline void armv8Rounds(uint32x4_t &abcd,
+                                                                                uint32_t &e0,
+                                                                                uint32_t &e1,
+                                                                                uint32x4_t msg[4])
+{
+    static const uint32_t constants[4] = {SHA1_K0, SHA1_K1, SHA1_K2, SHA1_K3};
+    const uint32x4_t current = msg[group % 4];
+    uint32x4_t wk = vaddq_u32(current, vdupq_n_u32(constants[group / 5]));
+    uint32_t &next = group % 2 == 0 ? e1 : e0;
+    uint32_t e = group % 2 == 0 ? e0 : e1;
+    next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    if (group < 5)
+    {
+        abcd = vsha1cq_u32(abcd, e, wk);
+    }
+    else if (group >= 10 && group < 15)
+    {
+        abcd = vsha1mq_u32(abcd, e, wk);
+    }
+    else
+    {
+        abcd = vsha1pq_u32(abcd, e, wk);
+    }
+    if (group >= 3 && group <= 18)
+    {
+        msg[(group + 1) % 4] = vsha1su1q_u32(msg[(group + 1) % 4], current);
+    }
+    if (group >= 2 && group <= 17)
+    {
+        msg[(group + 2) % 4] = vsha1su0q_u32(msg[(group + 2) % 4], msg[(group + 3) % 4], current);
+    }
+}
+
+SHA1_ARMV8_TARGET void sha1CompressArmv8(uint32_t state[5], const unsigned char *data, size_t count)
+{
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32_t e0 = state[4];
+    uint32_t e1 = 0;
+    for (; count > 0; count--, data += 64)
+    {
+        uint32x4_t abcdSaved = abcd;
+        uint32_t e0Saved = e0;
+        uint32x4_t msg[4];
+        for (int i = 0; i < 4; i++)
+        {
+            msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+        }
+        armv8Rounds<0>(abcd, e0, e1, msg);
+        armv8Rounds<1>(abcd, e0, e1, msg);
+        armv8Rounds<2>(abcd, e0, e1, msg);
+        armv8Rounds<3>(abcd, e0, e1, msg);
+        armv8Rounds<4>(abcd, e0, e1, msg);
+        armv8Rounds<5>(abcd, e0, e1, msg);
+        armv8Rounds<6>(abcd, e0, e1, msg);
+        armv8Rounds<7>(abcd, e0, e1, msg);
+        armv8Rounds<8>(abcd, e0, e1, msg);
+        armv8Rounds<9>(abcd, e0, e1, msg);
+        armv8Rounds<10>(abcd, e0, e1, msg);
+        armv8Rounds<11>(abcd, e0, e1, msg);
+        armv8Rounds<12>(abcd, e0, e1, msg);
+        armv8Rounds<13>(abcd, e0, e1, msg);
+        armv8Rounds<14>(abcd, e0, e1, msg);
+        armv8Rounds<15>(abcd, e0, e1, msg);
+        armv8Rounds<16>(abcd, e0, e1, msg);
+        armv8Rounds<17>(abcd, e0, e1, msg);
+        armv8Rounds<18>(abcd, e0, e1, msg);
+        armv8Rounds<19>(abcd, e0, e1, msg);
+        e0 += e0Saved;
+        abcd = vaddq_u32(abcd, abcdSaved);
+    }
+    vst1q_u32(state, abcd);
+    state[4] = e0;
+}
+
+#endif // SHA1_KERNELS_ARMV8
@@ -0,0 +1,35 @@
+#ifndef SHA1KERNELS_H
+#define SHA1KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Сжатие count подряд идущих 64-байтных блоков data в состояние state (a, b, c, d, e)
+typedef void (*Sha1Compress)(uint32_t state[5], const unsigned char *data, size_t count);
+
+// Переносимая реализация (sha1.cpp)
+void sha1CompressScalar(uint32_t state[5], const unsigned char *data, size_t count);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA1_KERNELS_X86 // Доступны реализации для x86
+
+// Расписание сообщения вычисляется векторно (SSSE3) параллельно со скалярными раундами
+void sha1CompressSsse3(uint32_t state[5], const unsigned char *data, size_t count);
+// То же для двух блоков сразу в регистрах AVX2, сдвиги раундов на BMI2
+void sha1CompressAvx2(uint32_t state[5], const unsigned char *data, size_t count);
+// Инструкции SHA (SHA-NI)
+void sha1CompressShaNi(uint32_t state[5], const unsigned char *data, size_t count);
+bool sha1CpuHasSsse3();   // Процессор поддерживает SSSE3
+bool sha1CpuHasAvx2();    // Процессор и система поддерживают AVX2 и BMI2
+bool sha1CpuHasShaNi();   // Процессор поддерживает SHA-NI и SSE4.1
+#endif
+
+#if defined(__aarch64__)
+#define SHA1_KERNELS_ARMV8 // Доступна реализация для ARMv8
+
+// Криптографическое расширение ARMv8 (инструкции SHA1C/SHA1P/SHA1M)
+void sha1CompressArmv8(uint32_t state[5], const unsigned char *data, size_t count);
+bool sha1CpuHasArmv8();   // Процессор поддерживает инструкции SHA1
+#endif
+
+#endif                    // SHA1KERNELS_H
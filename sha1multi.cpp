@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "sha1multi.h"
+
+#define SHA1_MULTI_ROL(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+
+// Векторы из 4, 8 и 16 слов: операции над ними компилируются в инструкции целевого набора функции
+typedef uint32_t Vector4 __attribute__((vector_size(16)));
+typedef uint32_t Vector8 __attribute__((vector_size(32)));
+typedef uint32_t Vector16 __attribute__((vector_size(64)));
+
+// Следующее слово расписания сообщения (t >= 16), хранится в кольцевом буфере из 16 слов
+#define SHA1_MULTI_SCHEDULE(w, t)                                                                                      \
+    (w[(t) & 15] = SHA1_MULTI_ROL(w[((t) + 13) & 15] ^ w[((t) + 8) & 15] ^ w[((t) + 2) & 15] ^ w[(t) & 15], 1))
+
+// Раунд SHA-1 во всех дорожках
+#define SHA1_MULTI_ROUND(f, k, word)                                                                                   \
+    {                                                                                                                  \
+        Vector temp = SHA1_MULTI_ROL(a, 5) + (f) + e + (word) + (uint32_t)(k);                                         \
+        e = d;                                                                                                         \
+        d = c;                                                                                                         \
+        c = SHA1_MULTI_ROL(b, 30);                                                                                     \
+        b = a;                                                                                                         \
+        a = temp;                                                                                                      \
+    }
+
+// Сжатие очередного блока каждой дорожки; blocks[lane] - 64 байта сообщения дорожки
+template <typename Vector, int lanes>
+__attribute__((always_inline)) static inline void compressLanes(Vector state[5], const unsigned char *const blocks[])
+{
+    Vector w[16];
+    for (int t = 0; t < 16; t++)
+    {
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            uint32_t word;
+            memcpy(&word, blocks[lane] + 4 * t, 4);
+            w[t][lane] = __builtin_bswap32(word);
+        }
+    }
+    Vector a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    int t = 0;
+    for (; t < 16; t++)
+    {
+        SHA1_MULTI_ROUND(((c ^ d) & b) ^ d, 0x5a827999, w[t]);
+    }
+    for (; t < 20; t++)
+    {
+        SHA1_MULTI_ROUND(((c ^ d) & b) ^ d, 0x5a827999, SHA1_MULTI_SCHEDULE(w, t));
+    }
+    for (; t < 40; t++)
+    {
+        SHA1_MULTI_ROUND(b ^ c ^ d, 0x6ed9eba1, SHA1_MULTI_SCHEDULE(w, t));
+    }
+    for (; t < 60; t++)
+    {
+        SHA1_MULTI_ROUND((b & c) | ((b | c) & d), 0x8f1bbcdc, SHA1_MULTI_SCHEDULE(w, t));
+    }
+    for (; t < 80; t++)
+    {
+        SHA1_MULTI_ROUND(b ^ c ^ d, 0xca62c1d6, SHA1_MULTI_SCHEDULE(w, t));
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+// Хэши не более lanes сообщений; недостающие дорожки повторяют первое сообщение, их результат отбрасывается
+template <typename Vector, int lanes>
+__attribute__((always_inline)) static inline void hashLanes(const char *const data[],
+                                                           size_t count,
+                                                           size_t length,
+                                                           Sha1Digest digests[])
+{
+    const unsigned char *messages[lanes];
+    for (int lane = 0; lane < lanes; lane++)
+    {
+        messages[lane] = (const unsigned char *)data[(size_t)lane < count ? lane : 0];
+    }
+    const uint32_t initial[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    Vector state[5];
+    for (int i = 0; i < 5; i++)
+    {
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            state[i][lane] = initial[i];
+        }
+    }
+
+    const unsigned char *blocks[lanes];
+    size_t fullBlocks = length / 64;
+    for (size_t block = 0; block < fullBlocks; block++)
+    {
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            blocks[lane] = messages[lane] + block * 64;
+        }
+        compressLanes<Vector, lanes>(state, blocks);
+    }
+
+    // Остаток сообщения, бит 1 и длина в битах занимают один или два последних блока
+    size_t tail = length % 64;
+    size_t paddingBlocks = tail + 9 <= 64 ? 1 : 2;
+    uint64_t bits = (uint64_t)length * 8;
+    unsigned char padding[lanes][128];
+    for (int lane = 0; lane < lanes; lane++)
+    {
+        unsigned char *last = padding[lane];
+        memcpy(last, messages[lane] + fullBlocks * 64, tail);
+        last[tail] = 0x80;
+        memset(last + tail + 1, 0, paddingBlocks * 64 - tail - 1);
+        for (int i = 0; i < 8; i++)
+        {
+            last[paddingBlocks * 64 - 1 - i] = (unsigned char)(bits >> (8 * i));
+        }
+    }
+    for (size_t block = 0; block < paddingBlocks; block++)
+    {
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            blocks[lane] = padding[lane] + block * 64;
+        }
+        compressLanes<Vector, lanes>(state, blocks);
+    }
+
+    for (size_t lane = 0; lane < count && lane < (size_t)lanes; lane++)
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            uint32_t word = __builtin_bswap32(state[i][lane]);
+            memcpy(&digests[lane][4 * i], &word, 4);
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx512f"))) static void hashLanes16(const char *const data[],
+                                                           size_t count,
+                                                           size_t length,
+                                                           Sha1Digest digests[])
+{
+    hashLanes<Vector16, 16>(data, count, length, digests);
+}
+
+__attribute__((target("avx2"))) static void hashLanes8(const char *const data[],
+                                                       size_t count,
+                                                       size_t length,
+                                                       Sha1Digest digests[])
+{
+    hashLanes<Vector8, 8>(data, count, length, digests);
+}
+#endif
+
+// SSE2 на x86-64, NEON на ARMv8
+static void hashLanes4(const char *const data[], size_t count, size_t length, Sha1Digest digests[])
+{
+    hashLanes<Vector4, 4>(data, count, length, digests);
+}
+
+// Ширина векторной реализации на этом процессоре
+static int widestLanes()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const int lanes = __builtin_cpu_supports("avx512f") ? 16 : __builtin_cpu_supports("avx2") ? 8 : 4;
+    return lanes;
+#else
+    return 4;
+#endif
+}
+
+int sha1MultiBufferLanes()
+{
+    // Четыре дорожки медленнее одного потока на инструкциях SHA (SHA-NI, ARMv8)
+    SHA1::Kernel kernel = SHA1::getKernel();
+    if (widestLanes() == 4 && (kernel == SHA1::kernelShaNi || kernel == SHA1::kernelArmv8))
+    {
+        return 1;
+    }
+    return widestLanes();
+}
+
+void sha1MultiBuffer(const char *const data[], size_t count, size_t length, Sha1Digest digests[])
+{
+    int lanes = sha1MultiBufferLanes();
+    if (lanes == 1)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            digests[i] = sha1Digest(data[i], length);
+        }
+        return;
+    }
+    for (size_t first = 0; first < count; first += lanes)
+    {
+        size_t group = std::min<size_t>(lanes, count - first);
+#if defined(__x86_64__) || defined(__i386__)
+        if (lanes == 16)
+        {
+            hashLanes16(data + first, group, length, digests + first);
+            continue;
+        }
+        if (lanes == 8)
+        {
+            hashLanes8(data + first, group, length, digests + first);
+            continue;
+        }
+#endif
+        hashLanes4(data + first, group, length, digests + first);
+    }
+}
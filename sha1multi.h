@@ -0,0 +1,22 @@
+#ifndef SHA1MULTI_H
+#define SHA1MULTI_H
+
+#include <cstddef>
+
+#include "sha1.h"
+
+/*
+ Многопоточное (multi-buffer) вычисление SHA-1: несколько независимых сообщений одинаковой длины
+ хешируются одновременно, каждое в своей дорожке векторного регистра (4 дорожки SSE2/NEON,
+ 8 - AVX2, 16 - AVX-512). Один поток SHA-1 не распараллеливается из-за зависимостей между
+ раундами, а независимые фрагменты (перепроверка, пачка завершенных фрагментов) - без труда.
+ */
+
+// Количество дорожек самой широкой доступной реализации (1, если она не быстрее одного потока SHA-1)
+int sha1MultiBufferLanes();
+
+// Хэши count сообщений data[i] длины length в digests[i].
+// count может быть любым: сообщения обрабатываются группами по sha1MultiBufferLanes()
+void sha1MultiBuffer(const char *const data[], size_t count, size_t length, Sha1Digest digests[]);
+
+#endif // SHA1MULTI_H
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "connect.h"
+#include "storage.h"
+
+#define SEND_BUFFER_SIZE 131072 // Буфер отдачи через readBlock (не меньше наибольшего запроса пира)
+
+bool Storage::isReadable() const
+{
+    return true;
+}
+
+bool Storage::hasData() const
+{
+    return false;
+}
+
+void Storage::send(int sock, long offset, long length, RateLimiter *limiter)
+{
+    thread_local std::vector<char> buffer(SEND_BUFFER_SIZE);
+    while (length > 0)
+    {
+        long chunk = std::min<long>(length, buffer.size());
+        readBlock(offset, buffer.data(), chunk);
+        sendMemoryData(sock, buffer.data(), chunk, limiter);
+        offset += chunk;
+        length -= chunk;
+    }
+}
+
+MemoryStorage::MemoryStorage(long totalLength) : totalLength(totalLength)
+{
+}
+
+void MemoryStorage::open()
+{
+}
+
+void MemoryStorage::preallocate()
+{
+    data.resize(totalLength);
+}
+
+void MemoryStorage::writePiece(long offset, const struct iovec *buffers, int count)
+{
+    // Размер выделяется в preallocate: при записи из нескольких потоков вектор не перераспределяется
+    for (int i = 0; i < count; i++)
+    {
+        if (offset < 0 || offset + (long)buffers[i].iov_len > (long)data.size())
+        {
+            throw std::runtime_error("Запись за пределы данных торрента");
+        }
+        memcpy(data.data() + offset, buffers[i].iov_base, buffers[i].iov_len);
+        offset += buffers[i].iov_len;
+    }
+}
+
+void MemoryStorage::readBlock(long offset, char *data, long length)
+{
+    if (offset < 0 || length < 0 || offset + length > (long)this->data.size())
+    {
+        throw std::runtime_error("Запрошенный участок выходит за пределы данных торрента");
+    }
+    memcpy(data, this->data.data() + offset, length);
+}
+
+void MemoryStorage::flush()
+{
+}
+
+const std::vector<char> &MemoryStorage::getData() const
+{
+    return data;
+}
+
+NullStorage::NullStorage(PieceHandler handler) : handler(std::move(handler))
+{
+}
+
+void NullStorage::open()
+{
+}
+
+void NullStorage::preallocate()
+{
+}
+
+void NullStorage::writePiece(long offset, const struct iovec *buffers, int count)
+{
+    if (handler)
+    {
+        handler(offset, buffers, count);
+    }
+}
+
+void NullStorage::readBlock(long, char *, long)
+{
+    throw std::runtime_error("Хранилище-приемник не сохраняет данные");
+}
+
+void NullStorage::flush()
+{
+}
+
+bool NullStorage::isReadable() const
+{
+    return false;
+}
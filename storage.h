@@ -0,0 +1,70 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <functional>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+#include "ratelimiter.h"
+
+/*
+ Хранилище данных торрента. PieceManager записывает в него проверенные фрагменты и читает
+ из него блоки для отдачи пирам; смещения отсчитываются от начала общих данных торрента.
+ Записи разных фрагментов не пересекаются и могут выполняться из разных потоков одновременно.
+ */
+class Storage {
+    public:
+    virtual ~Storage() = default;
+    virtual void open() = 0;             // Подготовка к работе (std::runtime_error, если невозможна)
+    virtual void preallocate() = 0;      // Резервирование места под данные
+    // Запись проверенного фрагмента: буферы подряд начиная с offset
+    virtual void writePiece(long offset, const struct iovec *buffers, int count) = 0;
+    virtual void readBlock(long offset, char *data, long length) = 0; // Чтение length байт с offset
+    virtual void flush() = 0;            // Сброс записанных данных на носитель
+    virtual bool isReadable() const;     // Можно ли читать записанные данные (отдавать их пирам)
+    virtual bool hasData() const;        // Были ли данные до open (стоит ли перепроверять фрагменты)
+    // Отдача length байт с offset в сокет; по умолчанию через readBlock и промежуточный буфер
+    virtual void send(int sock, long offset, long length, RateLimiter *limiter = nullptr);
+};
+
+// Хранилище в памяти: для тестов и промежуточных уровней кэширования
+class MemoryStorage : public Storage {
+    private:
+    const long totalLength;              // Общий размер данных
+    std::vector<char> data;              // Данные торрента
+
+    public:
+    explicit MemoryStorage(long totalLength); // Конструктор класса
+    void open() override;
+    void preallocate() override;
+    void writePiece(long offset, const struct iovec *buffers, int count) override;
+    void readBlock(long offset, char *data, long length) override;
+    void flush() override;
+    const std::vector<char> &getData() const; // Записанные данные
+};
+
+/*
+ Хранилище-приемник: данные проверенного фрагмента передаются обработчику (если он задан)
+ и отбрасываются. Позволяет измерять сеть и планировщик без участия диска или встроить
+ загрузку в конвейер, потребляющий фрагменты напрямую. Отдавать пирам нечего.
+ */
+class NullStorage : public Storage {
+    public:
+    // Получатель фрагмента; буферы действительны только во время вызова
+    using PieceHandler = std::function<void(long offset, const struct iovec *buffers, int count)>;
+
+    private:
+    PieceHandler handler;                // Получатель фрагментов
+
+    public:
+    explicit NullStorage(PieceHandler handler = nullptr); // Конструктор класса
+    void open() override;
+    void preallocate() override;
+    void writePiece(long offset, const struct iovec *buffers, int count) override;
+    void readBlock(long offset, char *data, long length) override; // std::runtime_error: данных нет
+    void flush() override;
+    bool isReadable() const override;
+};
+
+#endif                                   // STORAGE_H
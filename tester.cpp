@@ -1,11 +1,48 @@
 #include "tester.h"
 #include "bencode.h"
+#include "bittorrentmessage.h"
+#include "choker.h"
+#include "connect.h"
+#include "dht.h"
+#include "eventloop.h"
+#include "filestorage.h"
+#include "hashqueue.h"
+#include "httpclient.h"
+#include "peerconnection.h"
+#include "peercache.h"
+#include "peerexchange.h"
+#include "peerretriever.h"
 #include "piece.h"
+#include "piececache.h"
+#include "piecemanager.h"
+#include "ratelimiter.h"
+#include "resolver.h"
 #include "sha1.h"
+#include "sha1multi.h"
+#include "trackermanager.h"
+#include "udptracker.h"
+#include "utils.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <ostream>
+#include <set>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 #include <unordered_map>
+#include <zlib.h>
 
 void runTests()
 {
@@ -151,9 +188,158 @@ void runSHA1()
         assert(hash == expected_hash);
     }
 
+    // Двоичный хеш: потоковые части разных типов дают тот же результат, что и вызов целиком
+    {
+        const uint8_t part[] = {'b', 'c'};
+        SHA1 checksum;
+        checksum.update("a", 1);
+        checksum.update(part, sizeof(part));
+        Sha1Digest digest = checksum.final();
+        assert(digest == sha1Digest("abc") && digest[0] == 0xa9 && digest[19] == 0x9d);
+        assert(sha1Hex(digest) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+    }
+
+    // Контрольные значения FIPS 180 и длины на границах блока для каждой доступной реализации
+    const std::vector<std::pair<std::string, std::string>> vectors = {
+        {"", "da39a3ee5e6b4b0d3255bfef95601890afd80709"},
+        {"abc", "a9993e364706816aba3e25717850c26c9cd0d89d"},
+        {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "84983e441c3bd26ebaae4aa1f95129e5e54670f1"},
+        {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrst"
+         "nopqrstu",
+         "a49b2446a02c645bf419f995b67091253a04a259"},
+        {std::string(1000000, 'a'), "34aa973cd4c4daa4f61eeb2bdbad27316534016f"},
+    };
+    SHA1::Kernel detected = SHA1::getKernel();
+    std::string reference; // Хэши разных длин от переносимой реализации
+    for (SHA1::Kernel kernel :
+         {SHA1::kernelScalar, SHA1::kernelSsse3, SHA1::kernelAvx2, SHA1::kernelShaNi, SHA1::kernelArmv8})
+    {
+        if (!SHA1::isSupported(kernel))
+        {
+            std::cout << "SHA1 kernel " << SHA1::getKernelName(kernel) << ": not supported" << std::endl;
+            continue;
+        }
+        SHA1::setKernel(kernel);
+        for (const auto &vector : vectors)
+        {
+            assert(sha1(vector.first) == vector.second);
+        }
+        // Данные подаются частями разной длины, чтобы задеть буфер неполного блока
+        std::string hashes;
+        std::string data;
+        for (int length = 0; length < 300; length++)
+        {
+            data += (char)(length * 131 + 7);
+            SHA1 checksum;
+            for (size_t offset = 0; offset < data.size(); offset += 1 + length % 70)
+            {
+                checksum.update(data.data() + offset, std::min<size_t>(1 + length % 70, data.size() - offset));
+            }
+            hashes += sha1Hex(checksum.final());
+        }
+        if (reference.empty())
+        {
+            reference = hashes;
+        }
+        assert(hashes == reference);
+        std::cout << "SHA1 kernel " << SHA1::getKernelName(kernel) << ": OK" << std::endl;
+    }
+    SHA1::setKernel(detected);
+
+    // Многопоточное хеширование: неполные пачки и длины на границах блока, сверка с sha1()
+    for (size_t length : {0, 1, 55, 56, 63, 64, 65, 119, 120, 16384, 16385})
+    {
+        for (size_t count : {1, 3, 4, 5, 8, 9, 16, 17})
+        {
+            std::vector<std::string> messages(count);
+            std::vector<const char *> data;
+            for (size_t i = 0; i < count; i++)
+            {
+                for (size_t j = 0; j < length; j++)
+                {
+                    messages[i] += (char)(i * 31 + j * 7);
+                }
+                data.push_back(messages[i].data());
+            }
+            std::vector<Sha1Digest> digests(count);
+            sha1MultiBuffer(data.data(), count, length, digests.data());
+            for (size_t i = 0; i < count; i++)
+            {
+                assert(digests[i] == sha1Digest(messages[i]));
+            }
+        }
+    }
+    std::cout << "SHA1 multi-buffer (" << sha1MultiBufferLanes() << " lanes): OK" << std::endl;
+
+    // Очередь проверки: задания разной длины, обработчики из рабочих потоков
+    {
+        std::atomic<int> matched{0};
+        HashQueue queue(2);
+        for (int i = 0; i < 50; i++)
+        {
+            std::string data(1000 + (i % 3) * 64, (char)i);
+            Sha1Digest expected = sha1Digest(data);
+            queue.submit(std::move(data), [expected, &matched](const Sha1Digest &digest) {
+                if (digest == expected)
+                {
+                    matched++;
+                }
+            });
+        }
+        queue.wait();
+        assert(matched == 50);
+    }
+
     std::cout << "All SHA1 tests passed successfully!" << std::endl;
 }
 
+void runSHA1Benchmark()
+{
+    const size_t size = 64 << 20; // Объем хешируемых данных
+    std::string data(size, 0);
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = (char)(i * 2654435761u >> 24);
+    }
+    SHA1::Kernel detected = SHA1::getKernel();
+    for (SHA1::Kernel kernel :
+         {SHA1::kernelScalar, SHA1::kernelSsse3, SHA1::kernelAvx2, SHA1::kernelShaNi, SHA1::kernelArmv8})
+    {
+        if (!SHA1::isSupported(kernel))
+        {
+            continue;
+        }
+        SHA1::setKernel(kernel);
+        // Лучший из нескольких проходов, чтобы не зависеть от соседней нагрузки и частоты процессора
+        std::string hash;
+        double seconds = 0;
+        for (int pass = 0; pass < 3; pass++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            hash = sha1(data);
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            seconds = pass == 0 ? elapsed : std::min(seconds, elapsed);
+        }
+        std::cout << "SHA1 " << SHA1::getKernelName(kernel) << ": " << (int)(size / seconds / (1 << 20)) << " MB/s ("
+                  << hash << ")" << std::endl;
+    }
+    SHA1::setKernel(detected);
+
+    // Многопоточное хеширование: те же данные, разбитые на фрагменты по 1 МБ
+    const size_t pieceSize = 1 << 20;
+    std::vector<const char *> pieces;
+    for (size_t offset = 0; offset < size; offset += pieceSize)
+    {
+        pieces.push_back(data.data() + offset);
+    }
+    std::vector<Sha1Digest> digests(pieces.size());
+    auto start = std::chrono::steady_clock::now();
+    sha1MultiBuffer(pieces.data(), pieces.size(), pieceSize, digests.data());
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "SHA1 multi-buffer x" << sha1MultiBufferLanes() << ": " << (int)(size / seconds / (1 << 20))
+              << " MB/s" << std::endl;
+}
+
 void runPiece()
 {
     std::vector<Block *> blocks;
@@ -218,8 +404,1051 @@ void runPiece()
         std::cout << "Reset() method is incorrect!" << std::endl;
     }
 
+    // Блоки приходят не по порядку: хэш догоняет их, когда заполняется пропуск
+    {
+        std::string data;
+        for (int i = 0; i < 3000; i++)
+        {
+            data += (char)(i * 7);
+        }
+        std::vector<Block *> parts;
+        for (int i = 0; i < 3; ++i)
+        {
+            parts.push_back(new Block{1, i * 1000, 1000, BlockStatus::Missing, ""});
+        }
+        Sha1Digest digest = sha1Digest(data);
+        Piece ordered(1, parts, std::string(digest.begin(), digest.end()));
+        for (int i : {2, 0, 1})
+        {
+            ordered.blockReceived(i * 1000, data.substr(i * 1000, 1000));
+        }
+        assert(ordered.isHashMatching());
+
+        ordered.reset();
+        for (int i : {1, 2, 0})
+        {
+            ordered.blockReceived(i * 1000, i == 1 ? std::string(1000, 'x') : data.substr(i * 1000, 1000));
+        }
+        assert(!ordered.isHashMatching());
+        std::cout << "Incremental piece hash works correctly!" << std::endl;
+    }
+
     for (auto block : blocks)
     {
         delete block;
     }
 }
+
+void runDht()
+{
+    // Рой узлов на loopback: все подключаются к первому, один анонсирует торрент, другой его находит
+    const int basePort = 16881;
+    const int nodeCount = 8;
+    std::vector<std::unique_ptr<DhtNode>> nodes;
+    for (int i = 0; i < nodeCount; ++i)
+    {
+        nodes.push_back(std::make_unique<DhtNode>(basePort + i));
+        assert(nodes.back()->start());
+    }
+    for (int i = 1; i < nodeCount; ++i)
+    {
+        nodes[i]->bootstrap({{"127.0.0.1", basePort}});
+    }
+    for (int i = 0; i < nodeCount; ++i)
+    {
+        assert(nodes[i]->getNodeCount() > 0);
+    }
+
+    Sha1Digest digest = sha1Digest("dht test torrent");
+    std::string infoHash(digest.begin(), digest.end());
+    std::vector<Peer> announced = nodes[3]->getPeers(infoHash, 6000);
+    assert(announced.empty());
+
+    std::vector<Peer> found = nodes[6]->getPeers(infoHash);
+    assert(found.size() == 1);
+    assert(found[0].ip() == "127.0.0.1");
+    assert(found[0].port() == 6000);
+
+    // Поиск через молчащий узел прерывается флагом, не дожидаясь тайм-аута запроса (2 с)
+    std::atomic<bool> cancelled{false};
+    std::thread canceller([&cancelled]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        cancelled = true;
+    });
+    auto start = std::chrono::steady_clock::now();
+    nodes[7]->bootstrap({{"127.0.0.1", basePort + nodeCount}}, &cancelled);
+    canceller.join();
+    assert(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(1000));
+
+    for (auto &node : nodes)
+    {
+        node->stop();
+    }
+    std::cout << "All DHT tests passed successfully!" << std::endl;
+}
+
+// Сжатие gzip для подставного сервера
+static std::string gzipCompress(const std::string &data)
+{
+    z_stream stream{};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    std::string output(deflateBound(&stream, data.size()) + 32, '\0');
+    stream.next_in = (Bytef *)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef *)&output[0];
+    stream.avail_out = output.size();
+    deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return output;
+}
+
+// Подставной HTTP-сервер на loopback: каждое соединение обслуживается своим потоком до закрытия клиентом
+class StandInServer {
+    private:
+    int listenSock;
+    int port;
+    std::atomic<int> accepted{0};
+    std::thread acceptor;
+
+    static std::string reply(const std::string &target)
+    {
+        if (target == "/plain")
+        {
+            return "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+        }
+        if (target == "/chunked")
+        {
+            return "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3;ext=1\r\nhel\r\n8\r\nlo world\r\n0\r\nX-Trailer: 1\r\n\r\n";
+        }
+        if (target == "/gzip")
+        {
+            std::string body = gzipCompress(std::string(10000, 'z'));
+            return "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: " + std::to_string(body.size()) +
+                   "\r\n\r\n" + body;
+        }
+        if (target == "/close")
+        {
+            return "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\nuntil close";
+        }
+        if (target.compare(0, 9, "/announce") == 0 && target.find("&event=completed") != std::string::npos)
+        {
+            // Анонс завершения загрузки: раздающему пиры от трекера не нужны
+            std::string body = "d8:intervali900e5:peers0:e";
+            return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        }
+        if (target.compare(0, 9, "/announce") == 0)
+        {
+            // Сжатый ответ частями: interval, min interval и два компактных пира
+            std::string body = "d8:completei3e10:incompletei4e8:intervali900e12:min intervali60e5:peers12:" +
+                               Peer("10.0.0.1", 6881).compact() + Peer("10.0.0.2", 6882).compact() + "e";
+            body = gzipCompress(body);
+            std::string half = body.substr(0, body.size() / 2);
+            std::string rest = body.substr(body.size() / 2);
+            std::stringstream chunks;
+            chunks << std::hex << half.size() << "\r\n" << half << "\r\n" << rest.size() << "\r\n" << rest << "\r\n0\r\n\r\n";
+            return "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n\r\n" + chunks.str();
+        }
+        if (target.compare(0, 7, "/scrape") == 0)
+        {
+            std::string body = "d5:filesd20:" + std::string(20, '\xab') + "d8:completei5e10:downloadedi50e10:incompletei6eeee";
+            return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        }
+        return ""; // /slow: ответа нет, клиент должен завершить запрос по тайм-ауту
+    }
+
+    static void serve(int sock)
+    {
+        std::string input;
+        char buffer[4096];
+        ssize_t received;
+        while ((received = recv(sock, buffer, sizeof(buffer), 0)) > 0)
+        {
+            input.append(buffer, received);
+            size_t end;
+            while ((end = input.find("\r\n\r\n")) != std::string::npos)
+            {
+                std::string target = input.substr(4, input.find(' ', 4) - 4);
+                input.erase(0, end + 4);
+                std::string response = reply(target);
+                send(sock, response.data(), response.size(), MSG_NOSIGNAL);
+                if (target == "/close")
+                {
+                    close(sock);
+                    return;
+                }
+            }
+        }
+        close(sock);
+    }
+
+    public:
+    StandInServer()
+    {
+        listenSock = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listenSock, (struct sockaddr *)&address, sizeof(address));
+        socklen_t length = sizeof(address);
+        getsockname(listenSock, (struct sockaddr *)&address, &length);
+        port = ntohs(address.sin_port);
+        listen(listenSock, 16);
+        acceptor = std::thread([this]() {
+            int sock;
+            while ((sock = accept(listenSock, nullptr, nullptr)) >= 0)
+            {
+                accepted++;
+                std::thread(serve, sock).detach();
+            }
+        });
+    }
+
+    ~StandInServer()
+    {
+        shutdown(listenSock, SHUT_RDWR);
+        close(listenSock);
+        acceptor.join();
+    }
+
+    std::string url(const std::string &target) const
+    {
+        return "http://127.0.0.1:" + std::to_string(port) + target;
+    }
+
+    int getAccepted() const
+    {
+        return accepted;
+    }
+};
+
+void runHttpClient()
+{
+    StandInServer server;
+    EventLoop loop;
+    HttpClient client(loop);
+    std::vector<std::string> results;
+    auto record = [&](HttpResponse response) {
+        results.push_back(std::to_string(response.status) + " " + response.body);
+    };
+    loop.addTimer(10000, [&]() { loop.stop(); }, false);
+
+    // Запросы выполняются друг за другом, чтобы проверить повторное использование соединения
+    client.get(server.url("/plain"), {}, 2000, [&](HttpResponse response) {
+        record(response);
+        client.get(server.url("/chunked"), {}, 2000, [&](HttpResponse response) {
+            record(response);
+            client.get(server.url("/gzip"), {}, 2000, [&](HttpResponse response) {
+                record(response);
+                assert(client.getConnectionCount() == 1);
+                assert(server.getAccepted() == 1);
+                client.get(server.url("/close"), {}, 2000, [&](HttpResponse response) {
+                    record(response);
+                    client.get(server.url("/slow"), {}, 300, [&](HttpResponse response) {
+                        assert(response.status == 0 && !response.error.empty());
+                        loop.stop();
+                    });
+                });
+            });
+        });
+    });
+    loop.run();
+    assert(results.size() == 4);
+    assert(results[0] == "200 hello");
+    assert(results[1] == "200 hello world");
+    assert(results[2] == "200 " + std::string(10000, 'z'));
+    assert(results[3] == "200 until close");
+
+    // Анонс и scrape через PeerRetriever поверх того же клиента
+    std::string infoHash(20, '\xab');
+    auto retriever = std::make_shared<PeerRetriever>(std::string(20, 'p'), server.url("/announce"), infoHash, 6881, 100);
+    std::vector<Peer> peers;
+    bool scraped = false;
+    retriever->retrievePeers(client, 0, 0, 50, eventNone, [&](std::vector<Peer> received) {
+        peers = std::move(received);
+        retriever->scrape(client, [&](bool success) {
+            scraped = success;
+            loop.stop();
+        });
+    });
+    loop.run();
+    assert(peers.size() == 2 && peers[1].ip() == "10.0.0.2" && peers[1].port() == 6882);
+    assert(retriever->getInterval() == 900 && retriever->getMinInterval() == 60);
+    assert(scraped && retriever->getSeeders() == 5 && retriever->getLeechers() == 6 && retriever->getCompleted() == 50);
+
+    // Событие завершения загрузки передается трекеру параметром event
+    retriever->retrievePeers(client, 100, 0, 50, eventCompleted, [&](std::vector<Peer> received) {
+        peers = std::move(received);
+        loop.stop();
+    });
+    loop.run();
+    assert(peers.empty() && retriever->getInterval() == 900);
+
+    // HTTPS не поддерживается: запрос завершается явной ошибкой
+    std::string error;
+    client.get("https://tracker.example/announce", {}, 1000, [&](HttpResponse response) {
+        error = response.error;
+        loop.stop();
+    });
+    loop.run();
+    assert(error.rfind("HTTPS не поддерживается", 0) == 0);
+    std::cout << "All HTTP client tests passed successfully!" << std::endl;
+}
+
+void runRateLimiter()
+{
+    using Clock = std::chrono::steady_clock;
+    auto elapsed = [](Clock::time_point start) { return std::chrono::duration<double>(Clock::now() - start).count(); };
+
+    // Пир без собственного лимита ограничен лимитом торрента: сверх емкости корзины (16 КБ)
+    // 48 КБ при 100 КБ/с передаются около 0.5 с
+    {
+        RateLimiter torrent(nullptr, 100000, 16384);
+        RateLimiter peer(&torrent);
+        auto start = Clock::now();
+        for (int i = 0; i < 4; i++)
+        {
+            peer.acquire(16384);
+        }
+        double seconds = elapsed(start);
+        assert(seconds > 0.4 && seconds < 1.0);
+    }
+
+    // Лимит пира строже лимита торрента - действует лимит пира: 50 КБ сверх корзины за 1 с
+    {
+        RateLimiter torrent(nullptr, 1000000);
+        RateLimiter peer(&torrent, 50000, 25000);
+        auto start = Clock::now();
+        for (int i = 0; i < 3; i++)
+        {
+            peer.acquire(25000);
+        }
+        double seconds = elapsed(start);
+        assert(seconds > 0.8 && seconds < 1.5);
+    }
+
+    // Фактическая скорость измеряется на каждом уровне цепочки
+    {
+        RateLimiter torrent(nullptr, 100000, 16384);
+        RateLimiter peer(&torrent);
+        auto start = Clock::now();
+        while (elapsed(start) < 1.3)
+        {
+            peer.acquire(10000);
+        }
+        double torrentRate = torrent.getThroughput();
+        double peerRate = peer.getThroughput();
+        std::cout << "RateLimiter throughput: " << (long)torrentRate << " B/s" << std::endl;
+        // Первое окно усредняется с нулевым начальным значением, поэтому нижняя граница - половина лимита
+        assert(torrentRate > 40000 && torrentRate < 150000);
+        assert(peerRate > 40000 && peerRate < 150000);
+        assert(torrent.getUtilization() > 0.4 && torrent.getUtilization() <= 1.0);
+        assert(peer.getUtilization() == 0);
+    }
+    std::cout << "All RateLimiter tests passed successfully!" << std::endl;
+}
+
+void runChoker()
+{
+    // Соединения в choose не разыменовываются, поэтому вместо них подставляются различимые адреса
+    char storage[6];
+    PeerConnection *peers[6];
+    for (int i = 0; i < 6; i++)
+    {
+        peers[i] = reinterpret_cast<PeerConnection *>(&storage[i]);
+    }
+    auto contains = [](const std::vector<PeerConnection *> &list, PeerConnection *connection) {
+        return std::find(list.begin(), list.end(), connection) != list.end();
+    };
+    // Скорости 60, 50, ..., 10: четыре слота по скорости и один оптимистичный
+    auto candidates = [&peers]() {
+        std::vector<Choker::Candidate> result;
+        for (int i = 5; i >= 0; i--)
+        {
+            result.emplace_back(60 - 10 * i, peers[i]);
+        }
+        return result;
+    };
+
+    Choker choker(4, 1);
+    std::vector<PeerConnection *> unchoked = choker.choose(candidates());
+    assert(unchoked.size() == 5);
+    for (int i = 0; i < 4; i++)
+    {
+        assert(unchoked[i] == peers[i]);
+    }
+    PeerConnection *first = unchoked[4];
+    assert(first == peers[4] || first == peers[5]);
+    PeerConnection *second = first == peers[4] ? peers[5] : peers[4];
+
+    // Оптимистичный пир держится три пересчета, затем слот переходит к тому, кто в нем не был
+    for (int tick = 1; tick < 3; tick++)
+    {
+        unchoked = choker.choose(candidates());
+        assert(unchoked.size() == 5 && unchoked[4] == first);
+    }
+    unchoked = choker.choose(candidates());
+    assert(unchoked.size() == 5 && unchoked[4] == second);
+    for (int tick = 4; tick < 6; tick++)
+    {
+        assert(choker.choose(candidates())[4] == second);
+    }
+    assert(choker.choose(candidates())[4] == first);
+
+    // Оптимистичный пир, прошедший по скорости, освобождает слот сразу
+    std::vector<Choker::Candidate> faster = candidates();
+    for (auto &candidate : faster)
+    {
+        if (candidate.second == first)
+        {
+            candidate.first = 100;
+        }
+    }
+    unchoked = choker.choose(faster);
+    assert(unchoked.size() == 5 && unchoked[0] == first && unchoked[4] != first);
+    assert(!contains(unchoked, peers[3]) || unchoked[4] == peers[3]);
+
+    // Кандидатов меньше, чем слотов: разблокируются все, незаинтересованные в выбор не попадают
+    Choker small(4, 1);
+    unchoked = small.choose({{5, peers[0]}, {7, peers[1]}});
+    assert(unchoked.size() == 2 && unchoked[0] == peers[1] && unchoked[1] == peers[0]);
+    assert(!contains(small.choose({}), peers[0]));
+
+    // Заинтересовавшийся пир занимает свободный слот сразу, без ожидания пересчета
+    std::vector<std::unique_ptr<PeerConnection>> connections;
+    Choker slots(1, 1);
+    for (int i = 0; i < 3; i++)
+    {
+        connections.push_back(std::make_unique<PeerConnection>(nullptr, "", Sha1Digest{}, nullptr, nullptr,
+                                                               nullptr, nullptr));
+        if (i < 2)
+        {
+            slots.addConnection(connections.back().get());
+        }
+    }
+    assert(slots.interested(connections[0].get()) && slots.interested(connections[0].get()));
+    assert(slots.interested(connections[1].get()));
+    assert(!slots.interested(connections[2].get())); // Не зарегистрирован
+    slots.removeConnection(connections[1].get());
+    slots.addConnection(connections[2].get());
+    assert(slots.interested(connections[2].get()));
+    slots.addConnection(connections[1].get());
+    assert(!slots.interested(connections[1].get())); // Слоты заняты
+
+    // Молчание пира не ошибка: ожидание данных просто истекает
+    int sockets[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    assert(!waitForData(sockets[1], 10));
+    sendData(sockets[0], std::string(4, '\0'));
+    assert(waitForData(sockets[1], 10) && receiveData(sockets[1]).empty());
+    close(sockets[0]);
+    close(sockets[1]);
+    std::cout << "All Choker tests passed successfully!" << std::endl;
+}
+
+void runAllowedFast()
+{
+    // Пример из BEP 6: 80.4.4.200, info_hash из 0xaa, 1313 фрагментов. Первые 9 значений
+    // последовательности - 1059, 431, 808, 1217, 287, 376, 1188, 353, 508; десятое - 1246
+    Sha1Digest infoHash;
+    infoHash.fill(0xaa);
+    std::set<int> expected = {1059, 431, 808, 1217, 287, 376, 1188, 353, 508, 1246};
+    assert(generateAllowedFastSet("80.4.4.200", infoHash, 1313) == expected);
+    // Набор зависит только от подсети /24
+    assert(generateAllowedFastSet("80.4.4.1", infoHash, 1313) == expected);
+    assert(generateAllowedFastSet("80.4.5.200", infoHash, 1313) != expected);
+
+    // Фрагментов меньше размера набора - в него входят все; для IPv6 набор не определен
+    assert(generateAllowedFastSet("80.4.4.200", infoHash, 3) == std::set<int>({0, 1, 2}));
+    assert(generateAllowedFastSet("2001:db8::1", infoHash, 1313).empty());
+    assert(generateAllowedFastSet("80.4.4.200", infoHash, 0).empty());
+    std::cout << "All allowed fast set tests passed successfully!" << std::endl;
+}
+
+void runPeerExchange()
+{
+    // Два клиента: A подключен к B и к трем другим пирам, B узнает о них через PEX
+    PeerExchange a(6881);
+    PeerExchange b(6882);
+    std::string endpointA = Peer("127.0.0.1", 6881).compact();
+    std::string endpointB = Peer("127.0.0.1", 6882).compact();
+    std::string first = Peer("10.0.0.1", 7001).compact();
+    std::string second = Peer("10.0.0.2", 7002).compact();
+    std::string third = Peer("2001:db8::3", 7003).compact();
+    assert(first.size() == 6 && third.size() == 18);
+
+    // Соединение A -> B: сообщения extended идут по паре сокетов в том же виде, что и между пирами
+    int sockets[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    auto sendExtended = [&sockets](uint8_t id, const std::string &message) {
+        sendData(sockets[0], BitTorrentMessage(extended, std::string(1, (char)id) + message).toString());
+    };
+    auto receiveExtended = [&sockets](uint8_t expectedId) {
+        std::string reply = receiveData(sockets[1]);
+        assert(reply.size() > 2 && (uint8_t)reply[0] == extended && (uint8_t)reply[1] == expectedId);
+        return reply.substr(2);
+    };
+
+    // Extended handshake: идентификатор ut_pex и порт для входящих соединений
+    int pexId;
+    int listenPort;
+    sendExtended(0, a.buildHandshake());
+    PeerExchange::parseHandshake(receiveExtended(0), pexId, listenPort);
+    assert(pexId == UT_PEX_ID && listenPort == 6881);
+    // Некорректный порт отбрасывается
+    int otherPexId;
+    PeerExchange::parseHandshake("d1:md6:ut_pexi3ee1:pi70000ee", otherPexId, listenPort);
+    assert(otherPexId == 3 && listenPort == 0);
+
+    a.peerConnected(endpointB);
+    a.peerConnected(first);
+    a.peerConnected(second);
+    a.peerConnected(third);
+    b.peerConnected(endpointA);
+
+    // Первое сообщение содержит всех подключенных к A, кроме самого B; IPv6 - в added6
+    std::set<std::string> sentToB;
+    std::string message = a.buildMessage(endpointB, sentToB);
+    auto dictionary = std::dynamic_pointer_cast<BDictionary>(std::shared_ptr<BItem>(decode(message)));
+    assert(dictionary);
+    auto value = [&dictionary](const std::string &key) {
+        auto item = std::dynamic_pointer_cast<BString>(dictionary->getValue(key));
+        return item ? item->value() : std::string("-");
+    };
+    assert(value("added") == first + second && value("added.f") == std::string(2, '\0'));
+    assert(value("added6") == third && value("dropped") == "" && value("dropped6") == "");
+    assert(sentToB.size() == 3 && sentToB.count(endpointB) == 0);
+
+    sendExtended(pexId, message);
+    std::vector<Peer> fresh = b.parseMessage(receiveExtended(UT_PEX_ID));
+    close(sockets[0]);
+    close(sockets[1]);
+    assert(fresh.size() == 3);
+    assert(fresh[0].compact() == first && fresh[1].compact() == second && fresh[2].compact() == third);
+    assert(fresh[2].ip() == "2001:db8::3" && fresh[2].port() == 7003);
+    // Повторное сообщение не дает уже переданных в очередь пиров
+    assert(b.parseMessage(message).empty());
+
+    // Без изменений сообщение не отправляется; отключенный пир попадает в dropped
+    assert(a.buildMessage(endpointB, sentToB).empty());
+    a.peerDisconnected(second);
+    a.peerDisconnected(third);
+    dictionary = std::dynamic_pointer_cast<BDictionary>(std::shared_ptr<BItem>(decode(a.buildMessage(endpointB, sentToB))));
+    assert(value("added") == "" && value("dropped") == second && value("dropped6") == third);
+    assert(sentToB.size() == 1 && sentToB.count(first) == 1);
+
+    // Пир, к которому B уже подключен, в очередь не возвращается
+    std::string fourth = Peer("10.0.0.4", 7004).compact();
+    a.peerConnected(fourth);
+    b.peerConnected(fourth);
+    assert(b.parseMessage(a.buildMessage(endpointB, sentToB)).empty());
+    std::cout << "All peer exchange tests passed successfully!" << std::endl;
+}
+
+void runPeerCache()
+{
+    std::string path = "/tmp/torrent-client-peercache-" + std::to_string(getpid());
+    std::string first = Peer("10.0.0.1", 7001).compact();
+    std::string second = Peer("2001:db8::2", 7002).compact();
+    std::string third = Peer("10.0.0.3", 7003).compact();
+
+    // Сохранение и загрузка: записи с 6- и 18-байтными адресами, порядок по загруженному объему
+    {
+        PeerCache cache(path);
+        cache.recordSuccess(first, 1000);
+        cache.recordSuccess(second, 5000);
+        cache.recordSuccess(third, 0);
+        cache.recordFailure(third);
+        cache.recordFailure(Peer("10.0.0.4", 7004).compact()); // Незнакомый пир в кэш не попадает
+        cache.save();
+    }
+    {
+        PeerCache cache(path);
+        cache.load();
+        std::vector<Peer> peers = cache.getPeers(10);
+        assert(peers.size() == 3);
+        assert(peers[0].ip() == "2001:db8::2" && peers[0].port() == 7002);
+        assert(peers[1].compact() == first && peers[2].compact() == third);
+        assert(cache.getPeers(1).size() == 1);
+    }
+
+    // Оборванный файл: целые записи читаются, хвост отбрасывается
+    std::string data;
+    {
+        std::ifstream file(path, std::ios::binary);
+        data.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+    assert(data.size() == (1 + 18 + 20) + 2 * (1 + 6 + 20));
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << data.substr(0, data.size() - 5);
+    }
+    {
+        PeerCache cache(path);
+        cache.load();
+        std::vector<Peer> peers = cache.getPeers(10);
+        assert(peers.size() == 2 && peers[0].compact() == second && peers[1].compact() == first);
+    }
+
+    // Рейтинг учитывает давность последней сессии и отказы подряд; старые и отказывающие пиры удаляются
+    auto record = [](const std::string &endpoint, uint32_t failures, uint64_t downloaded, uint32_t lastSeen) {
+        std::string result(1, (char)endpoint.size());
+        result += endpoint;
+        uint64_t numbers[] = {1, failures, downloaded, lastSeen};
+        int sizes[] = {4, 4, 8, 4};
+        for (int i = 0; i < 4; i++)
+        {
+            for (int j = sizes[i] - 1; j >= 0; j--)
+            {
+                result.push_back((char)(numbers[i] >> (j * 8)));
+            }
+        }
+        return result;
+    };
+    uint32_t now = std::time(nullptr);
+    std::string old = Peer("10.0.0.5", 7005).compact();
+    std::string failing = Peer("10.0.0.6", 7006).compact();
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << record(first, 0, 8000, now - 3 * 24 * 3600) // Три дня назад: вес 1000
+             << record(second, 1, 3000, now)                 // Один отказ: вес 1500
+             << record(third, 0, 2000, now)                  // Вес 2000
+             << record(old, 0, 1000000000, now - 40 * 24 * 3600) << record(failing, 3, 1000000000, now);
+    }
+    {
+        PeerCache cache(path);
+        cache.load();
+        std::vector<Peer> peers = cache.getPeers(10);
+        assert(peers.size() == 3);
+        assert(peers[0].compact() == third && peers[1].compact() == second && peers[2].compact() == first);
+
+        // Отказы подряд опускают пира и затем удаляют его, успешная сессия сбрасывает счетчик
+        cache.recordFailure(third);
+        cache.recordFailure(third);
+        peers = cache.getPeers(10);
+        assert(peers.size() == 3 && peers[2].compact() == third);
+        cache.recordSuccess(second, 0);
+        assert(cache.getPeers(1)[0].compact() == second);
+        cache.recordFailure(third);
+        assert(cache.getPeers(10).size() == 2);
+        cache.save();
+    }
+    {
+        std::ifstream file(path, std::ios::binary);
+        data.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        assert(data.size() == (1 + 18 + 20) + (1 + 6 + 20));
+    }
+
+    // Отсутствующий файл - пустой кэш
+    std::remove(path.c_str());
+    PeerCache empty(path);
+    empty.load();
+    assert(empty.getPeers(10).empty());
+    std::cout << "All peer cache tests passed successfully!" << std::endl;
+}
+
+void runPieceManager()
+{
+    // Однофайловый торрент из трех фрагментов, последний короче
+    long pieceSize = 16384;
+    std::string data;
+    for (int i = 0; i < 40000; i++)
+    {
+        data += (char)(i * 7 % 251);
+    }
+    std::string hashes;
+    for (long offset = 0; offset < (long)data.size(); offset += pieceSize)
+    {
+        Sha1Digest digest = sha1Digest(data.substr(offset, pieceSize));
+        hashes.append((const char *)digest.data(), digest.size());
+    }
+    std::string path = "/tmp/torrent-client-piecemanager-" + std::to_string(getpid()) + ".torrent";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "d8:announce17:http://127.0.0.1/4:infod6:lengthi" << data.size() << "e4:name4:data"
+             << "12:piece lengthi" << pieceSize << "e6:pieces" << hashes.size() << ":" << hashes << "ee";
+    }
+    TorrentFile torrent(path);
+    std::remove(path.c_str());
+
+    // Загрузка всех блоков у пира со всеми фрагментами; испорченный фрагмент загружается повторно
+    auto download = [&data](PieceManager &manager) {
+        manager.addPeer("peer", std::string(1, (char)0xe0));
+        bool corrupted = false;
+        while (!manager.isComplete())
+        {
+            Block *block = manager.nextRequest("peer");
+            assert(block);
+            std::string payload = data.substr((long)block->piece * manager.getPieceSize(0) + block->offset,
+                                              block->length);
+            if (!corrupted)
+            {
+                payload[0] ^= 1;
+                corrupted = true;
+            }
+            manager.blockReceived("peer", block->piece, block->offset, payload);
+        }
+    };
+
+    // Хранилище в памяти получает проверенные данные целиком
+    {
+        auto memory = std::make_unique<MemoryStorage>(data.size());
+        MemoryStorage *storage = memory.get();
+        PieceManager manager(torrent, std::move(memory), 1);
+        assert(manager.getPieceCount() == 3 && manager.getPieceSize(2) == 40000 - 2 * pieceSize);
+        bool completed = false;
+        manager.setCompletionHandler([&completed] { completed = true; });
+        download(manager);
+        assert(completed);
+        assert(std::string(storage->getData().begin(), storage->getData().end()) == data);
+    }
+
+    // Хранилище-приемник передает обработчику каждый проверенный фрагмент один раз
+    std::map<long, std::string> received;
+    {
+        auto sink = std::make_unique<NullStorage>([&received](long offset, const struct iovec *buffers, int count) {
+            std::string &piece = received[offset];
+            assert(piece.empty());
+            for (int i = 0; i < count; i++)
+            {
+                piece.append((const char *)buffers[i].iov_base, buffers[i].iov_len);
+            }
+        });
+        PieceManager manager(torrent, std::move(sink), 1);
+        download(manager);
+        assert(manager.havePiece(0) && !manager.sendBlock(-1, 0, 0, 16, nullptr)); // Отдавать нечего
+    }
+    assert(received.size() == 3);
+    for (const auto &piece : received)
+    {
+        assert(piece.first % pieceSize == 0 && piece.second == data.substr(piece.first, pieceSize));
+    }
+    std::cout << "All piece manager tests passed successfully!" << std::endl;
+}
+
+void runPieceCache()
+{
+    // Загрузчик считает чтения с диска: промах читает фрагмент, попадание - нет
+    int loads = 0;
+    PieceCache::Loader load = [&loads](int index) {
+        loads++;
+        return std::string(4, (char)('a' + index));
+    };
+
+    // Попадания и промахи
+    {
+        PieceCache cache(4);
+        assert(*cache.get(0, load) == "aaaa" && loads == 1);
+        assert(*cache.get(0, load) == "aaaa" && loads == 1);
+        assert(cache.getHits() == 1 && cache.getMisses() == 1 && cache.getSize() == 1);
+    }
+
+    // Однократный проход по раздаче не вытесняет фрагменты, запрошенные повторно
+    {
+        PieceCache cache(4);
+        loads = 0;
+        for (int index : {0, 0, 1, 1})
+        {
+            cache.get(index, load);
+        }
+        for (int index = 2; index < 20; index++)
+        {
+            cache.get(index, load);
+        }
+        assert(loads == 20 && cache.getSize() == 4);
+        cache.get(0, load);
+        cache.get(1, load);
+        assert(loads == 20 && cache.getHits() == 4);
+    }
+
+    // Попадание в призрачный список B1 увеличивает долю однократных фрагментов: следующий промах
+    // вытесняет давний повторный фрагмент, а не однократный
+    {
+        PieceCache cache(4);
+        loads = 0;
+        for (int index : {0, 0, 1, 1, 2, 3, 4})
+        {
+            cache.get(index, load);
+        }
+        assert(loads == 5);
+        cache.get(2, load); // 2 вытеснен фрагментом 4
+        assert(loads == 6 && cache.getSize() == 4);
+        cache.get(5, load);
+        cache.get(4, load);
+        assert(loads == 7);
+        cache.get(0, load);
+        assert(loads == 8);
+        assert(cache.getHits() == 3 && cache.getMisses() == 8);
+    }
+
+    // Закрепленный (отправляемый) фрагмент не вытесняется, после отправки вытесняется как обычно
+    {
+        PieceCache cache(2);
+        loads = 0;
+        PieceCache::Data pinned = cache.get(0, load);
+        for (int index = 1; index < 6; index++)
+        {
+            cache.get(index, load);
+        }
+        assert(pinned.use_count() == 2 && cache.getSize() == 2);
+        std::weak_ptr<const std::string> released = pinned;
+        pinned.reset();
+        cache.get(6, load);
+        assert(released.expired() && loads == 7);
+    }
+
+    // Нулевая емкость: данные только передаются получателю
+    PieceCache disabled(0);
+    loads = 0;
+    disabled.get(0, load);
+    disabled.get(0, load);
+    assert(loads == 2 && disabled.getSize() == 0 && disabled.getHits() == 0);
+    std::cout << "All piece cache tests passed successfully!" << std::endl;
+}
+
+void runFileStorage()
+{
+    // Раздача из четырех файлов, один пустой; фрагменты по 16 байт, последний - 10 байт
+    std::string root = "/tmp/torrent-client-filestorage-" + std::to_string(getpid());
+    std::vector<TorrentFileEntry> files = {
+        {"dir/a", 10, 0}, {"dir/empty", 0, 10}, {"dir/sub/b", 25, 10}, {"dir/c", 7, 35}};
+    std::string data;
+    for (int i = 0; i < 42; i++)
+    {
+        data += (char)('a' + i % 26);
+    }
+    {
+        FileStorage storage(files, root, allocateFull, 2);
+
+        // Отображение: участок, пересекающий границу, пропускает пустой файл
+        std::vector<FileSpan> spans = storage.map(0, 16);
+        assert(spans.size() == 2);
+        assert(spans[0].file == 0 && spans[0].offset == 0 && spans[0].length == 10);
+        assert(spans[1].file == 2 && spans[1].offset == 0 && spans[1].length == 6);
+        spans = storage.map(32, 10);
+        assert(spans.size() == 2);
+        assert(spans[0].file == 2 && spans[0].offset == 22 && spans[0].length == 3);
+        assert(spans[1].file == 3 && spans[1].offset == 0 && spans[1].length == 7);
+        assert(storage.map(10, 0).empty());
+        bool outside = false;
+        try
+        {
+            storage.map(40, 5);
+        }
+        catch (const std::runtime_error &)
+        {
+            outside = true;
+        }
+        assert(outside);
+
+        storage.open();
+        assert(!storage.hasData());
+        struct stat status;
+        assert(stat(storage.getFilePath(1).c_str(), &status) == 0 && status.st_size == 0);
+
+        // Запись фрагментов буферами, границы которых не совпадают с границами файлов
+        for (long offset = 0; offset < 42; offset += 16)
+        {
+            long length = std::min(16L, 42 - offset);
+            struct iovec buffers[] = {{(void *)(data.data() + offset), 7},
+                                      {(void *)(data.data() + offset + 7), (size_t)length - 7}};
+            storage.writePiece(offset, buffers, 2);
+            // Открыто не больше двух файлов: давно не использовавшиеся закрываются
+            assert(storage.getOpenFileCount() <= 2);
+        }
+
+        // Чтение через границы файлов, включая последний фрагмент
+        char block[42];
+        storage.readBlock(0, block, 42);
+        assert(std::string(block, 42) == data);
+        storage.readBlock(32, block, 10);
+        assert(std::string(block, 10) == data.substr(32));
+        storage.readBlock(8, block, 4);
+        assert(std::string(block, 4) == data.substr(8, 4));
+        assert(storage.getOpenFileCount() <= 2);
+        storage.flush();
+    }
+
+    // Содержимое файлов на диске
+    for (const TorrentFileEntry &file : files)
+    {
+        std::string path = root + "/" + file.path;
+        std::ifstream stream(path, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+        assert(content == data.substr(file.offset, file.length));
+        std::remove(path.c_str());
+    }
+
+    // Повторное открытие видит записанные данные
+    {
+        FileStorage storage({files[0]}, root);
+        std::ofstream(root + "/dir/a") << "x";
+        storage.open();
+        assert(storage.hasData());
+        std::remove((root + "/dir/a").c_str());
+    }
+    rmdir((root + "/dir/sub").c_str());
+    rmdir((root + "/dir").c_str());
+    rmdir(root.c_str());
+    std::cout << "All file storage tests passed successfully!" << std::endl;
+}
+
+void runUdpTracker()
+{
+    // Подставной UDP-трекер на loopback: первый connect теряется, первый announce получает ошибку
+    // устаревшего идентификатора соединения
+    int server = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(server, (struct sockaddr *)&address, sizeof(address)) == 0);
+    socklen_t addressLength = sizeof(address);
+    getsockname(server, (struct sockaddr *)&address, &addressLength);
+    int port = ntohs(address.sin_port);
+
+    auto put32 = [](std::string &buffer, uint32_t value) {
+        value = htonl(value);
+        buffer.append((char *)&value, sizeof(value));
+    };
+    auto get32 = [](const char *data) {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return ntohl(value);
+    };
+    std::atomic<int> connects{0};
+    std::atomic<int> announces{0};
+    std::atomic<uint32_t> announcedEvent{0};
+    std::thread tracker([&]() {
+        char buffer[2048];
+        struct sockaddr_in client {};
+        socklen_t clientLength = sizeof(client);
+        long received;
+        while ((received = recvfrom(server, buffer, sizeof(buffer), 0, (struct sockaddr *)&client, &clientLength)) > 0)
+        {
+            if (received < 16)
+            {
+                break; // Сигнал завершения
+            }
+            uint32_t action = get32(buffer + 8);
+            std::string reply;
+            if (action == 0 && connects++ == 0)
+            {
+                continue;
+            }
+            if (action == 0)
+            {
+                put32(reply, 0);
+                put32(reply, get32(buffer + 12));
+                reply += std::string(8, (char)connects.load());
+            }
+            else if (action == 1 && announces++ == 0)
+            {
+                put32(reply, 3);
+                put32(reply, get32(buffer + 12));
+                reply += "Connection ID expired";
+            }
+            else if (action == 1)
+            {
+                announcedEvent = get32(buffer + 80);
+                put32(reply, 1);
+                put32(reply, get32(buffer + 12));
+                put32(reply, 1800);
+                put32(reply, 2);
+                put32(reply, 3);
+                reply += Peer("10.0.0.1", 6881).compact();
+            }
+            else if (action == 2)
+            {
+                put32(reply, 2);
+                put32(reply, get32(buffer + 12));
+                put32(reply, 5);
+                put32(reply, 50);
+                put32(reply, 6);
+            }
+            sendto(server, reply.data(), reply.size(), 0, (struct sockaddr *)&client, clientLength);
+        }
+    });
+
+    EventLoop loop;
+    Resolver resolver(loop);
+    // Цикл не блокируется, пока трекер не отвечает: таймер продолжает срабатывать
+    int ticks = 0;
+    loop.addTimer(100, [&ticks]() { ticks++; });
+
+    std::string infoHash(20, '\xab');
+    UdpAnnounceResult announced;
+    std::vector<UdpScrapeResult> scraped;
+    std::string announceError = "-";
+    std::string scrapeError = "-";
+    auto client = std::make_shared<UdpTracker>(loop, resolver, "127.0.0.1", port);
+    client->announce(infoHash, std::string(20, 'p'), 6881, 0, 100, 0, eventCompleted, 50,
+                     [&](const UdpAnnounceResult &result, const std::string &error) {
+                         announced = result;
+                         announceError = error;
+                         client->scrape({infoHash}, [&](const std::vector<UdpScrapeResult> &results,
+                                                        const std::string &error) {
+                             scraped = results;
+                             scrapeError = error;
+                             loop.stop();
+                         });
+                     });
+    loop.run();
+    assert(announceError.empty() && announced.interval == 1800 && announced.leechers == 2 && announced.seeders == 3);
+    assert(announced.peers.size() == 1 && announced.peers[0].ip() == "10.0.0.1" && announced.peers[0].port() == 6881);
+    assert(announcedEvent == eventCompleted);
+    // Потерянный connect повторен через 2 с, после ошибки announce идентификатор получен заново
+    assert(connects == 3 && announces == 2 && ticks >= 15);
+    assert(scrapeError.empty() && scraped.size() == 1);
+    assert(scraped[0].seeders == 5 && scraped[0].completed == 50 && scraped[0].leechers == 6);
+
+    // Трекер на закрытом порту: ошибка приходит сразу по ICMP, без ожидания повторов.
+    // Объект живет, пока не вызван обработчик, даже если ссылок на него не осталось
+    int closedPort = port == 65535 ? port - 1 : port + 1;
+    auto refused = std::make_shared<UdpTracker>(loop, resolver, "127.0.0.1", closedPort);
+    auto start = std::chrono::steady_clock::now();
+    refused->scrape({infoHash}, [&](const std::vector<UdpScrapeResult> &, const std::string &error) {
+        scrapeError = error;
+        loop.stop();
+    });
+    refused.reset();
+    loop.run();
+    assert(!scrapeError.empty() && std::chrono::steady_clock::now() - start < std::chrono::milliseconds(1000));
+
+    // Первый анонс сессии - started; при остановке ответившим трекерам отправляется stopped
+    {
+        std::string url = "udp://127.0.0.1:" + std::to_string(port) + "/announce";
+        std::vector<Peer> delivered;
+        TrackerManager trackers(loop, std::string(20, 'p'), infoHash, 6881, 100, url, {},
+                                [&](std::vector<Peer> peers, int) {
+                                    delivered = std::move(peers);
+                                    loop.stop();
+                                });
+        assert(trackers.announce(0, 0, 50, false, eventStarted));
+        loop.run();
+        assert(delivered.size() == 1 && announcedEvent == eventStarted);
+        bool stopped = false;
+        assert(trackers.announceStopped(100, 0, [&]() {
+            stopped = true;
+            loop.stop();
+        }));
+        loop.run();
+        assert(stopped && announcedEvent == eventStopped && !trackers.isAnnouncing());
+    }
+
+    // Имя разрешается асинхронно, повторный запрос отвечает из кэша
+    std::vector<struct sockaddr_storage> addresses;
+    resolver.resolve("localhost", 80, SOCK_STREAM, [&](std::vector<struct sockaddr_storage> result) {
+        addresses = std::move(result);
+        resolver.resolve("localhost", 80, SOCK_STREAM, [&](std::vector<struct sockaddr_storage> cached) {
+            assert(cached.size() == addresses.size());
+            loop.stop();
+        });
+    });
+    loop.run();
+    assert(!addresses.empty());
+
+    sendto(server, "", 1, 0, (struct sockaddr *)&address, sizeof(address));
+    tracker.join();
+    close(server);
+    std::cout << "All UDP tracker tests passed successfully!" << std::endl;
+}
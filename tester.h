@@ -3,6 +3,18 @@
 // [НЕ ИСПОЛЬЗУЕТСЯ]
 void runTests();
 void runSHA1();
+void runSHA1Benchmark();
 void runPiece();
+void runDht();
+void runHttpClient();
+void runRateLimiter();
+void runChoker();
+void runAllowedFast();
+void runPeerExchange();
+void runPeerCache();
+void runPieceManager();
+void runPieceCache();
+void runFileStorage();
+void runUdpTracker();
 
 #endif // TESTER_H
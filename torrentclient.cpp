@@ -1,18 +1,48 @@
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
 #include <iostream>
 #include <random>
+#include <set>
 #include <thread>
+#include <unistd.h>
 
+#include "peercache.h"
 #include "peerconnection.h"
 #include "peerretriever.h"
 #include "piecemanager.h"
 #include "torrentclient.h"
 #include "torrentfile.h"
+#include "trackermanager.h"
+#include "utils.h"
 
 #define PORT 8080              // Лучше ставить от 8000 до 16000
-#define PEER_QUERY_INTERVAL 60 // Интервал обновления списка пиров
+#define PEER_QUERY_INTERVAL 60 // Интервал проверки, не пора ли повторить анонс трекерам
+#define CHOKE_INTERVAL 10      // Интервал пересчета блокировок пиров
+#define DHT_STATE_FILE ".torrent-client.dht" // Файл таблицы маршрутизации DHT в домашнем каталоге
+#define DHT_MIN_NODES 8        // Меньше узлов в таблице - повторный bootstrap
+#define DHT_QUERY_INTERVAL 30  // Минимальный интервал поиска пиров через DHT
+#define PEER_REFILL_INTERVAL 5 // Интервал проверки опустевшей очереди пиров
+#define NUMWANT_PER_CONNECTION 2 // Сколько пиров запрашивать у трекера на одно соединение
+#define MIN_NUMWANT 10          // Наименьший numwant в запросе к трекеру
+#define MAX_NUMWANT 200         // Наибольший numwant в запросе к трекеру
+#define PEER_CACHE_DIAL 30     // Сколько пиров из кэша ставится в очередь при старте
+#define STOPPED_TIMEOUT 3000   // Сколько ждать ответов трекеров на событие stopped (миллисекунды)
 
-TorrentClient::TorrentClient(const int threadNum) : threadNum(threadNum)
+// Файл состояния DHT: в домашнем каталоге, если он известен, иначе в текущем
+static std::string dhtStateFile()
 {
+    const char *home = std::getenv("HOME");
+    return home ? std::string(home) + "/" + DHT_STATE_FILE : DHT_STATE_FILE;
+}
+
+TorrentClient::TorrentClient(const int threadNum) : threadNum(threadNum), listener(PORT), peerExchange(PORT), dht(PORT, dhtStateFile())
+{
+    // Пир, закрывший соединение во время отдачи, не должен завершать процесс сигналом SIGPIPE:
+    // у sendfile нет флага MSG_NOSIGNAL, поэтому сигнал игнорируется, а ошибка приходит как EPIPE
+    signal(SIGPIPE, SIG_IGN);
+
     peerId = "-UT2021-";
     std::random_device rd;
     std::mt19937 gen(rd());
@@ -27,62 +57,169 @@ TorrentClient::~TorrentClient() = default;
 
 void TorrentClient::downloadFile(const std::string &torrentFilePath, const std::string &downloadDirectory)
 {
+    // terminate во время подготовки не теряется: цикл событий, остановленный до запуска, сразу завершается
+    {
+        std::lock_guard<std::mutex> guard(sessionLock);
+        downloading = true;
+    }
 
     TorrentFile torrentFile(torrentFilePath);
-    std::string announceUrl = torrentFile.getAnnounce();
+    std::string announceUrl = torrentFile.get("announce") ? torrentFile.getAnnounce() : ""; // Необязательно (BEP 12)
     std::vector<std::vector<std::string>> announceList = torrentFile.getAnnounceList(); // Необязательно
     std::string сreationDate = torrentFile.getCreationDate();                           // Необязательно
     std::string comment = torrentFile.getComment();                                     // Необязательно
     std::string createdBy = torrentFile.getCreatedBy();                                 // Необязательно
     long fileSize = torrentFile.getFileSize();
 
-    const std::string infoHash = torrentFile.getInfoHash();
+    const Sha1Digest infoHash = torrentFile.getInfoHash();
+    const std::string binaryInfoHash((const char *)infoHash.data(), infoHash.size()); // Для трекеров и DHT
     std::string filename = torrentFile.getFileName();
     std::string downloadPath = downloadDirectory + filename;
-    PieceManager pieceManager(torrentFile, downloadPath, threadNum);
+    PieceManager pieceManager(torrentFile, downloadDirectory, threadNum, storageMode, allocationMode);
+    pieceManager.setDirectWrites(directWrites);
+    pieceManager.setReadCacheSize(readCacheSize);
+    int rechecked = pieceManager.recheck(); // Данные прошлого запуска докачиваются, а не загружаются заново
+    if (rechecked > 0)
+    {
+        std::cout << "Verified " << rechecked << "/" << pieceManager.getPieceCount() << " pieces on disk" << std::endl;
+    }
+
+    // Пиры прошлых сессий подключаются сразу, не дожидаясь ответа трекеров
+    PeerCache peerCache(PeerCache::defaultPath(sha1Hex(infoHash)));
+    peerCache.load();
+    addTrackerPeers(peerCache.getPeers(PEER_CACHE_DIAL), false);
 
     // Инициализация соединений
     for (int i = 0; i < threadNum; i++)
     {
-        PeerConnection connection(&queue, peerId, infoHash, &pieceManager);
-        connections.push_back(&connection);
+        auto *connection = new PeerConnection(
+            &queue, peerId, infoHash, &pieceManager, &downloadLimiter, &uploadLimiter, &peerExchange);
+        connection->setRateLimits(peerDownloadLimit, peerUploadLimit);
+        connection->setPeerCache(&peerCache);
+        connection->setChoker(&choker);
+        connections.push_back(connection);
+        choker.addConnection(connection);
         std::thread thread(&PeerConnection::start, connection);
         threadPool.push_back(std::move(thread));
     }
 
-    auto lastPeerQuery = (time_t)(-1);
+    // Входящие пиры уже подключены, поэтому ставятся в начало очереди.
+    // Одновременно ожидать обработки может не больше входящих пиров, чем потоков загрузки.
+    listener.start();
+    listener.registerTorrent(binaryInfoHash, [this](Peer &peer) {
+        int inboundPeers = queue.count_if([](const Peer &queued) { return queued.sock >= 0; });
+        if (inboundPeers >= threadNum)
+        {
+            return false;
+        }
+        queue.push_front(peer);
+        return true;
+    });
 
-    std::cout << "Download initiated..." << std::endl;
+    TrackerManager trackers(supervisor, peerId, binaryInfoHash, PORT, fileSize, announceUrl, announceList,
+                            [this](std::vector<Peer> peers, int round) {
+                                // Первые пиры нового раунда заменяют пиров от предыдущего,
+                                // но пиры из кэша до первого ответа трекеров сохраняются
+                                addTrackerPeers(std::move(peers), trackerRound != 0 && round != trackerRound);
+                                trackerRound = round;
+                            });
 
-    // Цикл загрузки файла
-    while (true)
-    {
-        if (pieceManager.isComplete())
+    // Поиск через DHT идет в отдельном потоке, чтобы не задерживать таймеры цикла;
+    // при выходе из цикла он прерывается, а не дорабатывает до тайм-аута
+    std::thread dhtSearch;
+    std::atomic<bool> dhtSearching{false};
+    std::atomic<bool> dhtCancelled{false};
+    time_t lastDhtQuery = 0;
+
+    // Пиров запрашивается столько, чтобы очередь покрыла все соединения с запасом;
+    // трекеры анонсируются не чаще своих interval (внеочередной анонс - min interval)
+    auto announce = [&](bool force, TrackerEvent event) {
+        int numWant = std::clamp(threadNum * NUMWANT_PER_CONNECTION - queue.size(), MIN_NUMWANT, MAX_NUMWANT);
+        return trackers.announce(pieceManager.bytesDownloaded(), pieceManager.bytesUploaded(), numWant, force, event);
+    };
+    // Пополнение очереди, когда соединения разобрали всех пиров
+    auto refillPeers = [&]() {
+        if (!queue.empty() || trackers.isAnnouncing() || dhtSearching)
         {
-            break;
+            return;
         }
-
         time_t currentTime = std::time(nullptr);
-        auto diff = std::difftime(currentTime, lastPeerQuery);
-        if (lastPeerQuery == -1 || diff >= PEER_QUERY_INTERVAL || queue.empty())
+        if (announce(true, eventNone))
+        {
+            return;
+        }
+        // Трекеры не дали пиров, их нет или им еще рано отвечать - поиск через DHT с анонсом нашего порта
+        if (std::difftime(currentTime, lastDhtQuery) >= DHT_QUERY_INTERVAL)
         {
-            // Получение списка пиров
-            PeerRetriever peerRetriever(peerId, announceUrl, infoHash, PORT, fileSize);
-            std::vector<Peer *> peers = peerRetriever.retrievePeers(pieceManager.bytesDownloaded());
-            lastPeerQuery = currentTime;
-            if (!peers.empty())
+            lastDhtQuery = currentTime;
+            dhtSearching = true;
+            if (dhtSearch.joinable())
             {
-                queue.clear();
-                for (auto *peer : peers)
+                dhtSearch.join();
+            }
+            dhtSearch = std::thread([this, &dhtSearching, &dhtCancelled, binaryInfoHash]() {
+                // DHT работает на том же номере порта, что и TCP-listener (BEP 5)
+                if (dht.start() && dht.getNodeCount() < DHT_MIN_NODES)
                 {
-                    queue.push_back(peer);
+                    dht.bootstrap({{"router.bittorrent.com", 6881},
+                                   {"dht.transmissionbt.com", 6881},
+                                   {"router.utorrent.com", 6881}},
+                                  &dhtCancelled);
                 }
-            }
+                addTrackerPeers(dht.getPeers(binaryInfoHash, PORT, &dhtCancelled), false);
+                dhtSearching = false;
+            });
         }
+    };
+
+    std::cout << "Download initiated..." << std::endl;
+
+    // Все периодические действия выполняются по таймерам, между ними поток спит в poll().
+    // После загрузки цикл продолжается: соединения и listener раздают файл до вызова terminate()
+    pieceManager.setCompletionHandler([&]() {
+        supervisor.post([&]() {
+            std::cout << "Download completed, seeding " << downloadPath << std::endl;
+            announce(true, eventCompleted);
+            // Слоты разблокировки сразу распределяются по скорости отдачи, а не загрузки
+            choker.tick(true);
+        });
+    });
+    std::vector<int> timers;
+    timers.push_back(supervisor.addTimer(PEER_QUERY_INTERVAL * 1000, [&]() { announce(false, eventNone); }));
+    timers.push_back(supervisor.addTimer(PEER_REFILL_INTERVAL * 1000, refillPeers));
+    timers.push_back(supervisor.addTimer(CHOKE_INTERVAL * 1000, [&]() { choker.tick(pieceManager.isComplete()); }));
+    timers.push_back(supervisor.addTimer(PEER_QUERY_INTERVAL * 1000, [&]() { peerCache.save(); }));
+    supervisor.post([&]() { announce(false, eventStarted); });
+    supervisor.post(refillPeers);
+    supervisor.run();
+    {
+        std::lock_guard<std::mutex> guard(sessionLock);
+        downloading = false;
+    }
+    for (int timer : timers)
+    {
+        supervisor.cancelTimer(timer);
+    }
+    pieceManager.setCompletionHandler(nullptr);
+    dhtCancelled = true;
+    if (dhtSearch.joinable())
+    {
+        dhtSearch.join();
     }
 
-    // Завершение загрузки
-    terminate();
+    // Завершение загрузки или раздачи
+    listener.unregisterTorrent(binaryInfoHash);
+    shutdown();
+    peerCache.save();
+
+    // Трекерам сообщается об остановке с итоговой статистикой; цикл ждет ответов ограниченное время
+    if (trackers.announceStopped(
+            pieceManager.bytesDownloaded(), pieceManager.bytesUploaded(), [this]() { supervisor.stop(); }))
+    {
+        int timer = supervisor.addTimer(STOPPED_TIMEOUT, [this]() { supervisor.stop(); }, false);
+        supervisor.run();
+        supervisor.cancelTimer(timer);
+    }
 
     if (pieceManager.isComplete())
     {
@@ -91,13 +228,49 @@ void TorrentClient::downloadFile(const std::string &torrentFilePath, const std::
     }
 }
 
+void TorrentClient::addTrackerPeers(std::vector<Peer> peers, bool replace)
+{
+    if (peers.empty())
+    {
+        return;
+    }
+    std::set<std::string> incoming;
+    for (const Peer &peer : peers)
+    {
+        incoming.insert(peer.compact());
+    }
+    // Входящие соединения остаются в очереди, старые пиры от трекера заменяются новыми
+    queue.remove_if([replace, &incoming](const Peer &queued) {
+        if (queued.sock >= 0)
+        {
+            return false;
+        }
+        return replace || incoming.count(queued.compact()) > 0;
+    });
+    for (Peer &peer : peers)
+    {
+        queue.push_back(std::move(peer));
+    }
+}
+
 void TorrentClient::terminate()
+{
+    // Загрузка или раздача завершится в downloadFile после выхода из цикла событий; соединения
+    // останавливает поток downloadFile, поэтому повторный вызов или вызов без загрузки ничего не делает
+    std::lock_guard<std::mutex> guard(sessionLock);
+    if (downloading)
+    {
+        downloading = false;
+        supervisor.stop();
+    }
+}
+
+void TorrentClient::shutdown()
 {
     // Отправка заглушечных пиров в очередь для завершения потоков
     for (int i = 0; i < threadNum; i++)
     {
-        Peer *dummyPeer = new Peer{"0.0.0.0", 0};
-        queue.push_back(dummyPeer);
+        queue.push_back(Peer());
     }
     // Остановка соединений
     for (auto connection : connections)
@@ -114,4 +287,75 @@ void TorrentClient::terminate()
     }
     // Очистка пула потоков
     threadPool.clear();
+    // Закрытие входящих соединений, которые так и не были обработаны
+    queue.remove_if([](const Peer &queued) {
+        if (queued.sock >= 0)
+        {
+            close(queued.sock);
+        }
+        return true;
+    });
+    for (auto connection : connections)
+    {
+        choker.removeConnection(connection);
+        delete connection;
+    }
+    connections.clear();
+}
+
+void TorrentClient::setRateLimits(long downloadLimit, long uploadLimit)
+{
+    downloadLimiter.setRate(downloadLimit);
+    uploadLimiter.setRate(uploadLimit);
+}
+
+void TorrentClient::setPeerRateLimits(long downloadLimit, long uploadLimit)
+{
+    peerDownloadLimit = downloadLimit;
+    peerUploadLimit = uploadLimit;
+    for (auto connection : connections)
+    {
+        connection->setRateLimits(downloadLimit, uploadLimit);
+    }
+}
+
+void TorrentClient::setGlobalRateLimits(long downloadLimit, long uploadLimit)
+{
+    RateLimiter::globalDownload().setRate(downloadLimit);
+    RateLimiter::globalUpload().setRate(uploadLimit);
+}
+
+double TorrentClient::getDownloadRate() const
+{
+    return downloadLimiter.getThroughput();
+}
+
+void TorrentClient::setUnchokeSlots(int unchokeSlots, int optimisticSlots)
+{
+    choker.setSlots(unchokeSlots, optimisticSlots);
+}
+
+void TorrentClient::setStorageMode(StorageMode mode)
+{
+    storageMode = mode;
+}
+
+void TorrentClient::setAllocationMode(AllocationMode mode)
+{
+    allocationMode = mode;
+}
+
+void TorrentClient::setDirectWrites(bool enabled)
+{
+    directWrites = enabled;
+}
+
+void TorrentClient::setReadCacheSize(size_t bytes)
+{
+    readCacheSize = bytes;
+}
+
+double TorrentClient::getUploadRate() const
+{
+    return uploadLimiter.getThroughput();
 }
@@ -2,24 +2,60 @@
 #define TORRENTCLIENT_H
 
 #include "SharedQueue.h"
+#include "choker.h"
+#include "dht.h"
+#include "eventloop.h"
 #include "peerconnection.h"
+#include "peerlistener.h"
 #include "peerretriever.h"
+#include "piecemanager.h"
+#include "ratelimiter.h"
 
+#include <mutex>
 #include <string>
 
 class TorrentClient {
     public:
     explicit TorrentClient(int threadNum = 5); // Конструктор с параметром по умолчанию
     ~TorrentClient();                          // Деструктор
-    void terminate();                          // Завершает загрузку
+    void terminate();                          // Завершает загрузку или раздачу (вызывается из другого потока)
     void downloadFile(const std::string &torrentFilePath,
                       const std::string &downloadDirectory); // Метод для загрузки файла
+    void setRateLimits(long downloadLimit, long uploadLimit); // Лимиты торрента, байт/с (0 - без ограничения)
+    void setPeerRateLimits(long downloadLimit, long uploadLimit); // Лимиты каждого пира, байт/с
+    static void setGlobalRateLimits(long downloadLimit, long uploadLimit); // Общие лимиты клиента, байт/с
+    double getDownloadRate() const;  // Текущая скорость загрузки торрента, байт/с
+    double getUploadRate() const;    // Текущая скорость отдачи торрента, байт/с
+    void setUnchokeSlots(int unchokeSlots, int optimisticSlots); // Количество разблокированных пиров
+    void setStorageMode(StorageMode mode);     // Способ хранения файла для следующих загрузок
+    void setAllocationMode(AllocationMode mode); // Выделение места под файлы для следующих загрузок
+    void setDirectWrites(bool enabled);        // Запись на диск мимо page cache (O_DIRECT)
+    void setReadCacheSize(size_t bytes);       // Размер кэша отдаваемых фрагментов, байт (0 - без кэша)
     private:
     const int threadNum;       // Количество потоков для загрузки
     std::string peerId;        // Идентификатор клиента
-    SharedQueue<Peer *> queue; // Общая очередь для обмена данными между потоками
+    SharedQueue<Peer> queue;   // Общая очередь для обмена данными между потоками
     std::vector<std::thread> threadPool;       // Пул потоков
     std::vector<PeerConnection *> connections; // Вектор для хранения соединений
+    RateLimiter downloadLimiter{&RateLimiter::globalDownload()}; // Лимит загрузки торрента
+    RateLimiter uploadLimiter{&RateLimiter::globalUpload()};     // Лимит отдачи торрента
+    long peerDownloadLimit = 0;                // Лимит загрузки на пира
+    long peerUploadLimit = 0;                  // Лимит отдачи на пира
+    StorageMode storageMode = storageStream;   // Способ хранения загружаемого файла
+    AllocationMode allocationMode = allocateFull; // Выделение места под загружаемые файлы
+    bool directWrites = false;                 // Запись фрагментов с O_DIRECT
+    size_t readCacheSize = DEFAULT_READ_CACHE_SIZE; // Размер кэша отдаваемых фрагментов
+    PeerListener listener;                     // Прием входящих соединений на анонсированном порту
+    Choker choker;                             // Выбор пиров, которым разрешена отдача
+    PeerExchange peerExchange;                 // Обмен списками пиров между соединениями (PEX)
+    DhtNode dht;                               // Узел DHT для поиска пиров без трекера
+    EventLoop supervisor;                      // Таймеры и пробуждения цикла загрузки
+    int trackerRound = 0;                      // Номер раунда анонса, от которого получены пиры в очереди
+    bool downloading = false;                  // downloadFile выполняется и еще не получил terminate
+    std::mutex sessionLock;                    // Мьютекс для downloading
+    // Добавление пиров в очередь без повторов; replace - удалить пиров предыдущего раунда
+    void addTrackerPeers(std::vector<Peer> peers, bool replace);
+    void shutdown();                           // Остановка соединений и очистка очереди
 };
 
 #endif                                                       // TORRENTCLIENT_H
@@ -34,7 +34,7 @@ TorrentClientUI::TorrentClientUI(QWidget *parent) : QWidget(parent)
     connect(chooseDownloadDirButton, &QPushButton::clicked, this, &TorrentClientUI::chooseDownloadDirectory);
 
     // Кнопка для начала загрузки торрент-файла
-    QPushButton *downloadTorrentButton = new QPushButton(this);
+    downloadTorrentButton = new QPushButton(this);
     downloadTorrentButton->setText("Загрузить");
     connect(downloadTorrentButton, &QPushButton::clicked, this, &TorrentClientUI::downloadTorrent);
 
@@ -96,6 +96,12 @@ TorrentClientUI::TorrentClientUI(QWidget *parent) : QWidget(parent)
 
 TorrentClientUI::~TorrentClientUI()
 {
+    // Раздача продолжается до terminate, поэтому при закрытии окна ее нужно остановить
+    client.terminate();
+    if (downloadThread.joinable())
+    {
+        downloadThread.join();
+    }
 }
 
 void TorrentClientUI::browseTorrentFile()
@@ -137,11 +143,24 @@ void TorrentClientUI::downloadTorrent()
             downloadDirectory += "/";
         }
 
-        client.downloadFile(torrentFilePath.toStdString(), downloadDirectory.toStdString());
         qDebug() << "Загрузка торрент файла из: " << torrentFilePath;
         qDebug() << "Загрузка в директорию: " << downloadDirectory;
 
+        // downloadFile не возвращается, пока идет загрузка и раздача: он работает в отдельном потоке,
+        // а кнопка "Стоп" вызывает terminate из потока интерфейса
+        downloadTorrentButton->setEnabled(false);
         stopTorrentButton->setEnabled(true);
+        downloadThread = std::thread([this, torrentFilePath, downloadDirectory]() {
+            try
+            {
+                client.downloadFile(torrentFilePath.toStdString(), downloadDirectory.toStdString());
+            }
+            catch (const std::exception &e)
+            {
+                qDebug() << "Ошибка: " << e.what();
+            }
+            QMetaObject::invokeMethod(this, &TorrentClientUI::downloadFinished, Qt::QueuedConnection);
+        });
     }
     else
     {
@@ -171,6 +190,16 @@ void TorrentClientUI::stopDownload()
     stopTorrentButton->setEnabled(false);
 }
 
+void TorrentClientUI::downloadFinished()
+{
+    if (downloadThread.joinable())
+    {
+        downloadThread.join();
+    }
+    downloadTorrentButton->setEnabled(true);
+    stopTorrentButton->setEnabled(false);
+}
+
 void TorrentClientUI::updateConsole(const QString &text)
 {
     console->appendPlainText(text);
@@ -10,6 +10,7 @@
 #include <QPushButton>
 #include <QVBoxLayout>
 #include <QWidget>
+#include <thread>
 
 class ConsoleRedirect : public QObject {
     Q_OBJECT
@@ -41,6 +42,7 @@ class TorrentClientUI : public QWidget {
     void updateConsole(const QString &text); // Слот для обновления вывода в консоли
     void stopDownload();                     // Слот для остановки загрузки
     void chooseDownloadDirectory();
+    void downloadFinished();                 // Поток загрузки завершился
 
     private:
     TorrentClient client;
@@ -48,7 +50,9 @@ class TorrentClientUI : public QWidget {
     QLineEdit *downloadDirectoryLineEdit; // Поле для отображения пути к директории загрузки
     QLabel *torrentInfoLabel; // Добавлен для отображения информации о .torrent файле
     QPlainTextEdit *console;          // Консоль для отображения сообщений
+    QPushButton *downloadTorrentButton; // Начать загрузку
     QPushButton *stopTorrentButton;   // Стоп загрузка
+    std::thread downloadThread;       // Загрузка и раздача идут вне потока интерфейса
 
     ConsoleRedirect *consoleRedirect; // Объект перенаправления вывода
 };
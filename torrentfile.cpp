@@ -10,6 +10,34 @@
 
 #define HASH_LEN 20 // Длина хеша
 
+// Значение ключа непосредственно в словаре (без поиска во вложенных элементах)
+static std::shared_ptr<BItem> childValue(const std::shared_ptr<BDictionary> &dictionary, const std::string &key)
+{
+    if (!dictionary)
+    {
+        return nullptr;
+    }
+    for (const auto &item : *dictionary)
+    {
+        if (item.first->value() == key)
+        {
+            return item.second;
+        }
+    }
+    return nullptr;
+}
+
+// Проверка компонента пути из торрент-файла: выход за каталог загрузки недопустим
+static const std::string &checkPathComponent(const std::string &component)
+{
+    if (component.empty() || component == "." || component == ".." || component.find('/') != std::string::npos ||
+        component.find('\0') != std::string::npos)
+    {
+        throw std::runtime_error("Торрент-файл поврежден. [Недопустимый путь файла '" + component + "']");
+    }
+    return component;
+}
+
 // Конструктор класса TorrentFile
 TorrentFile::TorrentFile(const std::string &filePath)
 {
@@ -19,6 +47,12 @@ TorrentFile::TorrentFile(const std::string &filePath)
         std::dynamic_pointer_cast<BDictionary>(decodedTorrentFile); // Преобразование в словарь
     root = rootDict; // Инициализация корневого элемента
     std::cout << "Парсим торрент " << filePath << "..." << std::endl; // Вывод информации о начале разбора
+    // Список файлов разбирается один раз: размер данных нужен при обработке каждого блока
+    files = parseFiles();
+    for (const TorrentFileEntry &file : files)
+    {
+        totalLength += file.length;
+    }
     std::cout << "Статус парсинга: УСПЕШНО" << std::endl; // Вывод сообщения об успешном разборе
 }
 
@@ -30,12 +64,11 @@ std::shared_ptr<BItem> TorrentFile::get(std::string key) const
 }
 
 // Получить хеш информации о файле
-std::string TorrentFile::getInfoHash() const
+Sha1Digest TorrentFile::getInfoHash() const
 {
     std::shared_ptr<BItem> infoDictionary = get("info"); // Получение информационного словаря
     std::string infoString = encode(infoDictionary);     // Кодирование словаря в строку
-    std::string sha1Hash = sha1(infoString);             // Вычисление хеша SHA1
-    return sha1Hash;                                     // Возвращение хеша
+    return sha1Digest(infoString);                       // Вычисление хеша SHA1
 }
 
 // Разделить хеши кусков файла
@@ -60,17 +93,10 @@ std::vector<std::string> TorrentFile::splitPieceHashes() const
     return pieceHashes; // Возвращение вектора хешей
 }
 
-// Получить размер файла из торрент-файла
+// Получить общий размер всех файлов торрента
 long TorrentFile::getFileSize() const
 {
-    std::shared_ptr<BItem> fileSizeItem = get("length"); // Получение значения размера файла
-    if (!fileSizeItem)
-    {                                                    // Проверка наличия значения
-        throw std::runtime_error(
-            "Торрент-файл поврежден. [Файл не содержит ключ 'length']"); // Ошибка при отсутствии ключа
-    }
-    long fileSize = std::dynamic_pointer_cast<BInteger>(fileSizeItem)->value(); // Получение размера файла
-    return fileSize; // Возвращение размера файла
+    return totalLength;
 }
 
 // Получить размер куска файла из торрент-файла
@@ -186,3 +212,64 @@ std::vector<std::vector<std::string>> TorrentFile::getAnnounceList() const
 
     return result;                   // Возвращение списка адресов трекеров
 }
+
+// Получить файлы торрента в порядке их следования в данных
+const std::vector<TorrentFileEntry> &TorrentFile::getFiles() const
+{
+    return files;
+}
+
+std::vector<TorrentFileEntry> TorrentFile::parseFiles() const
+{
+    // Поиск только в словаре info: рекурсивный get("length") в многофайловом торренте вернул бы размер первого файла
+    auto info = std::dynamic_pointer_cast<BDictionary>(childValue(root, "info"));
+    auto nameItem = std::dynamic_pointer_cast<BString>(childValue(info, "name"));
+    if (!nameItem)
+    {
+        throw std::runtime_error("Торрент-файл поврежден. [Файл не содержит ключ 'name']");
+    }
+    std::string name = checkPathComponent(nameItem->value()); // Имя файла или корневого каталога
+
+    std::vector<TorrentFileEntry> files;
+    auto filesItem = std::dynamic_pointer_cast<BList>(childValue(info, "files"));
+    if (!filesItem)
+    {
+        // Однофайловый торрент
+        auto lengthItem = std::dynamic_pointer_cast<BInteger>(childValue(info, "length"));
+        if (!lengthItem || lengthItem->value() < 0)
+        {
+            throw std::runtime_error("Торрент-файл поврежден. [Файл не содержит ключ 'length']");
+        }
+        files.push_back({name, (long)lengthItem->value(), 0});
+        return files;
+    }
+
+    long offset = 0; // Смещение очередного файла в данных торрента
+    for (const auto &fileItem : *filesItem)
+    {
+        auto fileDictionary = std::dynamic_pointer_cast<BDictionary>(fileItem);
+        auto lengthItem = std::dynamic_pointer_cast<BInteger>(childValue(fileDictionary, "length"));
+        auto pathItem = std::dynamic_pointer_cast<BList>(childValue(fileDictionary, "path"));
+        if (!lengthItem || lengthItem->value() < 0 || !pathItem || pathItem->size() == 0)
+        {
+            throw std::runtime_error("Торрент-файл поврежден. [Неверное описание файла в списке 'files']");
+        }
+        std::string path = name;
+        for (const auto &componentItem : *pathItem)
+        {
+            auto component = std::dynamic_pointer_cast<BString>(componentItem);
+            if (!component)
+            {
+                throw std::runtime_error("Торрент-файл поврежден. [Неверное описание файла в списке 'files']");
+            }
+            path += "/" + checkPathComponent(component->value());
+        }
+        files.push_back({path, (long)lengthItem->value(), offset});
+        offset += lengthItem->value();
+    }
+    if (files.empty())
+    {
+        throw std::runtime_error("Торрент-файл поврежден. [Пустой список 'files']");
+    }
+    return files;
+}
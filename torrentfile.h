@@ -2,27 +2,43 @@
 #define TORRENTFILE_H
 
 #include "bencode.h"
+#include "sha1.h"
 #include <string>
 #include <vector>
 
+// Файл раздачи: путь относительно каталога загрузки и положение в общих данных торрента
+struct TorrentFileEntry
+{
+    std::string path;                  // Путь файла ("имя" или "имя/каталог/файл")
+    long length;                       // Размер файла
+    long offset;                       // Смещение начала файла в данных торрента
+};
+
 // Класс TorrentFile предназначен для разбора торрент-файлов
 class TorrentFile {
     private:
     std::shared_ptr<BDictionary> root; // Корневой элемент торрент-файла
+    std::vector<TorrentFileEntry> files; // Файлы торрента в порядке следования в данных
+    long totalLength = 0;              // Суммарный размер файлов
+
+    // Разбор списка файлов из словаря info (std::runtime_error, если он поврежден)
+    std::vector<TorrentFileEntry> parseFiles() const;
 
     public:
     explicit TorrentFile(const std::string &filePath); // Конструктор класса
-    long getFileSize() const;    // Получить размер файла из торрент-файла
+    long getFileSize() const;    // Получить общий размер всех файлов торрента
     long getPieceLength() const; // Получить размер куска файла из торрент-файла
     std::string getFileName() const; // Получить имя файла из торрент-файла
     std::string getAnnounce() const; // Получить адрес трекера из торрент-файла
     std::shared_ptr<BItem> get(std::string key) const; // Получить элемент по ключу из торрент-файла
-    std::string getInfoHash() const;                   // Получить хеш информации о файле
+    Sha1Digest getInfoHash() const;                    // Получить хеш информации о файле
     std::vector<std::string> splitPieceHashes() const; // Разделить хеши кусков файла
     std::string getComment() const; // Получить комментарий к торрент-файлу
     std::string getCreatedBy() const; // Получить информацию о создателе торрент-файла
     std::string getCreationDate() const; // Получить дату создания торрент-файла
     std::vector<std::vector<std::string>> getAnnounceList() const; // Получить список адресов трекеров из торрент-файла
+    // Получить файлы торрента в порядке их следования в данных; для однофайлового торрента - один файл
+    const std::vector<TorrentFileEntry> &getFiles() const;
 
     // Объявляем функцию вывода как друга
     friend std::ostream &operator<<(std::ostream &os, const TorrentFile &torrentFile)
@@ -30,7 +46,7 @@ class TorrentFile {
         os << "File Name: " << torrentFile.getFileName() << std::endl;
         os << "File Size: " << torrentFile.getFileSize() << " bytes" << std::endl;
         os << "Piece Length: " << torrentFile.getPieceLength() << " bytes" << std::endl;
-        os << "Info Hash: " << torrentFile.getInfoHash() << std::endl;
+        os << "Info Hash: " << sha1Hex(torrentFile.getInfoHash()) << std::endl;
         os << "Announce URL: " << torrentFile.getAnnounce() << std::endl;
         os << "Comment: " << torrentFile.getComment() << std::endl;
         os << "Created By: " << torrentFile.getCreatedBy() << std::endl;
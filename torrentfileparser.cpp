@@ -29,12 +29,11 @@ std::shared_ptr<BItem> TorrentFileParser::get(std::string key) const
 }
 
 // Получить хеш информации о файле
-std::string TorrentFileParser::getInfoHash() const
+Sha1Digest TorrentFileParser::getInfoHash() const
 {
     std::shared_ptr<BItem> infoDictionary = get("info"); // Получение информационного словаря
     std::string infoString = encode(infoDictionary);     // Кодирование словаря в строку
-    std::string sha1Hash = sha1(infoString);             // Вычисление хеша SHA1
-    return sha1Hash;                                     // Возвращение хеша
+    return sha1Digest(infoString);                       // Вычисление хеша SHA1
 }
 
 // Разделить хеши кусков файла
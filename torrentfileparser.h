@@ -2,6 +2,7 @@
 #define TORRENTFILEPARSER_H
 
 #include "bencode.h"
+#include "sha1.h"
 #include <string>
 #include <vector>
 
@@ -17,7 +18,7 @@ class TorrentFileParser {
     std::string getFileName() const; // Получить имя файла из торрент-файла
     std::string getAnnounce() const; // Получить адрес трекера из торрент-файла
     std::shared_ptr<BItem> get(std::string key) const; // Получить элемент по ключу из торрент-файла
-    std::string getInfoHash() const;                   // Получить хеш информации о файле
+    Sha1Digest getInfoHash() const;                    // Получить хеш информации о файле
     std::vector<std::string> splitPieceHashes() const; // Разделить хеши кусков файла
     std::string getComment() const; // Получить комментарий к торрент-файлу
     std::string getCreatedBy() const; // Получить информацию о создателе торрент-файла
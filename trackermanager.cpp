@@ -0,0 +1,471 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include "trackermanager.h"
+#include "udptracker.h"
+
+#define SCRAPE_TIMEOUT 3000      // Сколько первый раунд ждет ответов scrape (миллисекунды)
+#define MIN_FORCED_INTERVAL 30   // Внеочередной анонс, если трекер не задал min interval (секунды)
+#define FAILED_RETRY_INTERVAL 60 // Пауза перед повтором запроса к не ответившему трекеру за каждую неудачу
+#define MAX_RETRY_INTERVAL 1800  // Наибольшая пауза перед повтором (секунды)
+#define NUMWANT_SWARM_MARGIN 5   // Запас numwant сверх размера раздачи по данным трекера
+
+// Трекер, который клиент может опросить (http:// или udp://); остальные отбрасываются с сообщением
+static bool isSupported(const std::string &url)
+{
+    std::string host;
+    int port;
+    std::string target;
+    if (HttpClient::parseUrl(url, host, port, target) || UdpTracker::parseUrl(url, host, port))
+    {
+        return true;
+    }
+    std::cerr << "Трекер " << url << " пропущен: "
+              << (url.compare(0, 8, "https://") == 0 ? "HTTPS не поддерживается" : "неподдерживаемый протокол")
+              << std::endl;
+    return false;
+}
+
+TrackerManager::TrackerManager(EventLoop &loop,
+                               std::string peerId,
+                               std::string infoHash,
+                               const int port,
+                               const unsigned long fileSize,
+                               const std::string &announce,
+                               const std::vector<std::vector<std::string>> &announceList,
+                               Handler handler)
+    : peerId(std::move(peerId)), infoHash(std::move(infoHash)), port(port), fileSize(fileSize),
+      handler(std::move(handler)), loop(loop), http(loop), alive(std::make_shared<bool>(true))
+{
+    // При наличии announce-list ключ announce игнорируется (BEP 12)
+    std::set<std::string> seen;
+    std::mt19937 generator{std::random_device{}()};
+    for (const auto &list : announceList)
+    {
+        std::vector<Tracker> tier;
+        for (const std::string &url : list)
+        {
+            if (!url.empty() && seen.insert(url).second && isSupported(url))
+            {
+                tier.push_back({url});
+            }
+        }
+        if (!tier.empty())
+        {
+            // Начальный порядок трекеров внутри уровня случайный
+            std::shuffle(tier.begin(), tier.end(), generator);
+            tiers.push_back(std::move(tier));
+        }
+    }
+    if (tiers.empty() && !announce.empty() && !seen.count(announce) && isSupported(announce))
+    {
+        tiers.push_back({{announce}});
+    }
+    if (tiers.empty() && (!announce.empty() || !announceList.empty()))
+    {
+        std::cerr << "Ни один трекер торрента не поддерживается, пиры ищутся только через DHT, PEX и кэш"
+                  << std::endl;
+    }
+}
+
+TrackerManager::~TrackerManager()
+{
+    // Ответы трекеров, пришедшие позже, отбрасываются по признаку жизни
+    alive.reset();
+    if (scrapeTimer)
+    {
+        loop.cancelTimer(scrapeTimer);
+    }
+}
+
+bool TrackerManager::isAnnouncing() const
+{
+    return announcing;
+}
+
+int TrackerManager::getTrackerCount() const
+{
+    int count = 0;
+    for (const auto &tier : tiers)
+    {
+        count += tier.size();
+    }
+    return count;
+}
+
+TrackerManager::Tracker *TrackerManager::findTracker(const std::string &url)
+{
+    for (auto &tier : tiers)
+    {
+        for (Tracker &tracker : tier)
+        {
+            if (tracker.url == url)
+            {
+                return &tracker;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool TrackerManager::isDue(const Tracker &tracker, bool force, time_t now) const
+{
+    if (tracker.lastAnnounce == 0)
+    {
+        return true;
+    }
+    double elapsed = std::difftime(now, tracker.lastAnnounce);
+    // Не ответивший трекер повторяется с растущей паузой
+    if (tracker.interval == 0)
+    {
+        return elapsed >= std::min(FAILED_RETRY_INTERVAL * tracker.failures, MAX_RETRY_INTERVAL);
+    }
+    if (force)
+    {
+        return elapsed >= std::max(tracker.minInterval, MIN_FORCED_INTERVAL);
+    }
+    return elapsed >= tracker.interval;
+}
+
+// Размер раздачи по данным трекера: -1, если неизвестен
+static int swarmSize(int seeders, int leechers)
+{
+    if (seeders < 0 && leechers < 0)
+    {
+        return -1;
+    }
+    return std::max(seeders, 0) + std::max(leechers, 0);
+}
+
+std::vector<TrackerManager::Request> TrackerManager::selectTrackers(
+    size_t tierIndex, int numWant, bool force, TrackerEvent event, bool seeding, bool &serving) const
+{
+    // Пока файл не скачан, нужны любые пиры, после - только качающие
+    auto useful = [seeding](const Tracker &tracker) {
+        return seeding ? tracker.leechers : swarmSize(tracker.seeders, tracker.leechers);
+    };
+    std::vector<Request> selected;
+    serving = false;
+
+    // Уровень, где ни один трекер не знает о пирах, а хотя бы один сообщил о пустой раздаче,
+    // пропускается, если пиры есть ниже
+    bool tierEmpty = false;
+    bool tierHasPeers = false;
+    for (const Tracker &tracker : tiers[tierIndex])
+    {
+        tierEmpty = tierEmpty || useful(tracker) == 0;
+        tierHasPeers = tierHasPeers || useful(tracker) > 0;
+    }
+    tierEmpty = tierEmpty && !tierHasPeers;
+    bool laterHasPeers = false;
+    for (size_t later = tierIndex + 1; later < tiers.size(); later++)
+    {
+        for (const Tracker &tracker : tiers[later])
+        {
+            laterHasPeers = laterHasPeers || useful(tracker) > 0;
+        }
+    }
+    if (tierEmpty && laterHasPeers && event == eventNone)
+    {
+        return selected;
+    }
+
+    time_t now = std::time(nullptr);
+    for (const Tracker &tracker : tiers[tierIndex])
+    {
+        // О событии сообщается сразу, не дожидаясь интервала
+        if (event == eventNone && !isDue(tracker, force, now))
+        {
+            serving = serving || tracker.interval > 0;
+            continue;
+        }
+        // Трекер с пустой раздачей не нужен, пока другие трекеры уровня знают о пирах
+        if (!seeding && event == eventNone && useful(tracker) == 0 && tierHasPeers)
+        {
+            continue;
+        }
+        // Больше пиров, чем в раздаче, трекер не даст; запас покрывает пиров, пришедших после scrape
+        int size = useful(tracker);
+        selected.push_back({tracker.url, size >= 0 ? std::min(numWant, size + NUMWANT_SWARM_MARGIN) : numWant});
+    }
+    return selected;
+}
+
+bool TrackerManager::announce(
+    unsigned long bytesDownloaded, unsigned long bytesUploaded, int numWant, bool force, TrackerEvent event)
+{
+    if (tiers.empty())
+    {
+        return false;
+    }
+    if (announcing)
+    {
+        // Событие нельзя потерять: оно отправится, когда текущий раунд завершится
+        if (event == eventNone)
+        {
+            return false;
+        }
+        deferred.bytesDownloaded = bytesDownloaded;
+        deferred.bytesUploaded = bytesUploaded;
+        deferred.numWant = numWant;
+        deferred.event = event;
+        return true;
+    }
+    bool due = false;
+    for (size_t tierIndex = 0; tierIndex < tiers.size() && !due; tierIndex++)
+    {
+        bool serving;
+        due = !selectTrackers(tierIndex, numWant, force, event, bytesDownloaded >= fileSize, serving).empty();
+        if (serving)
+        {
+            break;
+        }
+    }
+    if (!due)
+    {
+        return false;
+    }
+
+    announcing = true;
+    int number = current.number + 1;
+    current = Round();
+    current.number = number;
+    current.bytesDownloaded = bytesDownloaded;
+    current.bytesUploaded = bytesUploaded;
+    current.numWant = numWant;
+    current.force = force;
+    current.event = event;
+    if (!scraped)
+    {
+        waitingScrape = true;
+        startScrape();
+    }
+    else
+    {
+        startTier();
+    }
+    return true;
+}
+
+bool TrackerManager::announceStopped(unsigned long bytesDownloaded,
+                                     unsigned long bytesUploaded,
+                                     std::function<void()> done)
+{
+    // Ответы прерванного раунда отбрасываются по номеру раунда
+    announcing = false;
+    waitingScrape = false;
+    current.number++;
+    deferred = Round();
+    // Счетчик удерживается на время отправки, чтобы ответ без ожидания не завершил анонс раньше времени
+    auto pending = std::make_shared<int>(1);
+    std::weak_ptr<bool> token = alive;
+    for (const auto &tier : tiers)
+    {
+        for (const Tracker &tracker : tier)
+        {
+            if (tracker.successes == 0)
+            {
+                continue;
+            }
+            auto retriever = std::make_shared<PeerRetriever>(peerId, tracker.url, infoHash, port, fileSize);
+            (*pending)++;
+            retriever->retrievePeers(http, bytesDownloaded, bytesUploaded, 0, eventStopped,
+                                     [token, retriever, pending, done](std::vector<Peer>) {
+                                         if (--*pending == 0 && !token.expired())
+                                         {
+                                             done();
+                                         }
+                                     });
+        }
+    }
+    return --*pending > 0;
+}
+
+void TrackerManager::startScrape()
+{
+    scraped = true;
+    std::weak_ptr<bool> token = alive;
+    for (const auto &tier : tiers)
+    {
+        for (const Tracker &tracker : tier)
+        {
+            auto retriever = std::make_shared<PeerRetriever>(peerId, tracker.url, infoHash, port, fileSize);
+            scrapePending++;
+            retriever->scrape(http, [this, token, retriever, url = tracker.url](bool success) {
+                if (token.expired())
+                {
+                    return;
+                }
+                // Данные анонса свежее, чем scrape, поэтому поздний ответ их не перезаписывает
+                Tracker *tracker = findTracker(url);
+                if (success && tracker && tracker->interval == 0)
+                {
+                    tracker->seeders = retriever->getSeeders();
+                    tracker->leechers = retriever->getLeechers();
+                }
+                if (--scrapePending == 0)
+                {
+                    finishScrape();
+                }
+            });
+        }
+    }
+    scrapeTimer = loop.addTimer(
+        SCRAPE_TIMEOUT,
+        [this, token]() {
+            if (!token.expired())
+            {
+                scrapeTimer = 0;
+                finishScrape();
+            }
+        },
+        false);
+}
+
+void TrackerManager::finishScrape()
+{
+    if (scrapeTimer)
+    {
+        loop.cancelTimer(scrapeTimer);
+        scrapeTimer = 0;
+    }
+    if (waitingScrape)
+    {
+        waitingScrape = false;
+        startTier();
+    }
+}
+
+void TrackerManager::startTier()
+{
+    const bool seeding = current.bytesDownloaded >= fileSize;
+    for (; current.tierIndex < tiers.size(); current.tierIndex++)
+    {
+        std::vector<Request> selected =
+            selectTrackers(current.tierIndex, current.numWant, current.force, current.event, seeding, current.serving);
+        if (selected.empty())
+        {
+            // Уровень обслуживает нас до истечения интервала - следующие уровни не нужны
+            if (current.serving)
+            {
+                break;
+            }
+            continue;
+        }
+
+        // Все выбранные трекеры уровня опрашиваются одновременно
+        time_t now = std::time(nullptr);
+        std::weak_ptr<bool> token = alive;
+        current.pending = selected.size();
+        current.gotPeers = false;
+        current.succeeded.clear();
+        for (const Request &request : selected)
+        {
+            findTracker(request.url)->lastAnnounce = now;
+            auto retriever = std::make_shared<PeerRetriever>(peerId, request.url, infoHash, port, fileSize);
+            retriever->retrievePeers(
+                http, current.bytesDownloaded, current.bytesUploaded, request.numWant, current.event,
+                [this, token, retriever, url = request.url, number = current.number](std::vector<Peer> peers) {
+                    if (!token.expired())
+                    {
+                        onAnnounced(number, url, *retriever, std::move(peers));
+                    }
+                });
+        }
+        return;
+    }
+    finishRound();
+}
+
+void TrackerManager::onAnnounced(int round, const std::string &url, const PeerRetriever &retriever, std::vector<Peer> peers)
+{
+    if (!announcing || round != current.number)
+    {
+        return;
+    }
+    std::vector<Peer> fresh;
+    fresh.reserve(peers.size());
+    for (Peer &peer : peers)
+    {
+        if (current.delivered.insert(peer.compact()).second)
+        {
+            fresh.push_back(std::move(peer));
+        }
+    }
+    current.gotPeers = current.gotPeers || !peers.empty();
+
+    Tracker *tracker = findTracker(url);
+    if (tracker)
+    {
+        bool success = retriever.getInterval() > 0;
+        if (success)
+        {
+            current.succeeded.push_back(url);
+        }
+        tracker->successes += success;
+        tracker->failures = success ? 0 : tracker->failures + 1;
+        tracker->interval = retriever.getInterval();
+        tracker->minInterval = retriever.getMinInterval();
+        if (success && swarmSize(retriever.getSeeders(), retriever.getLeechers()) >= 0)
+        {
+            tracker->seeders = retriever.getSeeders();
+            tracker->leechers = retriever.getLeechers();
+        }
+    }
+    if (!fresh.empty())
+    {
+        handler(std::move(fresh), round);
+    }
+    if (--current.pending == 0)
+    {
+        finishTier();
+    }
+}
+
+void TrackerManager::finishTier()
+{
+    // Ответившие трекеры переносятся в начало уровня в порядке скорости ответа,
+    // не ответившие остаются за ними, реже отказывавшие - раньше
+    std::vector<std::string> &succeeded = current.succeeded;
+    std::vector<Tracker> &tier = tiers[current.tierIndex];
+    std::stable_sort(tier.begin(), tier.end(), [&succeeded](const Tracker &a, const Tracker &b) {
+        auto rank = [&succeeded](const Tracker &tracker) {
+            return std::find(succeeded.begin(), succeeded.end(), tracker.url) - succeeded.begin();
+        };
+        if (rank(a) != rank(b))
+        {
+            return rank(a) < rank(b);
+        }
+        return a.failures < b.failures;
+    });
+
+    // Следующий уровень нужен, только если этот уровень не дал пиров и не обслуживает нас.
+    // О завершении достаточно сообщить одному уровню, даже если раздающему он пиров не дал
+    if (current.gotPeers || current.serving || (current.event == eventCompleted && !current.succeeded.empty()))
+    {
+        finishRound();
+        return;
+    }
+    current.tierIndex++;
+    startTier();
+}
+
+void TrackerManager::finishRound()
+{
+    announcing = false;
+    if (deferred.event == eventNone)
+    {
+        return;
+    }
+    // Раунд завершается в обработчике ответа, поэтому отложенный анонс запускается из цикла
+    Round next = deferred;
+    deferred = Round();
+    std::weak_ptr<bool> token = alive;
+    loop.post([this, token, next]() {
+        if (!token.expired())
+        {
+            announce(next.bytesDownloaded, next.bytesUploaded, next.numWant, false, next.event);
+        }
+    });
+}
@@ -0,0 +1,128 @@
+#ifndef TRACKERMANAGER_H
+#define TRACKERMANAGER_H
+
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "eventloop.h"
+#include "httpclient.h"
+#include "peerretriever.h"
+
+/*
+ Анонс по списку трекеров (BEP 12). Уровни опрашиваются по порядку, трекеры одного уровня -
+ одновременно. Пиры передаются обработчику по мере ответов трекеров без повторов внутри раунда,
+ поэтому медленный трекер не задерживает начало загрузки. Ответивший трекер переносится
+ в начало своего уровня и в следующем раунде опрашивается первым.
+
+ Перед первым анонсом все трекеры опрашиваются через scrape. Трекер, у которого раздача пуста,
+ пропускается, если другой трекер уровня знает о пирах, а пустой уровень - если пиры есть на
+ следующих. numwant ограничивается размером раздачи. Каждый трекер опрашивается не чаще своего
+ interval, внеочередной анонс - не чаще min interval. Анонс с событием (started, completed) отправляется
+ трекерам уровня независимо от интервалов; если в это время идет раунд, событие ждет его окончания.
+ Событие stopped прерывает раунд и отправляется всем трекерам, которые отвечали в этой сессии.
+
+ Раунд выполняется на цикле событий: HTTP- и UDP-запросы и разрешение имен не блокируют поток
+ и не требуют отдельных потоков. Все методы и обработчик пиров вызываются в потоке цикла.
+ Трекеры с неподдерживаемым протоколом (https://) отбрасываются с сообщением об ошибке.
+ */
+class TrackerManager {
+    public:
+    // Обработчик новых пиров; round - номер раунда анонса (растет с каждым вызовом announce)
+    using Handler = std::function<void(std::vector<Peer> peers, int round)>;
+
+    private:
+    struct Tracker
+    {
+        std::string url;             // URL трекера
+        int successes = 0;           // Количество успешных ответов
+        int failures = 0;            // Количество неудачных запросов подряд
+        int interval = 0;            // Интервал анонса из последнего ответа (0 - трекер не ответил)
+        int minInterval = 0;         // Минимальный интервал анонса из последнего ответа
+        time_t lastAnnounce = 0;     // Время последнего анонса
+        int seeders = -1;            // Раздающие по данным scrape или анонса (-1 - неизвестно)
+        int leechers = -1;           // Качающие (-1 - неизвестно)
+    };
+
+    struct Request
+    {
+        std::string url;             // URL трекера
+        int numWant;                 // Сколько пиров запросить
+    };
+
+    // Состояние выполняемого раунда
+    struct Round
+    {
+        int number = 0;              // Номер раунда
+        unsigned long bytesDownloaded = 0; // Скачано байт на момент анонса
+        unsigned long bytesUploaded = 0;   // Отдано байт на момент анонса
+        int numWant = DEFAULT_NUMWANT; // Сколько пиров запросить
+        bool force = false;          // Внеочередной анонс
+        TrackerEvent event = eventNone; // Событие анонса
+        size_t tierIndex = 0;        // Опрашиваемый уровень
+        size_t pending = 0;          // Запросы уровня без ответа
+        bool serving = false;        // Уровень уже обслуживает нас
+        bool gotPeers = false;       // Уровень дал пиров
+        std::vector<std::string> succeeded; // Ответившие трекеры уровня в порядке ответа
+        std::set<std::string> delivered; // Компактные адреса пиров, уже переданных обработчику
+    };
+
+    const std::string peerId;        // Идентификатор клиента
+    const std::string infoHash;      // Хэш информации (20 байт)
+    const int port;                  // Порт для входящих соединений
+    const unsigned long fileSize;    // Размер файла
+    std::vector<std::vector<Tracker>> tiers; // Уровни трекеров
+    Handler handler;                 // Получатель пиров
+    EventLoop &loop;                 // Цикл событий
+    HttpClient http;                 // Клиент HTTP-трекеров
+    bool announcing = false;         // Раунд выполняется
+    bool scraped = false;            // Scrape уже запущен
+    bool waitingScrape = false;      // Раунд ждет ответов scrape
+    int scrapePending = 0;           // Запросы scrape без ответа
+    int scrapeTimer = 0;             // Таймер ожидания scrape
+    Round current;                   // Текущий раунд
+    Round deferred;                  // Анонс с событием, ожидающий окончания текущего раунда
+    std::shared_ptr<bool> alive;     // Признак жизни менеджера для ответов, пришедших после уничтожения
+
+    void startScrape();              // Запуск scrape всех трекеров
+    void finishScrape();             // Ответы scrape получены или время ожидания истекло
+    void startTier();                // Опрос очередного уровня раунда
+    void finishTier();               // Все трекеры уровня ответили
+    void finishRound();              // Раунд завершен, запуск отложенного анонса с событием
+    // Ответ трекера на анонс
+    void onAnnounced(int round, const std::string &url, const PeerRetriever &retriever, std::vector<Peer> peers);
+    Tracker *findTracker(const std::string &url); // Трекер по URL
+    bool isDue(const Tracker &tracker, bool force, time_t now) const; // Пора ли опрашивать трекер
+    // Трекеры уровня, которые нужно опросить сейчас; serving - уровень уже обслуживает нас
+    // (трекер ответил, и его интервал не истек)
+    std::vector<Request> selectTrackers(
+        size_t tierIndex, int numWant, bool force, TrackerEvent event, bool seeding, bool &serving) const;
+
+    public:
+    TrackerManager(EventLoop &loop,
+                   std::string peerId,
+                   std::string infoHash,
+                   int port,
+                   unsigned long fileSize,
+                   const std::string &announce,
+                   const std::vector<std::vector<std::string>> &announceList,
+                   Handler handler);  // Конструктор класса
+    ~TrackerManager();                // Деструктор класса, незавершенные запросы отменяются
+    // Запуск раунда анонса; force - внеочередной анонс (с соблюдением min interval), event - событие
+    // анонса. false, если предыдущий раунд еще не завершен или ни одному трекеру еще рано отвечать
+    bool announce(unsigned long bytesDownloaded,
+                  unsigned long bytesUploaded,
+                  int numWant,
+                  bool force = false,
+                  TrackerEvent event = eventNone);
+    // Анонс остановки трекерам, отвечавшим в этой сессии; текущий и отложенный раунды отменяются.
+    // done вызывается в потоке цикла, когда ответили все трекеры. false, если ждать нечего
+    bool announceStopped(unsigned long bytesDownloaded, unsigned long bytesUploaded, std::function<void()> done);
+    bool isAnnouncing() const;        // Выполняется ли раунд
+    int getTrackerCount() const;      // Общее количество трекеров
+};
+
+#endif                                // TRACKERMANAGER_H
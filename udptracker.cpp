@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <endian.h>
+#include <random>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "udptracker.h"
+
+#define UDP_PROTOCOL_ID 0x41727101980ULL // Магическая константа запроса connect
+#define UDP_CONNECTION_TTL 60            // Время жизни идентификатора соединения (секунды)
+#define UDP_RETRANSMIT_BASE 2000         // Начальный тайм-аут ответа (миллисекунды), удваивается при повторе
+#define UDP_MAX_RETRANSMITS 3            // Количество повторов запроса
+#define UDP_MAX_RESPONSE 4096            // Максимальный размер ответа трекера
+#define UDP_MAX_SCRAPE 74                // Максимум info_hash в одном запросе scrape
+#define ACTION_CONNECT 0
+#define ACTION_ANNOUNCE 1
+#define ACTION_SCRAPE 2
+#define ACTION_ERROR 3
+
+std::map<std::string, UdpTracker::Connection> UdpTracker::connections;
+std::mutex UdpTracker::connectionsLock;
+
+// Запись целых чисел в сетевом порядке байт
+static void put32(std::string &buffer, uint32_t value)
+{
+    value = htonl(value);
+    buffer.append((char *)&value, sizeof(value));
+}
+
+static void put64(std::string &buffer, uint64_t value)
+{
+    value = htobe64(value);
+    buffer.append((char *)&value, sizeof(value));
+}
+
+static uint32_t get32(const std::string &buffer, size_t offset)
+{
+    uint32_t value;
+    std::memcpy(&value, buffer.data() + offset, sizeof(value));
+    return ntohl(value);
+}
+
+static uint64_t get64(const std::string &buffer, size_t offset)
+{
+    uint64_t value;
+    std::memcpy(&value, buffer.data() + offset, sizeof(value));
+    return be64toh(value);
+}
+
+static uint32_t randomId()
+{
+    static thread_local std::mt19937 gen(std::random_device{}());
+    return gen();
+}
+
+UdpTracker::UdpTracker(EventLoop &loop, Resolver &resolver, std::string host, const int port)
+    : loop(loop), resolver(resolver), host(std::move(host)), port(port)
+{
+}
+
+UdpTracker::~UdpTracker()
+{
+    // Отслеживание сокета снято в finish: живой объект всегда удерживается обработчиком цикла
+    if (sock >= 0)
+    {
+        close(sock);
+    }
+}
+
+bool UdpTracker::parseUrl(const std::string &url, std::string &host, int &port)
+{
+    const std::string scheme = "udp://";
+    if (url.compare(0, scheme.length(), scheme) != 0)
+    {
+        return false;
+    }
+    size_t hostEnd = url.find_first_of(":/", scheme.length());
+    host = url.substr(scheme.length(), hostEnd - scheme.length());
+    port = 80;
+    if (hostEnd != std::string::npos && url[hostEnd] == ':')
+    {
+        port = std::atoi(url.c_str() + hostEnd + 1);
+    }
+    return !host.empty() && port > 0 && port < 65536;
+}
+
+void UdpTracker::open(std::function<void(const std::string &error)> done)
+{
+    if (sock >= 0)
+    {
+        loop.post([done]() { done(""); });
+        return;
+    }
+    std::shared_ptr<UdpTracker> self = shared_from_this();
+    resolver.resolve(host, port, SOCK_DGRAM, [self, done](std::vector<struct sockaddr_storage> addresses) {
+        if (addresses.empty())
+        {
+            done("Не удалось разрешить адрес UDP-трекера " + self->host);
+            return;
+        }
+        // Первый адрес, к которому удалось привязать сокет (IPv6 без маршрута отсеивается на connect)
+        for (const struct sockaddr_storage &address : addresses)
+        {
+            if (self->sock >= 0)
+            {
+                break;
+            }
+            self->sock = socket(address.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            // connect() у UDP-сокета отбрасывает датаграммы с чужих адресов
+            if (self->sock >= 0 &&
+                connect(self->sock, (const struct sockaddr *)&address, Resolver::addressLength(address)) < 0)
+            {
+                close(self->sock);
+                self->sock = -1;
+            }
+            self->family = address.ss_family;
+        }
+        done(self->sock < 0 ? "Не удалось создать сокет для UDP-трекера " + self->host : "");
+    });
+}
+
+void UdpTracker::transact(
+    std::string request, uint32_t transactionId, uint32_t action, size_t minLength, ResponseCallback done)
+{
+    std::shared_ptr<UdpTracker> self = shared_from_this();
+    open([self, request = std::move(request), transactionId, action, minLength, done](const std::string &error) {
+        if (!error.empty())
+        {
+            done("", error);
+            return;
+        }
+        self->current = Transaction();
+        self->current.request = request;
+        self->current.transactionId = transactionId;
+        self->current.action = action;
+        self->current.minLength = minLength;
+        self->current.done = done;
+        self->loop.watchFd(self->sock, POLLIN, [self](short) { self->onReadable(); });
+        self->sendAttempt();
+    });
+}
+
+void UdpTracker::sendAttempt()
+{
+    if (send(sock, current.request.data(), current.request.length(), 0) < 0)
+    {
+        finish("", "Не удалось отправить запрос UDP-трекеру " + host);
+        return;
+    }
+    std::shared_ptr<UdpTracker> self = shared_from_this();
+    current.timer = loop.addTimer(
+        (long)UDP_RETRANSMIT_BASE << current.attempt,
+        [self]() {
+            self->current.timer = 0;
+            if (++self->current.attempt > UDP_MAX_RETRANSMITS)
+            {
+                self->finish("", "UDP-трекер " + self->host + " не отвечает");
+                return;
+            }
+            self->sendAttempt();
+        },
+        false);
+}
+
+void UdpTracker::onReadable()
+{
+    char buffer[UDP_MAX_RESPONSE];
+    while (current.done)
+    {
+        long bytesRead = recv(sock, buffer, sizeof(buffer), 0);
+        // ICMP port unreachable: трекер на этом адресе не запущен, повторы бессмысленны
+        if (bytesRead < 0 && errno == ECONNREFUSED)
+        {
+            finish("", "UDP-трекер " + host + " отклонил соединение");
+            return;
+        }
+        if (bytesRead < 0)
+        {
+            return;
+        }
+        if (bytesRead < 8)
+        {
+            continue;
+        }
+        std::string response(buffer, bytesRead);
+        // Ответы на предыдущие попытки и посторонние пакеты пропускаются
+        if (get32(response, 4) != current.transactionId)
+        {
+            continue;
+        }
+        uint32_t responseAction = get32(response, 0);
+        if (responseAction == ACTION_ERROR || (responseAction == current.action && response.length() >= current.minLength))
+        {
+            finish(response, "");
+            return;
+        }
+    }
+}
+
+void UdpTracker::finish(const std::string &response, const std::string &error)
+{
+    loop.unwatchFd(sock);
+    if (current.timer)
+    {
+        loop.cancelTimer(current.timer);
+    }
+    ResponseCallback done = std::move(current.done);
+    current = Transaction();
+    done(response, error);
+}
+
+void UdpTracker::getConnectionId(bool renew, ConnectionCallback done)
+{
+    std::string key = host + ":" + std::to_string(port);
+    {
+        std::lock_guard<std::mutex> guard(connectionsLock);
+        auto iter = connections.find(key);
+        if (!renew && iter != connections.end() &&
+            std::difftime(std::time(nullptr), iter->second.obtained) < UDP_CONNECTION_TTL)
+        {
+            uint64_t connectionId = iter->second.connectionId;
+            loop.post([done, connectionId]() { done(connectionId, ""); });
+            return;
+        }
+    }
+    uint32_t transactionId = randomId();
+    std::string request;
+    put64(request, UDP_PROTOCOL_ID);
+    put32(request, ACTION_CONNECT);
+    put32(request, transactionId);
+    std::shared_ptr<UdpTracker> self = shared_from_this();
+    transact(request, transactionId, ACTION_CONNECT, 16,
+             [self, key, done](const std::string &response, const std::string &error) {
+                 if (!error.empty())
+                 {
+                     done(0, error);
+                     return;
+                 }
+                 if (get32(response, 0) == ACTION_ERROR)
+                 {
+                     done(0, "UDP-трекер " + self->host + " вернул ошибку: " + response.substr(8));
+                     return;
+                 }
+                 uint64_t connectionId = get64(response, 8);
+                 {
+                     std::lock_guard<std::mutex> guard(connectionsLock);
+                     connections[key] = {connectionId, std::time(nullptr)};
+                 }
+                 done(connectionId, "");
+             });
+}
+
+void UdpTracker::forgetConnection()
+{
+    std::lock_guard<std::mutex> guard(connectionsLock);
+    connections.erase(host + ":" + std::to_string(port));
+}
+
+void UdpTracker::request(std::function<std::string(uint64_t connectionId, uint32_t transactionId)> build,
+                         uint32_t action,
+                         size_t minLength,
+                         bool renew,
+                         ResponseCallback done)
+{
+    std::shared_ptr<UdpTracker> self = shared_from_this();
+    getConnectionId(renew, [self, build, action, minLength, renew, done](uint64_t connectionId, const std::string &error) {
+        if (!error.empty())
+        {
+            done("", error);
+            return;
+        }
+        uint32_t transactionId = randomId();
+        self->transact(build(connectionId, transactionId), transactionId, action, minLength,
+                       [self, build, action, minLength, renew, done](const std::string &response, const std::string &error) {
+                           if (!error.empty() || get32(response, 0) != ACTION_ERROR)
+                           {
+                               done(response, error);
+                               return;
+                           }
+                           // Трекер мог забыть идентификатор соединения раньше срока - тогда одна попытка с новым
+                           self->forgetConnection();
+                           if (renew)
+                           {
+                               done("", "UDP-трекер " + self->host + " вернул ошибку: " + response.substr(8));
+                               return;
+                           }
+                           self->request(build, action, minLength, true, done);
+                       });
+    });
+}
+
+void UdpTracker::announce(const std::string &infoHash,
+                          const std::string &peerId,
+                          int listenPort,
+                          uint64_t downloaded,
+                          uint64_t left,
+                          uint64_t uploaded,
+                          TrackerEvent event,
+                          int numWant,
+                          AnnounceCallback done)
+{
+    if (infoHash.length() != 20 || peerId.length() != 20)
+    {
+        loop.post([done]() { done(UdpAnnounceResult(), "info_hash и peer_id должны быть длиной 20 байт"); });
+        return;
+    }
+    static const uint32_t key = randomId(); // Постоянный ключ клиента для трекера
+    auto build = [=](uint64_t connectionId, uint32_t transactionId) {
+        std::string request;
+        put64(request, connectionId);
+        put32(request, ACTION_ANNOUNCE);
+        put32(request, transactionId);
+        request += infoHash;
+        request += peerId;
+        put64(request, downloaded);
+        put64(request, left);
+        put64(request, uploaded);
+        put32(request, event);
+        put32(request, 0); // IP-адрес определяет трекер
+        put32(request, key);
+        put32(request, (uint32_t)numWant);
+        uint16_t networkPort = htons(listenPort);
+        request.append((char *)&networkPort, sizeof(networkPort));
+        return request;
+    };
+    std::shared_ptr<UdpTracker> self = shared_from_this();
+    request(build, ACTION_ANNOUNCE, 20, false, [self, done](const std::string &response, const std::string &error) {
+        UdpAnnounceResult result;
+        if (!error.empty())
+        {
+            done(result, error);
+            return;
+        }
+        result.interval = (int)get32(response, 8);
+        result.leechers = (int)get32(response, 12);
+        result.seeders = (int)get32(response, 16);
+        // Трекер, опрошенный по IPv6, возвращает 18-байтовые записи пиров (BEP 15)
+        size_t entryLength = self->family == AF_INET6 ? COMPACT_PEER6_LEN : COMPACT_PEER_LEN;
+        size_t peersLength = (response.length() - 20) / entryLength * entryLength;
+        result.peers = decodeCompactPeers(std::string_view(response).substr(20, peersLength), entryLength);
+        done(result, "");
+    });
+}
+
+void UdpTracker::scrape(const std::vector<std::string> &infoHashes, ScrapeCallback done)
+{
+    scrapeFrom(std::make_shared<std::vector<std::string>>(infoHashes), 0,
+               std::make_shared<std::vector<UdpScrapeResult>>(), std::move(done));
+}
+
+void UdpTracker::scrapeFrom(std::shared_ptr<std::vector<std::string>> infoHashes,
+                            size_t start,
+                            std::shared_ptr<std::vector<UdpScrapeResult>> results,
+                            ScrapeCallback done)
+{
+    if (start >= infoHashes->size())
+    {
+        loop.post([results, done]() { done(*results, ""); });
+        return;
+    }
+    size_t count = std::min(infoHashes->size() - start, (size_t)UDP_MAX_SCRAPE);
+    auto build = [infoHashes, start, count](uint64_t connectionId, uint32_t transactionId) {
+        std::string request;
+        put64(request, connectionId);
+        put32(request, ACTION_SCRAPE);
+        put32(request, transactionId);
+        for (size_t i = start; i < start + count; i++)
+        {
+            request += (*infoHashes)[i];
+        }
+        return request;
+    };
+    std::shared_ptr<UdpTracker> self = shared_from_this();
+    request(build, ACTION_SCRAPE, 8 + 12 * count, false,
+            [self, infoHashes, start, count, results, done](const std::string &response, const std::string &error) {
+                if (!error.empty())
+                {
+                    done(*results, error);
+                    return;
+                }
+                for (size_t i = 0; i < count; i++)
+                {
+                    size_t offset = 8 + 12 * i;
+                    results->push_back({(int)get32(response, offset), (int)get32(response, offset + 4),
+                                        (int)get32(response, offset + 8)});
+                }
+                // Следующая пачка запрашивается через цикл событий, поэтому стек не растет
+                self->scrapeFrom(infoHashes, start + count, results, done);
+            });
+}
@@ -0,0 +1,120 @@
+#ifndef UDPTRACKER_H
+#define UDPTRACKER_H
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+
+#include "eventloop.h"
+#include "peerretriever.h"
+#include "resolver.h"
+
+struct UdpAnnounceResult
+{
+    int interval = 0;             // Интервал повторного анонса (секунды)
+    int leechers = 0;             // Количество качающих
+    int seeders = 0;              // Количество раздающих
+    std::vector<Peer> peers;      // Полученные пиры
+};
+
+struct UdpScrapeResult
+{
+    int seeders = 0;              // Количество раздающих
+    int completed = 0;            // Сколько раз торрент был скачан полностью
+    int leechers = 0;             // Количество качающих
+};
+
+/*
+ Клиент UDP-трекера (BEP 15): connect, announce и scrape на цикле событий без блокировки потока.
+ Адрес трекера разрешается асинхронно, сокет отслеживается циклом, повторы запросов без ответа
+ идут по таймерам с экспоненциально растущим тайм-аутом. Идентификатор соединения кэшируется
+ на время его жизни (1 минута) отдельно для каждого трекера.
+ Объект создается через std::make_shared и живет, пока не вызван обработчик; запросы одного
+ объекта выполняются по очереди, обработчики вызываются в потоке цикла.
+ */
+class UdpTracker : public std::enable_shared_from_this<UdpTracker> {
+    public:
+    // Результат анонса; error - описание ошибки (пустое при успехе)
+    using AnnounceCallback = std::function<void(const UdpAnnounceResult &result, const std::string &error)>;
+    // Статистика торрентов в порядке запроса; error - описание ошибки (пустое при успехе)
+    using ScrapeCallback = std::function<void(const std::vector<UdpScrapeResult> &results, const std::string &error)>;
+
+    private:
+    using ResponseCallback = std::function<void(const std::string &response, const std::string &error)>;
+    using ConnectionCallback = std::function<void(uint64_t connectionId, const std::string &error)>;
+
+    struct Connection
+    {
+        uint64_t connectionId;    // Идентификатор соединения, выданный трекером
+        time_t obtained;          // Время получения идентификатора
+    };
+
+    // Выполняемый запрос
+    struct Transaction
+    {
+        std::string request;      // Отправляемая датаграмма
+        uint32_t transactionId = 0; // Идентификатор транзакции
+        uint32_t action = 0;      // Ожидаемое действие ответа
+        size_t minLength = 0;     // Наименьшая длина ответа
+        int attempt = 0;          // Номер попытки
+        int timer = 0;            // Таймер ожидания ответа
+        ResponseCallback done;    // Получатель ответа
+    };
+
+    EventLoop &loop;              // Цикл событий
+    Resolver &resolver;           // Разрешение адреса трекера
+    std::string host;             // Адрес трекера
+    int port;                     // UDP-порт трекера
+    int sock = -1;                // Сокет, соединенный с адресом трекера
+    int family = AF_INET;         // Семейство адресов трекера: от него зависит формат пиров в ответе
+    Transaction current;          // Выполняемый запрос
+
+    static std::map<std::string, Connection> connections; // Кэш идентификаторов соединений по host:port
+    static std::mutex connectionsLock;                    // Мьютекс кэша
+
+    // Разрешение адреса и создание сокета; error пустой при успехе
+    void open(std::function<void(const std::string &error)> done);
+    // Отправка запроса и ожидание ответа с тем же transaction_id (или ошибки); повтор при тайм-ауте
+    void transact(std::string request, uint32_t transactionId, uint32_t action, size_t minLength, ResponseCallback done);
+    void sendAttempt();                                   // Отправка запроса и запуск таймера ожидания
+    void onReadable();                                    // Прием ответов трекера
+    void finish(const std::string &response, const std::string &error); // Завершение запроса
+    void getConnectionId(bool renew, ConnectionCallback done); // Идентификатор соединения из кэша или от трекера
+    void forgetConnection();                              // Сброс устаревшего идентификатора
+    // Запрос с идентификатором соединения; при ошибке трекера одна попытка с новым идентификатором
+    void request(std::function<std::string(uint64_t connectionId, uint32_t transactionId)> build,
+                 uint32_t action,
+                 size_t minLength,
+                 bool renew,
+                 ResponseCallback done);
+    // Scrape очередной пачки info_hash, начиная с start
+    void scrapeFrom(std::shared_ptr<std::vector<std::string>> infoHashes,
+                    size_t start,
+                    std::shared_ptr<std::vector<UdpScrapeResult>> results,
+                    ScrapeCallback done);
+
+    public:
+    UdpTracker(EventLoop &loop, Resolver &resolver, std::string host, int port); // Конструктор класса
+    ~UdpTracker();                                        // Деструктор класса
+    // Анонс; infoHash в двоичном виде
+    void announce(const std::string &infoHash,
+                  const std::string &peerId,
+                  int listenPort,
+                  uint64_t downloaded,
+                  uint64_t left,
+                  uint64_t uploaded,
+                  TrackerEvent event,
+                  int numWant,
+                  AnnounceCallback done);
+    void scrape(const std::vector<std::string> &infoHashes, ScrapeCallback done); // Статистика торрентов
+    // Разбор URL вида udp://host:port/announce; false, если URL не UDP
+    static bool parseUrl(const std::string &url, std::string &host, int &port);
+};
+
+#endif                                                    // UDPTRACKER_H
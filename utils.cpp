@@ -16,7 +16,7 @@ std::string urlEncode(const std::string &value)
 
     for (char c : value)
     {
-        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+        if (isalnum((unsigned char)c) || c == '-' || c == '_' || c == '.' || c == '~')
         {
             escaped << c;
             continue;